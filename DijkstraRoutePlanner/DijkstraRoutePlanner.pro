@@ -9,16 +9,42 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    contractionhierarchy.cpp \
+    distancetable.cpp \
+    edgegrid.cpp \
     graph.cpp \
+    isochrone.cpp \
+    kdtree.cpp \
+    landmarks.cpp \
     main.cpp \
     mainwindow.cpp \
-    mapwidget.cpp
+    maploader.cpp \
+    mapwidget.cpp \
+    routecache.cpp \
+    routeengine.cpp \
+    routeservice.cpp \
+    tilecache.cpp
 
 HEADERS += \
     Structs.h \
+    contractionhierarchy.h \
+    distancetable.h \
+    edgegrid.h \
+    edgeweights.h \
+    geo.h \
     graph.h \
+    indexedheap.h \
+    isochrone.h \
+    kdtree.h \
+    landmarks.h \
     mainwindow.h \
-    mapwidget.h
+    maploader.h \
+    mapwidget.h \
+    routecache.h \
+    routeengine.h \
+    routeservice.h \
+    searchspace.h \
+    tilecache.h
 
 FORMS += \
     mainwindow.ui
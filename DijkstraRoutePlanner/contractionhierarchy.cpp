@@ -0,0 +1,486 @@
+#include "contractionhierarchy.h"
+#include "graph.h"
+#include "searchspace.h"
+#include <QFile>
+#include <QSaveFile>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+namespace {
+
+const quint32 ChFileMagic = 0x31304843; // "CH01"
+const quint32 ChFileVersion = 1;
+
+// Settled-node limit of a single witness search. Hitting it only costs an
+// unnecessary shortcut, never a wrong distance.
+const int WitnessSettleLimit = 500;
+
+struct ChFileHeader {
+    quint32 magic;
+    quint32 version;
+    quint64 fingerprint;
+    qint32 nodeCount;
+    qint32 upCount;
+    qint32 downCount;
+    qint32 shortcutCount;
+};
+
+struct ChEdge {
+    int node;
+    double weight;
+    int middle;
+};
+
+struct Shortcut {
+    int from;
+    int to;
+    double weight;
+    int middle;
+};
+
+// Graph that shrinks as nodes are contracted. out[u] and in[u] only ever
+// reference nodes that are still uncontracted.
+struct DynamicGraph {
+    std::vector<std::vector<ChEdge>> out;
+    std::vector<std::vector<ChEdge>> in;
+
+    void addOrImprove(int from, int to, double weight, int middle) {
+        for (auto& e : out[from]) {
+            if (e.node != to) continue;
+            if (weight < e.weight) {
+                e.weight = weight;
+                e.middle = middle;
+                for (auto& r : in[to]) {
+                    if (r.node == from) {
+                        r.weight = weight;
+                        r.middle = middle;
+                    }
+                }
+            }
+            return;
+        }
+        out[from].push_back({to, weight, middle});
+        in[to].push_back({from, weight, middle});
+    }
+
+    static void removeNode(std::vector<ChEdge>& list, int node) {
+        list.erase(std::remove_if(list.begin(), list.end(),
+                                  [node](const ChEdge& e) { return e.node == node; }),
+                   list.end());
+    }
+};
+
+// Per-thread state of the witness searches.
+struct Witness {
+    SearchSpace space;
+    std::vector<unsigned> targetMark;
+    unsigned mark = 0;
+
+    void resize(int n) {
+        space.resize(n);
+        targetMark.assign(n, 0);
+        mark = 0;
+    }
+
+    // Shortcuts needed when v is contracted from the current graph.
+    void shortcutsFor(const DynamicGraph& g, int v, std::vector<Shortcut>& result) {
+        result.clear();
+        const auto& ins = g.in[v];
+        const auto& outs = g.out[v];
+        if (ins.empty() || outs.empty()) return;
+
+        double maxOut = 0;
+        for (const auto& o : outs) maxOut = std::max(maxOut, o.weight);
+
+        for (const auto& i : ins) {
+            int u = i.node;
+            double limit = i.weight + maxOut;
+
+            // The search can stop as soon as every out-neighbour is settled.
+            if (++mark == 0) {
+                std::fill(targetMark.begin(), targetMark.end(), 0);
+                mark = 1;
+            }
+            int targetsLeft = 0;
+            for (const auto& o : outs) {
+                if (o.node != u && targetMark[o.node] != mark) {
+                    targetMark[o.node] = mark;
+                    ++targetsLeft;
+                }
+            }
+
+            space.reset();
+            space.relax(u, 0, -1);
+            space.heap.push(u, 0);
+            while (targetsLeft > 0 && !space.heap.empty() && space.settledNodes() < WitnessSettleLimit) {
+                if (space.heap.topKey() > limit) break;
+                int x = space.heap.pop();
+                space.settle(x);
+                if (targetMark[x] == mark) --targetsLeft;
+                double dx = space.distance(x);
+                for (const auto& e : g.out[x]) {
+                    if (e.node == v) continue;
+                    double d = dx + e.weight;
+                    if (d <= limit && space.relax(e.node, d, x)) space.heap.push(e.node, d);
+                }
+            }
+
+            for (const auto& o : outs) {
+                int w = o.node;
+                if (w == u) continue;
+                double via = i.weight + o.weight;
+                // Only a strictly shorter witness may replace the shortcut:
+                // with ties, two nodes of the same batch could each rely on
+                // a witness through the other and both be removed.
+                if (space.distance(w) < via) continue;
+                result.push_back({u, w, via, v});
+            }
+        }
+    }
+};
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&](int thread) {
+        for (int i = next++; i < count; i = next++) fn(i, thread);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : threads) t.join();
+}
+
+template <typename T>
+bool readArray(QFile& file, std::vector<T>& out, size_t count) {
+    out.resize(count);
+    qint64 bytes = static_cast<qint64>(count * sizeof(T));
+    return bytes == 0 || file.read(reinterpret_cast<char*>(out.data()), bytes) == bytes;
+}
+
+// Offsets start at 0, never go down and end at count.
+bool validOffsets(const std::vector<int>& offsets, int count) {
+    if (offsets.empty() || offsets.front() != 0 || offsets.back() != count) return false;
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        if (offsets[i] < offsets[i - 1]) return false;
+    }
+    return true;
+}
+
+template <typename T>
+bool writeArray(QSaveFile& file, const std::vector<T>& data) {
+    qint64 bytes = static_cast<qint64>(data.size() * sizeof(T));
+    return bytes == 0 || file.write(reinterpret_cast<const char*>(data.data()), bytes) == bytes;
+}
+
+}
+
+ContractionHierarchy::ContractionHierarchy() : nodes(0), shortcuts(0), graphFingerprint(0) {}
+
+void ContractionHierarchy::clear() {
+    nodes = 0;
+    shortcuts = 0;
+    graphFingerprint = 0;
+    rank.clear();
+    upOffsets.clear();
+    upTargets.clear();
+    upWeights.clear();
+    upMiddle.clear();
+    downOffsets.clear();
+    downSources.clear();
+    downWeights.clear();
+    downMiddle.clear();
+}
+
+void ContractionHierarchy::build(const Graph& graph, const std::vector<float>& lengths, int threadCount) {
+    contract(graph, lengths, nullptr, threadCount, nullptr);
+}
+
+void ContractionHierarchy::rebuild(const Graph& graph, const std::vector<float>& lengths,
+                                   const ContractionHierarchy& previous, int threadCount,
+                                   const std::atomic<bool>* cancel) {
+    if (previous.nodeCount() != graph.nodeCount() || previous.graphFingerprint != graph.fingerprint()) {
+        contract(graph, lengths, nullptr, threadCount, cancel);
+    } else {
+        contract(graph, lengths, &previous.rank, threadCount, cancel);
+    }
+}
+
+// With an order the priorities are simply the ranks: batches are then the
+// uncontracted nodes ranked below all their neighbours, and contracting
+// them cannot change anyone's priority.
+void ContractionHierarchy::contract(const Graph& graph, const std::vector<float>& lengths,
+                                    const std::vector<int>* order, int threadCount,
+                                    const std::atomic<bool>* cancel) {
+    clear();
+    int n = graph.nodeCount();
+    if (n == 0) return;
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    DynamicGraph g;
+    g.out.resize(n);
+    g.in.resize(n);
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    for (int u = 0; u < n; ++u) {
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            if (targets[e] != u && !std::isinf(lengths[e])) g.addOrImprove(u, targets[e], lengths[e], -1);
+        }
+    }
+
+    std::vector<Witness> witnesses(threadCount);
+    for (auto& w : witnesses) w.resize(n);
+    std::vector<std::vector<Shortcut>> scratch(threadCount);
+
+    std::vector<int> contractedNeighbors(n, 0);
+    std::vector<int> priority(n, 0);
+    auto updatePriority = [&](int v, int thread) {
+        witnesses[thread].shortcutsFor(g, v, scratch[thread]);
+        int edgeDifference = static_cast<int>(scratch[thread].size()) -
+                             static_cast<int>(g.in[v].size() + g.out[v].size());
+        priority[v] = 2 * edgeDifference + contractedNeighbors[v];
+    };
+    if (order) priority = *order;
+    else parallelFor(n, threadCount, updatePriority);
+
+    // Final hierarchy edges, collected as each node is contracted.
+    std::vector<std::vector<ChEdge>> up(n);
+    std::vector<std::vector<ChEdge>> down(n);
+
+    rank.assign(n, -1);
+    std::vector<int> remaining(n);
+    for (int v = 0; v < n; ++v) remaining[v] = v;
+    std::vector<std::vector<Shortcut>> pending;
+    std::vector<char> touched(n, 0);
+    int nextRank = 0;
+
+    while (!remaining.empty()) {
+        if (cancel && *cancel) {
+            clear();
+            return;
+        }
+        auto lessThan = [&](int a, int b) {
+            return priority[a] < priority[b] || (priority[a] == priority[b] && a < b);
+        };
+        std::vector<int> batch;
+        for (int v : remaining) {
+            bool minimal = true;
+            for (const auto& e : g.out[v]) {
+                if (!lessThan(v, e.node)) { minimal = false; break; }
+            }
+            if (minimal) {
+                for (const auto& e : g.in[v]) {
+                    if (!lessThan(v, e.node)) { minimal = false; break; }
+                }
+            }
+            if (minimal) batch.push_back(v);
+        }
+
+        pending.assign(batch.size(), std::vector<Shortcut>());
+        parallelFor(static_cast<int>(batch.size()), threadCount, [&](int i, int thread) {
+            witnesses[thread].shortcutsFor(g, batch[i], pending[i]);
+        });
+
+        std::vector<int> neighbors;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            int v = batch[i];
+            rank[v] = nextRank++;
+            up[v] = g.out[v];
+            down[v] = g.in[v];
+
+            for (const auto& e : g.out[v]) {
+                DynamicGraph::removeNode(g.in[e.node], v);
+                contractedNeighbors[e.node]++;
+                if (!touched[e.node]) { touched[e.node] = 1; neighbors.push_back(e.node); }
+            }
+            for (const auto& e : g.in[v]) {
+                DynamicGraph::removeNode(g.out[e.node], v);
+                contractedNeighbors[e.node]++;
+                if (!touched[e.node]) { touched[e.node] = 1; neighbors.push_back(e.node); }
+            }
+            g.out[v].clear();
+            g.in[v].clear();
+
+            for (const auto& s : pending[i]) {
+                g.addOrImprove(s.from, s.to, s.weight, s.middle);
+            }
+        }
+
+        for (int w : neighbors) touched[w] = 0;
+        if (!order) {
+            parallelFor(static_cast<int>(neighbors.size()), threadCount, [&](int i, int thread) {
+                updatePriority(neighbors[i], thread);
+            });
+        }
+
+        remaining.erase(std::remove_if(remaining.begin(), remaining.end(),
+                                       [&](int v) { return rank[v] >= 0; }),
+                        remaining.end());
+    }
+
+    upOffsets.assign(n + 1, 0);
+    downOffsets.assign(n + 1, 0);
+    for (int v = 0; v < n; ++v) {
+        upOffsets[v + 1] = upOffsets[v] + static_cast<int>(up[v].size());
+        downOffsets[v + 1] = downOffsets[v] + static_cast<int>(down[v].size());
+    }
+    for (int v = 0; v < n; ++v) {
+        for (const auto& e : up[v]) {
+            upTargets.push_back(e.node);
+            upWeights.push_back(e.weight);
+            upMiddle.push_back(e.middle);
+            if (e.middle >= 0) ++shortcuts;
+        }
+        for (const auto& e : down[v]) {
+            downSources.push_back(e.node);
+            downWeights.push_back(e.weight);
+            downMiddle.push_back(e.middle);
+            if (e.middle >= 0) ++shortcuts;
+        }
+    }
+
+    nodes = n;
+    graphFingerprint = graph.fingerprint();
+}
+
+int ContractionHierarchy::findMiddle(int u, int v) const {
+    if (rank[u] < rank[v]) {
+        for (int e = upOffsets[u]; e < upOffsets[u + 1]; ++e) {
+            if (upTargets[e] == v) return upMiddle[e];
+        }
+    } else {
+        for (int e = downOffsets[v]; e < downOffsets[v + 1]; ++e) {
+            if (downSources[e] == u) return downMiddle[e];
+        }
+    }
+    return -1;
+}
+
+void ContractionHierarchy::unpackEdge(int u, int v, std::vector<int>& path) const {
+    // Explicit stack of edges still to expand, last one on top.
+    std::vector<std::pair<int, int>> stack(1, {u, v});
+    while (!stack.empty()) {
+        std::pair<int, int> edge = stack.back();
+        stack.pop_back();
+        int middle = findMiddle(edge.first, edge.second);
+        if (middle < 0) {
+            path.push_back(edge.second);
+        } else {
+            stack.push_back({middle, edge.second});
+            stack.push_back({edge.first, middle});
+        }
+    }
+}
+
+bool ContractionHierarchy::load(const QString& filePath, const Graph& graph) {
+    clear();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    ChFileHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != ChFileMagic || header.version != ChFileVersion) return false;
+    if (header.fingerprint != graph.fingerprint() || header.nodeCount != graph.nodeCount()) return false;
+    if (header.upCount < 0 || header.downCount < 0 || header.shortcutCount < 0 ||
+        header.shortcutCount > static_cast<qint64>(header.upCount) + header.downCount) {
+        return false;
+    }
+
+    // Check the size before allocating anything from the counts.
+    const qint64 perEdge = sizeof(int) + sizeof(double) + sizeof(int);
+    qint64 n = header.nodeCount;
+    qint64 expected = static_cast<qint64>(sizeof(header)) + n * sizeof(int) + 2 * (n + 1) * sizeof(int) +
+                      (static_cast<qint64>(header.upCount) + header.downCount) * perEdge;
+    if (file.size() != expected) return false;
+
+    if (!readArray(file, rank, n) ||
+        !readArray(file, upOffsets, n + 1) ||
+        !readArray(file, upTargets, header.upCount) ||
+        !readArray(file, upWeights, header.upCount) ||
+        !readArray(file, upMiddle, header.upCount) ||
+        !readArray(file, downOffsets, n + 1) ||
+        !readArray(file, downSources, header.downCount) ||
+        !readArray(file, downWeights, header.downCount) ||
+        !readArray(file, downMiddle, header.downCount) ||
+        !validArrays()) {
+        clear();
+        return false;
+    }
+
+    nodes = header.nodeCount;
+    shortcuts = header.shortcutCount;
+    graphFingerprint = header.fingerprint;
+    return true;
+}
+
+// Everything queries and unpacking rely on: ranks are a permutation, the
+// offsets cover the arc arrays, every arc leads to a higher rank, weights
+// are numbers >= 0 and a middle node ranks below both ends of its
+// shortcut, so unpacking always ends.
+bool ContractionHierarchy::validArrays() const {
+    int n = static_cast<int>(rank.size());
+    std::vector<char> seen(n, 0);
+    for (int r : rank) {
+        if (r < 0 || r >= n || seen[r]) return false;
+        seen[r] = 1;
+    }
+    if (!validOffsets(upOffsets, static_cast<int>(upTargets.size())) ||
+        !validOffsets(downOffsets, static_cast<int>(downSources.size()))) {
+        return false;
+    }
+
+    auto validArc = [&](int low, int high, double weight, int middle) {
+        if (high < 0 || high >= n || rank[high] <= rank[low] || !(weight >= 0)) return false;
+        return middle == -1 || (middle >= 0 && middle < n && rank[middle] < rank[low]);
+    };
+    for (int v = 0; v < n; ++v) {
+        for (int e = upOffsets[v]; e < upOffsets[v + 1]; ++e) {
+            if (!validArc(v, upTargets[e], upWeights[e], upMiddle[e])) return false;
+        }
+        for (int e = downOffsets[v]; e < downOffsets[v + 1]; ++e) {
+            if (!validArc(v, downSources[e], downWeights[e], downMiddle[e])) return false;
+        }
+    }
+    return true;
+}
+
+bool ContractionHierarchy::save(const QString& filePath) const {
+    if (isEmpty()) return false;
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    ChFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = ChFileMagic;
+    header.version = ChFileVersion;
+    header.fingerprint = graphFingerprint;
+    header.nodeCount = nodes;
+    header.upCount = static_cast<qint32>(upTargets.size());
+    header.downCount = static_cast<qint32>(downSources.size());
+    header.shortcutCount = shortcuts;
+
+    if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (!writeArray(file, rank) ||
+        !writeArray(file, upOffsets) || !writeArray(file, upTargets) ||
+        !writeArray(file, upWeights) || !writeArray(file, upMiddle) ||
+        !writeArray(file, downOffsets) || !writeArray(file, downSources) ||
+        !writeArray(file, downWeights) || !writeArray(file, downMiddle)) {
+        return false;
+    }
+    return file.commit();
+}
+
+bool ContractionHierarchy::isEmpty() const { return nodes == 0; }
+int ContractionHierarchy::nodeCount() const { return nodes; }
+int ContractionHierarchy::shortcutCount() const { return shortcuts; }
+
+const std::vector<int>& ContractionHierarchy::getRanks() const { return rank; }
+
+const std::vector<int>& ContractionHierarchy::getUpOffsets() const { return upOffsets; }
+const std::vector<int>& ContractionHierarchy::getUpTargets() const { return upTargets; }
+const std::vector<double>& ContractionHierarchy::getUpWeights() const { return upWeights; }
+
+const std::vector<int>& ContractionHierarchy::getDownOffsets() const { return downOffsets; }
+const std::vector<int>& ContractionHierarchy::getDownSources() const { return downSources; }
+const std::vector<double>& ContractionHierarchy::getDownWeights() const { return downWeights; }
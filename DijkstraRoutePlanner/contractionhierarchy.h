@@ -0,0 +1,83 @@
+#ifndef CONTRACTIONHIERARCHY_H
+#define CONTRACTIONHIERARCHY_H
+
+#include <QString>
+#include <vector>
+#include <atomic>
+
+class Graph;
+
+// Contraction Hierarchies over a loaded Graph.
+//
+// Preprocessing contracts nodes in order of increasing priority (edge
+// difference plus the number of already contracted neighbours). Rounds pick
+// an independent set of locally minimal nodes, run their witness searches in
+// parallel and then insert the resulting shortcuts.
+//
+// The result is split into two CSR graphs over the original node indices:
+//   up:   edges u -> v with rank[u] < rank[v], grouped by u
+//   down: edges u -> v with rank[u] > rank[v], grouped by v
+// so a forward search from the source scans "up" and a backward search from
+// the target scans "down", both only ever climbing in rank. Shortcuts keep
+// their middle node so a path can be unpacked back to original edges.
+class ContractionHierarchy {
+public:
+    ContractionHierarchy();
+
+    // Contracts the graph with the given forward edge lengths; closed
+    // (infinite) edges are left out. threadCount <= 0 uses every available
+    // core.
+    void build(const Graph& graph, const std::vector<float>& lengths, int threadCount = 0);
+    // Same for new lengths, contracting in the order of an earlier hierarchy
+    // of the same graph instead of choosing one. That skips every priority
+    // update, which is most of the work, and an order that was good for
+    // the old lengths stays good when only some of them change. Setting
+    // cancel stops the contraction and leaves the hierarchy empty.
+    void rebuild(const Graph& graph, const std::vector<float>& lengths, const ContractionHierarchy& previous,
+                 int threadCount = 0, const std::atomic<bool>* cancel = nullptr);
+
+    bool load(const QString& filePath, const Graph& graph);
+    bool save(const QString& filePath) const;
+
+    void clear();
+    bool isEmpty() const;
+    int nodeCount() const;
+    int shortcutCount() const;
+
+    const std::vector<int>& getRanks() const;
+
+    const std::vector<int>& getUpOffsets() const;
+    const std::vector<int>& getUpTargets() const;
+    const std::vector<double>& getUpWeights() const;
+
+    const std::vector<int>& getDownOffsets() const;
+    const std::vector<int>& getDownSources() const;
+    const std::vector<double>& getDownWeights() const;
+
+    // Expands the hierarchy edge u -> v into original nodes, appending
+    // everything after u (up to and including v) to path.
+    void unpackEdge(int u, int v, std::vector<int>& path) const;
+
+private:
+    int nodes;
+    int shortcuts;
+    unsigned long long graphFingerprint;
+    std::vector<int> rank;
+
+    std::vector<int> upOffsets;
+    std::vector<int> upTargets;
+    std::vector<double> upWeights;
+    std::vector<int> upMiddle;
+
+    std::vector<int> downOffsets;
+    std::vector<int> downSources;
+    std::vector<double> downWeights;
+    std::vector<int> downMiddle;
+
+    void contract(const Graph& graph, const std::vector<float>& lengths, const std::vector<int>* order,
+                  int threadCount, const std::atomic<bool>* cancel);
+    bool validArrays() const;
+    int findMiddle(int u, int v) const;
+};
+
+#endif // CONTRACTIONHIERARCHY_H
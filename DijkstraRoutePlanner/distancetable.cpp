@@ -0,0 +1,195 @@
+#include "distancetable.h"
+#include "graph.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+struct BucketEntry {
+    int target;
+    double distance;
+};
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&](int thread) {
+        for (int i = next++; i < count; i = next++) fn(i, thread);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : threads) t.join();
+}
+
+// Exhaustive search over one half of the hierarchy with stall-on-demand.
+// visit(u, du) is called for every settled node that is not stalled; those
+// are exactly the nodes whose label may be a shortest distance.
+template <typename Visit>
+void upwardSearch(SearchSpace& space, int start,
+                  const std::vector<int>& off, const std::vector<int>& adj, const std::vector<double>& weight,
+                  const std::vector<int>& stallOff, const std::vector<int>& stallAdj,
+                  const std::vector<double>& stallWeight, Visit visit) {
+    space.reset();
+    space.relax(start, 0, -1);
+    space.heap.push(start, 0);
+
+    while (!space.heap.empty()) {
+        int u = space.heap.pop();
+        space.settle(u);
+        double du = space.distance(u);
+
+        bool stalled = false;
+        for (int e = stallOff[u]; e < stallOff[u + 1]; ++e) {
+            if (space.distance(stallAdj[e]) + stallWeight[e] < du) {
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled) continue;
+
+        visit(u, du);
+        for (int e = off[u]; e < off[u + 1]; ++e) {
+            int v = adj[e];
+            double dv = du + weight[e];
+            if (space.relax(v, dv, u)) space.heap.push(v, dv);
+        }
+    }
+}
+
+}
+
+DistanceTable::DistanceTable(const Graph& graph) : graph(graph) {}
+
+// Sized for the graph as it is now, which may have been reloaded since the
+// last call.
+void DistanceTable::prepareWorkers(int threadCount) {
+    if (static_cast<int>(workers.size()) < threadCount) workers.resize(threadCount);
+    int n = graph.nodeCount();
+    for (int t = 0; t < threadCount; ++t) {
+        Worker& w = workers[t];
+        if (w.space.size() != n) {
+            w.space.resize(n);
+            w.isTarget.assign(n, 0);
+        }
+    }
+}
+
+void DistanceTable::runOneToMany(Worker& w, const EdgeWeights& weights, int source, const std::vector<int>& targets,
+                                 double* row) const {
+    std::fill(row, row + targets.size(), SearchSpace::Infinity);
+    if (source < 0) return;
+
+    int remaining = 0;
+    for (int t : targets) {
+        if (t >= 0 && !w.isTarget[t]) {
+            w.isTarget[t] = 1;
+            ++remaining;
+        }
+    }
+
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& edgeTargets = graph.getEdgeTargets();
+    const auto& lengths = weights.forward;
+
+    SearchSpace& space = w.space;
+    space.reset();
+    space.relax(source, 0, -1);
+    space.heap.push(source, 0);
+    while (remaining > 0 && !space.heap.empty()) {
+        int u = space.heap.pop();
+        space.settle(u);
+        if (w.isTarget[u]) --remaining;
+
+        double du = space.distance(u);
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = edgeTargets[e];
+            double dv = du + lengths[e];
+            if (space.relax(v, dv, u)) space.heap.push(v, dv);
+        }
+    }
+
+    for (size_t j = 0; j < targets.size(); ++j) {
+        int t = targets[j];
+        if (t < 0) continue;
+        if (space.isSettled(t)) row[j] = space.distance(t);
+        w.isTarget[t] = 0;
+    }
+}
+
+std::vector<double> DistanceTable::oneToMany(int source, const std::vector<int>& targets) {
+    std::vector<double> row(targets.size());
+    prepareWorkers(1);
+    runOneToMany(workers[0], *graph.getWeights(), source, targets, row.data());
+    return row;
+}
+
+std::vector<double> DistanceTable::manyToMany(const std::vector<int>& sources, const std::vector<int>& targets,
+                                              int threadCount) {
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::max(1, std::min(threadCount, static_cast<int>(std::max(sources.size(), targets.size()))));
+
+    prepareWorkers(threadCount);
+    std::shared_ptr<const EdgeWeights> weights = graph.getWeights();
+    if (weights->hierarchy) {
+        return bucketMatrix(*weights->hierarchy, sources, targets, threadCount);
+    }
+
+    size_t columns = targets.size();
+    std::vector<double> matrix(sources.size() * columns);
+    parallelFor(static_cast<int>(sources.size()), threadCount, [&](int i, int thread) {
+        runOneToMany(workers[thread], *weights, sources[i], targets, matrix.data() + i * columns);
+    });
+    return matrix;
+}
+
+std::vector<double> DistanceTable::bucketMatrix(const ContractionHierarchy& ch, const std::vector<int>& sources,
+                                                const std::vector<int>& targets, int threadCount) {
+    const auto& upOffsets = ch.getUpOffsets();
+    const auto& upTargets = ch.getUpTargets();
+    const auto& upWeights = ch.getUpWeights();
+    const auto& downOffsets = ch.getDownOffsets();
+    const auto& downSources = ch.getDownSources();
+    const auto& downWeights = ch.getDownWeights();
+    int n = graph.nodeCount();
+
+    // Backward searches from the targets, each thread collecting its own
+    // (node, entry) pairs.
+    std::vector<std::vector<std::pair<int, BucketEntry>>> collected(threadCount);
+    parallelFor(static_cast<int>(targets.size()), threadCount, [&](int j, int thread) {
+        if (targets[j] < 0) return;
+        upwardSearch(workers[thread].space, targets[j], downOffsets, downSources, downWeights,
+                     upOffsets, upTargets, upWeights, [&](int u, double du) {
+            collected[thread].push_back({u, {j, du}});
+        });
+    });
+
+    // Buckets in CSR form, indexed by node.
+    std::vector<int> bucketOffsets(n + 1, 0);
+    for (const auto& entries : collected) {
+        for (const auto& e : entries) ++bucketOffsets[e.first + 1];
+    }
+    for (int v = 0; v < n; ++v) bucketOffsets[v + 1] += bucketOffsets[v];
+    std::vector<BucketEntry> buckets(bucketOffsets[n]);
+    std::vector<int> fill(bucketOffsets.begin(), bucketOffsets.end() - 1);
+    for (auto& entries : collected) {
+        for (const auto& e : entries) buckets[fill[e.first]++] = e.second;
+        entries = std::vector<std::pair<int, BucketEntry>>();
+    }
+
+    size_t columns = targets.size();
+    std::vector<double> matrix(sources.size() * columns, SearchSpace::Infinity);
+    parallelFor(static_cast<int>(sources.size()), threadCount, [&](int i, int thread) {
+        if (sources[i] < 0) return;
+        double* row = matrix.data() + i * columns;
+        upwardSearch(workers[thread].space, sources[i], upOffsets, upTargets, upWeights,
+                     downOffsets, downSources, downWeights, [&](int u, double du) {
+            for (int b = bucketOffsets[u]; b < bucketOffsets[u + 1]; ++b) {
+                double d = du + buckets[b].distance;
+                if (d < row[buckets[b].target]) row[buckets[b].target] = d;
+            }
+        });
+    });
+    return matrix;
+}
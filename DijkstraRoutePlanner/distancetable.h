@@ -0,0 +1,50 @@
+#ifndef DISTANCETABLE_H
+#define DISTANCETABLE_H
+
+#include <vector>
+#include "searchspace.h"
+#include "edgeweights.h"
+
+class Graph;
+
+// Distances from a set of sources to a set of targets, given as node
+// indices. Unreachable pairs and indices of -1 get SearchSpace::Infinity.
+// Each call runs on the weight state current when it starts. The search
+// spaces are kept between calls, so keep the table around for repeated
+// queries; a table serves one call at a time.
+class DistanceTable {
+public:
+    explicit DistanceTable(const Graph& graph);
+
+    // A single Dijkstra search from the source that stops as soon as every
+    // target is settled. Entry j is the distance to targets[j].
+    std::vector<double> oneToMany(int source, const std::vector<int>& targets);
+
+    // Dense row-major |sources| x |targets| matrix. With a contraction
+    // hierarchy for the current weights this is the bucket algorithm: one upward backward search per
+    // target leaves (target, distance) entries in buckets at every node it
+    // settles, and one upward forward search per source then combines its
+    // labels with the buckets it meets. Without one it runs a one-to-many
+    // search per source. Either way the searches are spread over threadCount
+    // threads (<= 0 uses every available core).
+    std::vector<double> manyToMany(const std::vector<int>& sources, const std::vector<int>& targets,
+                                   int threadCount = 0);
+
+private:
+    struct Worker {
+        SearchSpace space;
+        std::vector<char> isTarget;
+    };
+
+    const Graph& graph;
+    // One per thread of the widest call so far; oneToMany() uses the first.
+    std::vector<Worker> workers;
+
+    void prepareWorkers(int threadCount);
+    void runOneToMany(Worker& w, const EdgeWeights& weights, int source, const std::vector<int>& targets,
+                      double* row) const;
+    std::vector<double> bucketMatrix(const ContractionHierarchy& ch, const std::vector<int>& sources,
+                                     const std::vector<int>& targets, int threadCount);
+};
+
+#endif // DISTANCETABLE_H
@@ -0,0 +1,142 @@
+#include "edgegrid.h"
+#include "graph.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Average number of segments per cell the grid is sized for.
+const int SegmentsPerCell = 16;
+const int MaxCellsPerSide = 1024;
+
+}
+
+EdgeGrid::EdgeGrid() : columns(0), rows(0) {}
+
+void EdgeGrid::clear() {
+    columns = 0;
+    rows = 0;
+    from.clear();
+    to.clear();
+    minU.clear();
+    minV.clear();
+    extentU.clear();
+    extentV.clear();
+    cellOffsets.clear();
+    cellSegments.clear();
+}
+
+bool EdgeGrid::isEmpty() const {
+    return from.empty();
+}
+
+int EdgeGrid::segmentCount() const {
+    return static_cast<int>(from.size());
+}
+
+int EdgeGrid::columnOf(double u) const {
+    return std::min(columns - 1, std::max(0, static_cast<int>(u * columns)));
+}
+
+int EdgeGrid::rowOf(double v) const {
+    return std::min(rows - 1, std::max(0, static_cast<int>(v * rows)));
+}
+
+void EdgeGrid::build(const Graph& graph) {
+    clear();
+
+    const auto& nodes = graph.getNodes();
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    int n = graph.nodeCount();
+
+    std::vector<float> us(n);
+    std::vector<float> vs(n);
+    for (int i = 0; i < n; ++i) {
+        us[i] = static_cast<float>((nodes[i].lon - graph.minLon) / graph.lonRange());
+        vs[i] = static_cast<float>((nodes[i].lat - graph.minLat) / graph.latRange());
+    }
+
+    auto hasArc = [&](int u, int v) {
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            if (targets[e] == v) return true;
+        }
+        return false;
+    };
+
+    for (int u = 0; u < n; ++u) {
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = targets[e];
+            if (v == u || (v < u && hasArc(v, u))) continue;
+            from.push_back(u);
+            to.push_back(v);
+            minU.push_back(std::min(us[u], us[v]));
+            minV.push_back(std::min(vs[u], vs[v]));
+            extentU.push_back(std::abs(us[u] - us[v]));
+            extentV.push_back(std::abs(vs[u] - vs[v]));
+        }
+    }
+
+    int m = segmentCount();
+    int side = static_cast<int>(std::sqrt(static_cast<double>(m) / SegmentsPerCell));
+    columns = std::max(1, std::min(MaxCellsPerSide, side));
+    rows = columns;
+
+    // Longest first, so every cell ends up sorted by the counting sort below.
+    std::vector<int> order(m);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        return std::max(extentU[a], extentV[a]) > std::max(extentU[b], extentV[b]);
+    });
+
+    cellOffsets.assign(static_cast<size_t>(columns) * rows + 1, 0);
+    for (int s : order) {
+        for (int r = rowOf(minV[s]); r <= rowOf(minV[s] + extentV[s]); ++r) {
+            for (int c = columnOf(minU[s]); c <= columnOf(minU[s] + extentU[s]); ++c) {
+                ++cellOffsets[r * columns + c + 1];
+            }
+        }
+    }
+    for (size_t i = 1; i < cellOffsets.size(); ++i) cellOffsets[i] += cellOffsets[i - 1];
+
+    std::vector<int> fill(cellOffsets.begin(), cellOffsets.end() - 1);
+    cellSegments.resize(cellOffsets.back());
+    for (int s : order) {
+        for (int r = rowOf(minV[s]); r <= rowOf(minV[s] + extentV[s]); ++r) {
+            for (int c = columnOf(minU[s]); c <= columnOf(minU[s] + extentU[s]); ++c) {
+                cellSegments[fill[r * columns + c]++] = s;
+            }
+        }
+    }
+}
+
+void EdgeGrid::query(double qMinU, double qMinV, double qMaxU, double qMaxV,
+                     double pixelsPerU, double pixelsPerV, double minPixels,
+                     std::vector<int>& segments) const {
+    if (isEmpty() || qMaxU < 0 || qMaxV < 0 || qMinU > 1 || qMinV > 1) return;
+
+    int c0 = columnOf(qMinU), c1 = columnOf(qMaxU);
+    int r0 = rowOf(qMinV), r1 = rowOf(qMaxV);
+    double maxPixelsPerUnit = std::max(pixelsPerU, pixelsPerV);
+
+    for (int r = r0; r <= r1; ++r) {
+        for (int c = c0; c <= c1; ++c) {
+            int cell = r * columns + c;
+            for (int i = cellOffsets[cell]; i < cellOffsets[cell + 1]; ++i) {
+                int s = cellSegments[i];
+                if (std::max(extentU[s], extentV[s]) * maxPixelsPerUnit < minPixels) break;
+                if (std::max(extentU[s] * pixelsPerU, extentV[s] * pixelsPerV) < minPixels) continue;
+                if (minU[s] > qMaxU || minU[s] + extentU[s] < qMinU) continue;
+                if (minV[s] > qMaxV || minV[s] + extentV[s] < qMinV) continue;
+
+                // A segment spanning several visible cells is reported by the
+                // first of them only: the cell holding the lower corner of
+                // its overlap with the query rectangle.
+                if (columnOf(std::max<double>(minU[s], qMinU)) != c) continue;
+                if (rowOf(std::max<double>(minV[s], qMinV)) != r) continue;
+                segments.push_back(s);
+            }
+        }
+    }
+}
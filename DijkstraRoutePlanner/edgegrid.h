@@ -0,0 +1,52 @@
+#ifndef EDGEGRID_H
+#define EDGEGRID_H
+
+#include <vector>
+
+class Graph;
+
+// Uniform grid over the road segments, in the normalized [0, 1] x [0, 1]
+// lat/lon space of the map, so it survives widget resizes. A segment is
+// listed in every cell its bounding box overlaps, and each cell keeps its
+// segments ordered from longest to shortest so that a query can stop at the
+// first segment that would be too small to see.
+//
+// Two-way roads are stored once.
+class EdgeGrid {
+public:
+    EdgeGrid();
+
+    void build(const Graph& graph);
+    void clear();
+    bool isEmpty() const;
+    int segmentCount() const;
+
+    // Appends the segments overlapping the rectangle [minU, maxU] x [minV, maxV]
+    // whose extent, at pixelsPerU / pixelsPerV pixels per normalized unit, is
+    // at least minPixels. Every segment is reported at most once.
+    void query(double minU, double minV, double maxU, double maxV,
+               double pixelsPerU, double pixelsPerV, double minPixels,
+               std::vector<int>& segments) const;
+
+    int segmentFrom(int segment) const { return from[segment]; }
+    int segmentTo(int segment) const { return to[segment]; }
+
+private:
+    int columns;
+    int rows;
+
+    std::vector<int> from;
+    std::vector<int> to;
+    std::vector<float> minU;
+    std::vector<float> minV;
+    std::vector<float> extentU;
+    std::vector<float> extentV;
+
+    std::vector<int> cellOffsets;
+    std::vector<int> cellSegments;
+
+    int columnOf(double u) const;
+    int rowOf(double v) const;
+};
+
+#endif // EDGEGRID_H
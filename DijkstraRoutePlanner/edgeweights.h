@@ -0,0 +1,45 @@
+#ifndef EDGEWEIGHTS_H
+#define EDGEWEIGHTS_H
+
+#include <vector>
+#include <memory>
+#include <limits>
+
+class Landmarks;
+class ContractionHierarchy;
+
+// Length change of one directed edge. The factor scales the length read from
+// the map, so updates replace each other instead of compounding: 1 restores
+// the edge and Closed takes it out of every route.
+struct EdgeWeightUpdate {
+    static constexpr double Closed = std::numeric_limits<double>::infinity();
+
+    long fromNodeId;
+    long toNodeId;
+    double factor;
+};
+
+// One traffic state of the edge lengths together with the preprocessing
+// that is valid for it. A state is published as a whole and never modified
+// afterwards, so a query that holds on to it sees the same lengths from
+// start to end while newer states are being applied.
+struct EdgeWeights {
+    // 0 for the lengths of the map file, incremented by every update.
+    unsigned version;
+    // Parallel to the forward and reverse edge arrays of the Graph; closed
+    // edges are infinite.
+    std::vector<float> forward;
+    std::vector<float> reverse;
+    // Smallest length per meter of great-circle distance over all edges.
+    // Updates only ever lower it, so the A* bound stays admissible; a reset
+    // puts back the value of the map.
+    double lengthPerMeter;
+    // Null until prepared. The landmark tables stay valid lower bounds when
+    // edges get longer and are repaired when they get shorter; the hierarchy
+    // only holds for the lengths it was built from, so a new state starts
+    // without one and gets it from the rebuild in the background.
+    std::shared_ptr<const Landmarks> landmarks;
+    std::shared_ptr<const ContractionHierarchy> hierarchy;
+};
+
+#endif // EDGEWEIGHTS_H
@@ -0,0 +1,21 @@
+#ifndef GEO_H
+#define GEO_H
+
+#include <cmath>
+#include <algorithm>
+
+const double EarthRadiusMeters = 6371008.8;
+const double DegToRad = 3.14159265358979323846 / 180.0;
+
+// Haversine distance between two WGS84 points, in meters.
+inline double greatCircleMeters(double lat1, double lon1, double lat2, double lon2) {
+    double p1 = lat1 * DegToRad;
+    double p2 = lat2 * DegToRad;
+    double dp = p2 - p1;
+    double dl = (lon2 - lon1) * DegToRad;
+    double h = std::sin(dp / 2) * std::sin(dp / 2) +
+               std::cos(p1) * std::cos(p2) * std::sin(dl / 2) * std::sin(dl / 2);
+    return 2 * EarthRadiusMeters * std::asin(std::sqrt(std::min(1.0, h)));
+}
+
+#endif // GEO_H
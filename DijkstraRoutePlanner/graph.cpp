@@ -1,26 +1,151 @@
 #include "graph.h"
+#include "geo.h"
+#include "maploader.h"
+#include "distancetable.h"
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>
+
+namespace {
+
+const quint32 SnapshotMagic = 0x31534752; // "RGS1"
+const quint32 SnapshotVersion = 2;
+
+struct SnapshotHeader {
+    quint32 magic;
+    quint32 version;
+    qint64 sourceSize;
+    qint64 sourceModified;
+    quint64 fingerprint;
+    qint32 nodeCount;
+    qint32 edgeCount;
+    qint32 nodeOrder;
+    qint32 reserved;
+    double minLat;
+    double maxLat;
+    double minLon;
+    double maxLon;
+    double lengthPerMeter;
+};
+
+// Copies count elements of T out of the mapped snapshot and advances p.
+template <typename T>
+void readSection(const uchar*& p, std::vector<T>& out, size_t count) {
+    out.resize(count);
+    if (count > 0) std::memcpy(out.data(), p, count * sizeof(T));
+    p += count * sizeof(T);
+}
+
+template <typename T>
+bool writeSection(QSaveFile& file, const std::vector<T>& data) {
+    qint64 bytes = static_cast<qint64>(data.size() * sizeof(T));
+    return bytes == 0 || file.write(reinterpret_cast<const char*>(data.data()), bytes) == bytes;
+}
+
+// Position of (x, y) along a Hilbert curve filling a 2^16 x 2^16 grid.
+quint64 hilbertIndex(quint32 x, quint32 y) {
+    const quint32 side = 1u << 16;
+    quint64 d = 0;
+    for (quint32 s = side / 2; s > 0; s /= 2) {
+        quint32 rx = (x & s) ? 1 : 0;
+        quint32 ry = (y & s) ? 1 : 0;
+        d += static_cast<quint64>(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+}
+
+Graph::Graph() : nodeOrder(HilbertOrder), hierarchyStale(false), hierarchyStop(false), viewWidth(0), viewHeight(0) {
+    clear();
+}
+
+Graph::~Graph() {
+    stopHierarchyWorker();
+}
+
+void Graph::setNodeOrder(NodeOrder order) {
+    nodeOrder = order;
+}
+
+NodeOrder Graph::getNodeOrder() const {
+    return nodeOrder;
+}
+
+void Graph::clear() {
+    // The worker reads the edge arrays, so it has to be gone first.
+    stopHierarchyWorker();
+    nodes.clear();
+    edgeOffsets.assign(1, 0);
+    edgeTargets.clear();
+    edgeLengths.clear();
+    reverseOffsets.assign(1, 0);
+    reverseSources.clear();
+    reverseLengths.clear();
+    sortedIds.clear();
+    sortedIdIndex.clear();
+    sourcePath.clear();
+    layoutFingerprint = 0;
+    lengthPerMeter = 0;
+    reverseSlots.clear();
+    engine.reset();
+    {
+        std::lock_guard<std::mutex> lock(distanceTableMutex);
+        distanceTable.reset();
+    }
+    initWeights();
+    routeCache.invalidate(0);
+
+    spatialIndex.clear();
 
-Graph::Graph() : root(nullptr) {
     minLat = std::numeric_limits<double>::max();
     maxLat = std::numeric_limits<double>::lowest();
     minLon = std::numeric_limits<double>::max();
     maxLon = std::numeric_limits<double>::lowest();
 }
 
-Graph::~Graph() {
-    clearKdTree(root);
-}
+bool Graph::loadFromXml(const QString& filePath) {
+    clear();
+
+    QString snapshotPath = filePath + ".graph";
+    if (loadSnapshot(snapshotPath, filePath)) {
+        sourcePath = filePath;
+        buildReverseSlots();
+        buildSpatialIndex();
+        initWeights();
+        return true;
+    }
+
+    std::vector<Node> parsedNodes;
+    std::vector<Arc> arcs;
+    // The snapshot is only written for files that parsed without errors.
+    bool ok = true;
+    if (!MapLoader::parseXml(filePath, parsedNodes, arcs)) {
+        QFile file(filePath);
+        if (!file.exists()) return false;
+        parsedNodes.clear();
+        arcs.clear();
+        ok = readXmlStream(filePath, parsedNodes, arcs);
+    }
 
-void Graph::clearKdTree(KdNode* node) {
-    if (node == nullptr) return;
-    clearKdTree(node->left);
-    clearKdTree(node->right);
-    delete node;
+    buildGraph(parsedNodes, arcs);
+    sourcePath = filePath;
+    buildSpatialIndex();
+    initWeights();
+    if (ok) saveSnapshot(snapshotPath, filePath);
+    return ok;
 }
 
-bool Graph::loadFromXml(const QString& filePath) {
+bool Graph::readXmlStream(const QString& filePath, std::vector<Node>& parsedNodes, std::vector<Arc>& arcs) {
     QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::ReadOnly)) {
         return false;
     }
 
@@ -28,161 +153,739 @@ bool Graph::loadFromXml(const QString& filePath) {
     while (!xml.atEnd() && !xml.hasError()) {
         QXmlStreamReader::TokenType token = xml.readNext();
         if (token == QXmlStreamReader::StartElement) {
+            // Same rule as MapLoader: every attribute present and readable.
+            bool ok[3];
             if (xml.name() == QString("node")) {
-                long id = xml.attributes().value("id").toLong();
-                double lat = xml.attributes().value("latitude").toDouble();
-                double lon = xml.attributes().value("longitude").toDouble();
-
                 Node n;
-                n.id = id;
-                n.lat = lat;
-                n.lon = lon;
-                nodes.insert(id, n);
-
-                if (lat < minLat) minLat = lat;
-                if (lat > maxLat) maxLat = lat;
-                if (lon < minLon) minLon = lon;
-                if (lon > maxLon) maxLon = lon;
+                n.id = xml.attributes().value("id").toLong(&ok[0]);
+                n.lat = xml.attributes().value("latitude").toDouble(&ok[1]);
+                n.lon = xml.attributes().value("longitude").toDouble(&ok[2]);
+                n.x = 0;
+                n.y = 0;
+                if (!ok[0] || !ok[1] || !ok[2]) xml.raiseError("Invalid node attributes");
+                parsedNodes.push_back(n);
             }
             else if (xml.name() == QString("arc")) {
-                long from = xml.attributes().value("from").toLong();
-                long to = xml.attributes().value("to").toLong();
-                double length = xml.attributes().value("length").toDouble();
-
-                Edge e;
-                e.toNodeId = to;
-                e.length = length;
-                adjList[from].push_back(e);
+                Arc a;
+                a.fromNodeId = xml.attributes().value("from").toLong(&ok[0]);
+                a.toNodeId = xml.attributes().value("to").toLong(&ok[1]);
+                a.length = xml.attributes().value("length").toDouble(&ok[2]);
+                if (!ok[0] || !ok[1] || !ok[2]) xml.raiseError("Invalid arc attributes");
+                arcs.push_back(a);
             }
         }
     }
     return !xml.hasError();
 }
 
-KdNode* Graph::buildKdTree(std::vector<Node>& nodeList, int depth) {
-    if (nodeList.empty()) return nullptr;
+void Graph::buildGraph(std::vector<Node>& parsedNodes, const std::vector<Arc>& arcs) {
+    // A node id that appears twice keeps the index of its first occurrence
+    // and the coordinates of its last one.
+    std::vector<int> order(parsedNodes.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = static_cast<int>(i);
+    std::stable_sort(order.begin(), order.end(), [&parsedNodes](int a, int b) {
+        return parsedNodes[a].id < parsedNodes[b].id;
+    });
+
+    std::vector<char> keep(parsedNodes.size(), 1);
+    for (size_t i = 0; i < order.size();) {
+        size_t j = i;
+        while (j + 1 < order.size() && parsedNodes[order[j + 1]].id == parsedNodes[order[i]].id) ++j;
+        if (j > i) {
+            parsedNodes[order[i]] = parsedNodes[order[j]];
+            for (size_t k = i + 1; k <= j; ++k) keep[order[k]] = 0;
+        }
+        i = j + 1;
+    }
 
-    int axis = depth % 2;
+    nodes.clear();
+    nodes.reserve(parsedNodes.size());
+    for (size_t i = 0; i < parsedNodes.size(); ++i) {
+        if (!keep[i]) continue;
+        const Node& n = parsedNodes[i];
+        nodes.push_back(n);
+
+        if (n.lat < minLat) minLat = n.lat;
+        if (n.lat > maxLat) maxLat = n.lat;
+        if (n.lon < minLon) minLon = n.lon;
+        if (n.lon > maxLon) maxLon = n.lon;
+    }
 
-    auto comparator = [axis](const Node& a, const Node& b) {
-        if (axis == 0) return a.x < b.x;
-        return a.y < b.y;
-    };
+    buildIdIndex();
+    buildCsr(arcs);
+}
+
+void Graph::buildIdIndex() {
+    std::vector<std::pair<long, int>> pairs(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        pairs[i] = {nodes[i].id, static_cast<int>(i)};
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    sortedIds.resize(pairs.size());
+    sortedIdIndex.resize(pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        sortedIds[i] = pairs[i].first;
+        sortedIdIndex[i] = pairs[i].second;
+    }
+}
 
-    size_t medianIndex = nodeList.size() / 2;
-    std::nth_element(nodeList.begin(), nodeList.begin() + medianIndex, nodeList.end(), comparator);
+void Graph::buildCsr(const std::vector<Arc>& arcs) {
+    int n = static_cast<int>(nodes.size());
 
-    KdNode* node = new KdNode(nodeList[medianIndex]);
+    // Arcs whose endpoints are not in the node list cannot be drawn or routed
+    // over, so they are dropped here instead of being checked on every use.
+    std::vector<std::pair<int, int>> endpoints;
+    endpoints.reserve(arcs.size());
+    for (const auto& a : arcs) {
+        endpoints.push_back({indexOf(a.fromNodeId), indexOf(a.toNodeId)});
+    }
 
-    std::vector<Node> leftNodes(nodeList.begin(), nodeList.begin() + medianIndex);
-    std::vector<Node> rightNodes(nodeList.begin() + medianIndex + 1, nodeList.end());
+    edgeOffsets.assign(n + 1, 0);
+    for (const auto& e : endpoints) {
+        if (e.first >= 0 && e.second >= 0) edgeOffsets[e.first + 1]++;
+    }
+    for (int u = 0; u < n; ++u) {
+        edgeOffsets[u + 1] += edgeOffsets[u];
+    }
 
-    node->left = buildKdTree(leftNodes, depth + 1);
-    node->right = buildKdTree(rightNodes, depth + 1);
+    edgeTargets.assign(edgeOffsets[n], 0);
+    edgeLengths.assign(edgeOffsets[n], 0.0f);
+
+    std::vector<int> fill(edgeOffsets.begin(), edgeOffsets.end() - 1);
+    for (size_t i = 0; i < arcs.size(); ++i) {
+        int u = endpoints[i].first;
+        int v = endpoints[i].second;
+        if (u < 0 || v < 0) continue;
+        int slot = fill[u]++;
+        edgeTargets[slot] = v;
+        edgeLengths[slot] = static_cast<float>(arcs[i].length);
+    }
 
-    return node;
+    applyNodeOrder();
+    buildReverseCsr();
+    computeMetadata();
 }
 
-void Graph::normalizeCoordinates(int width, int height) {
-    double latRange = maxLat - minLat;
-    double lonRange = maxLon - minLon;
+// Renumbers the nodes so that nodes close on the map, or in the road
+// network, get close indices, and with them close slots in every per-node
+// array a search touches. Edges keep their order within each node.
+void Graph::applyNodeOrder() {
+    int n = nodeCount();
+    if (nodeOrder == FileOrder || n == 0) return;
+
+    std::vector<int> order(n);
+    if (nodeOrder == HilbertOrder) {
+        const double scale = 65535.0;
+        std::vector<quint64> keys(n);
+        for (int v = 0; v < n; ++v) {
+            auto x = static_cast<quint32>((nodes[v].lon - minLon) / lonRange() * scale);
+            auto y = static_cast<quint32>((nodes[v].lat - minLat) / latRange() * scale);
+            keys[v] = hilbertIndex(x, y);
+            order[v] = v;
+        }
+        std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+    } else {
+        // Cuthill-McKee: breadth-first over the undirected road network,
+        // starting each component at a node of lowest degree and visiting
+        // neighbours by increasing degree. Components are laid out largest
+        // first, so index 0 stays in the main network as with the other
+        // orders.
+        buildReverseCsr();
+        auto degree = [this](int v) {
+            return edgeOffsets[v + 1] - edgeOffsets[v] + reverseOffsets[v + 1] - reverseOffsets[v];
+        };
+        std::vector<int> byDegree(n);
+        for (int v = 0; v < n; ++v) byDegree[v] = v;
+        std::stable_sort(byDegree.begin(), byDegree.end(), [&degree](int a, int b) { return degree(a) < degree(b); });
+
+        std::vector<char> visited(n, 0);
+        std::vector<int> neighbours;
+        std::vector<std::pair<int, int>> components;
+        int head = 0;
+        int tail = 0;
+        for (int start : byDegree) {
+            if (visited[start]) continue;
+            visited[start] = 1;
+            components.push_back({tail, 0});
+            order[tail++] = start;
+            while (head < tail) {
+                int u = order[head++];
+                neighbours.clear();
+                for (int e = edgeOffsets[u]; e < edgeOffsets[u + 1]; ++e) neighbours.push_back(edgeTargets[e]);
+                for (int e = reverseOffsets[u]; e < reverseOffsets[u + 1]; ++e) neighbours.push_back(reverseSources[e]);
+                std::stable_sort(neighbours.begin(), neighbours.end(), [&degree](int a, int b) { return degree(a) < degree(b); });
+                for (int v : neighbours) {
+                    if (visited[v]) continue;
+                    visited[v] = 1;
+                    order[tail++] = v;
+                }
+            }
+            components.back().second = tail - components.back().first;
+        }
 
-    std::vector<Node> nodeList;
+        std::stable_sort(components.begin(), components.end(),
+                         [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.second > b.second; });
+        std::vector<int> bfsOrder;
+        bfsOrder.reserve(n);
+        for (const auto& c : components) {
+            bfsOrder.insert(bfsOrder.end(), order.begin() + c.first, order.begin() + c.first + c.second);
+        }
+        order.swap(bfsOrder);
+    }
 
-    for (auto& node : nodes) {
-        node.x = ((node.lon - minLon) / lonRange) * width;
-        node.y = height - ((node.lat - minLat) / latRange) * height;
-        nodeList.push_back(node);
+    std::vector<int> newIndex(n);
+    for (int i = 0; i < n; ++i) newIndex[order[i]] = i;
+
+    std::vector<Node> reordered(n);
+    std::vector<int> offsets(n + 1, 0);
+    std::vector<int> targets(edgeTargets.size());
+    std::vector<float> lengths(edgeLengths.size());
+    for (int i = 0; i < n; ++i) {
+        int old = order[i];
+        reordered[i] = nodes[old];
+        offsets[i + 1] = offsets[i];
+        for (int e = edgeOffsets[old]; e < edgeOffsets[old + 1]; ++e) {
+            targets[offsets[i + 1]] = newIndex[edgeTargets[e]];
+            lengths[offsets[i + 1]] = edgeLengths[e];
+            ++offsets[i + 1];
+        }
+    }
+    nodes.swap(reordered);
+    edgeOffsets.swap(offsets);
+    edgeTargets.swap(targets);
+    edgeLengths.swap(lengths);
+    for (int& index : sortedIdIndex) index = newIndex[index];
+}
+
+void Graph::buildReverseCsr() {
+    int n = nodeCount();
+
+    reverseOffsets.assign(n + 1, 0);
+    for (int v : edgeTargets) {
+        reverseOffsets[v + 1]++;
     }
+    for (int v = 0; v < n; ++v) {
+        reverseOffsets[v + 1] += reverseOffsets[v];
+    }
+
+    reverseSources.assign(edgeTargets.size(), 0);
+    reverseLengths.assign(edgeTargets.size(), 0.0f);
 
-    clearKdTree(root);
-    root = buildKdTree(nodeList, 0);
+    buildReverseSlots();
+    for (int u = 0; u < n; ++u) {
+        for (int e = edgeOffsets[u]; e < edgeOffsets[u + 1]; ++e) {
+            reverseSources[reverseSlots[e]] = u;
+            reverseLengths[reverseSlots[e]] = edgeLengths[e];
+        }
+    }
 }
 
-void Graph::searchKdTree(KdNode* node, double targetX, double targetY, int depth, Node& bestNode, double& minDistSq) {
-    if (node == nullptr) return;
+// Edges of each target keep the order of their sources, so the slots follow
+// from the offsets alone and need not be stored in the snapshot.
+void Graph::buildReverseSlots() {
+    reverseSlots.assign(edgeTargets.size(), 0);
+    std::vector<int> fill(reverseOffsets.begin(), reverseOffsets.end() - 1);
+    for (int u = 0; u < nodeCount(); ++u) {
+        for (int e = edgeOffsets[u]; e < edgeOffsets[u + 1]; ++e) {
+            reverseSlots[e] = fill[edgeTargets[e]]++;
+        }
+    }
+}
 
-    double dx = node->node.x - targetX;
-    double dy = node->node.y - targetY;
-    double distSq = dx * dx + dy * dy;
+void Graph::computeMetadata() {
+    // FNV-1a over the arrays that define node indices and edge slots.
+    unsigned long long hash = 1469598103934665603ULL;
+    auto mix = [&hash](const void* data, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    for (const auto& node : nodes) mix(&node.id, sizeof(node.id));
+    mix(edgeOffsets.data(), edgeOffsets.size() * sizeof(int));
+    mix(edgeTargets.data(), edgeTargets.size() * sizeof(int));
+    mix(edgeLengths.data(), edgeLengths.size() * sizeof(float));
+    layoutFingerprint = hash;
+
+    lengthPerMeter = std::numeric_limits<double>::max();
+    for (int u = 0; u < nodeCount(); ++u) {
+        for (int e = edgeOffsets[u]; e < edgeOffsets[u + 1]; ++e) {
+            const Node& a = nodes[u];
+            const Node& b = nodes[edgeTargets[e]];
+            double meters = greatCircleMeters(a.lat, a.lon, b.lat, b.lon);
+            if (meters > 0) lengthPerMeter = std::min(lengthPerMeter, edgeLengths[e] / meters);
+        }
+    }
+    if (lengthPerMeter == std::numeric_limits<double>::max()) lengthPerMeter = 0;
+}
+
+bool Graph::loadSnapshot(const QString& snapshotPath, const QString& xmlPath) {
+    QFileInfo source(xmlPath);
+    QFile file(snapshotPath);
+    if (!source.exists() || !file.open(QIODevice::ReadOnly)) return false;
+
+    qint64 size = file.size();
+    if (size < static_cast<qint64>(sizeof(SnapshotHeader))) return false;
+    const uchar* data = file.map(0, size);
+    if (data == nullptr) return false;
+
+    SnapshotHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    size_t n = header.nodeCount;
+    size_t m = header.edgeCount;
+    qint64 expected = static_cast<qint64>(sizeof(SnapshotHeader) +
+        n * (2 * sizeof(qint64) + 2 * sizeof(double) + sizeof(int)) +
+        2 * (n + 1) * sizeof(int) + 2 * m * (sizeof(int) + sizeof(float)));
+
+    if (header.magic != SnapshotMagic || header.version != SnapshotVersion ||
+        header.nodeOrder != nodeOrder || header.sourceSize != source.size() ||
+        header.sourceModified != source.lastModified().toMSecsSinceEpoch() ||
+        header.nodeCount < 0 || header.edgeCount < 0 || expected != size) {
+        file.unmap(const_cast<uchar*>(data));
+        return false;
+    }
+
+    const uchar* p = data + sizeof(SnapshotHeader);
+    std::vector<qint64> ids;
+    std::vector<double> lats;
+    std::vector<double> lons;
+    std::vector<qint64> sorted;
+    readSection(p, ids, n);
+    readSection(p, lats, n);
+    readSection(p, lons, n);
+    readSection(p, sorted, n);
+    readSection(p, sortedIdIndex, n);
+    readSection(p, edgeOffsets, n + 1);
+    readSection(p, edgeTargets, m);
+    readSection(p, edgeLengths, m);
+    readSection(p, reverseOffsets, n + 1);
+    readSection(p, reverseSources, m);
+    readSection(p, reverseLengths, m);
+    file.unmap(const_cast<uchar*>(data));
+
+    nodes.resize(n);
+    sortedIds.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        nodes[i].id = static_cast<long>(ids[i]);
+        nodes[i].lat = lats[i];
+        nodes[i].lon = lons[i];
+        nodes[i].x = 0;
+        nodes[i].y = 0;
+        sortedIds[i] = static_cast<long>(sorted[i]);
+    }
+
+    minLat = header.minLat;
+    maxLat = header.maxLat;
+    minLon = header.minLon;
+    maxLon = header.maxLon;
+    layoutFingerprint = header.fingerprint;
+    lengthPerMeter = header.lengthPerMeter;
+    return true;
+}
+
+bool Graph::saveSnapshot(const QString& snapshotPath, const QString& xmlPath) const {
+    QFileInfo source(xmlPath);
+    QSaveFile file(snapshotPath);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = SnapshotMagic;
+    header.version = SnapshotVersion;
+    header.sourceSize = source.size();
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    header.fingerprint = layoutFingerprint;
+    header.nodeCount = nodeCount();
+    header.edgeCount = edgeCount();
+    header.nodeOrder = nodeOrder;
+    header.minLat = minLat;
+    header.maxLat = maxLat;
+    header.minLon = minLon;
+    header.maxLon = maxLon;
+    header.lengthPerMeter = lengthPerMeter;
+
+    // Node fields are written column by column so each section can be
+    // copied out of the mapping with a single memcpy.
+    std::vector<qint64> ids(nodes.size());
+    std::vector<double> lats(nodes.size());
+    std::vector<double> lons(nodes.size());
+    std::vector<qint64> sorted(sortedIds.begin(), sortedIds.end());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        ids[i] = nodes[i].id;
+        lats[i] = nodes[i].lat;
+        lons[i] = nodes[i].lon;
+    }
 
-    if (distSq < minDistSq) {
-        minDistSq = distSq;
-        bestNode = node->node;
+    if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (!writeSection(file, ids) || !writeSection(file, lats) || !writeSection(file, lons) ||
+        !writeSection(file, sorted) || !writeSection(file, sortedIdIndex) ||
+        !writeSection(file, edgeOffsets) || !writeSection(file, edgeTargets) ||
+        !writeSection(file, edgeLengths) || !writeSection(file, reverseOffsets) ||
+        !writeSection(file, reverseSources) || !writeSection(file, reverseLengths)) {
+        return false;
     }
+    return file.commit();
+}
 
-    int axis = depth % 2;
-    double diff = (axis == 0) ? (targetX - node->node.x) : (targetY - node->node.y);
+double Graph::latRange() const {
+    return maxLat > minLat ? maxLat - minLat : 1.0;
+}
 
-    KdNode* nearSide = (diff < 0) ? node->left : node->right;
-    KdNode* farSide = (diff < 0) ? node->right : node->left;
+double Graph::lonRange() const {
+    return maxLon > minLon ? maxLon - minLon : 1.0;
+}
 
-    searchKdTree(nearSide, targetX, targetY, depth + 1, bestNode, minDistSq);
+void Graph::buildSpatialIndex() {
+    std::vector<double> us(nodes.size());
+    std::vector<double> vs(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        us[i] = (nodes[i].lon - minLon) / lonRange();
+        vs[i] = (nodes[i].lat - minLat) / latRange();
+    }
+    spatialIndex.build(us, vs);
+}
 
-    if (diff * diff < minDistSq) {
-        searchKdTree(farSide, targetX, targetY, depth + 1, bestNode, minDistSq);
+void Graph::normalizeCoordinates(int width, int height) {
+    for (auto& node : nodes) {
+        node.x = ((node.lon - minLon) / lonRange()) * width;
+        node.y = height - ((node.lat - minLat) / latRange()) * height;
     }
+    viewWidth = width;
+    viewHeight = height;
 }
 
 long Graph::getNearestNode(double x, double y) {
-    if (root == nullptr) return -1;
+    if (spatialIndex.isEmpty() || viewWidth <= 0 || viewHeight <= 0) return -1;
+
+    double u = x / viewWidth;
+    double v = (viewHeight - y) / viewHeight;
+    int nearest = spatialIndex.nearest(u, v, viewWidth, viewHeight);
+    return nearest >= 0 ? nodes[nearest].id : -1;
+}
 
-    Node bestNode;
-    double minDistSq = std::numeric_limits<double>::max();
+namespace {
 
-    searchKdTree(root, x, y, 0, bestNode, minDistSq);
+// Meters per unit of normalized coordinate along each axis.
+void metersPerUnit(double latRange, double lonRange, double midLat, double& scaleX, double& scaleY) {
+    scaleY = latRange * DegToRad * EarthRadiusMeters;
+    scaleX = lonRange * DegToRad * EarthRadiusMeters * std::cos(midLat * DegToRad);
+}
+
+}
+
+long Graph::snapToNode(double lat, double lon) const {
+    if (spatialIndex.isEmpty()) return -1;
+
+    double scaleX, scaleY;
+    metersPerUnit(latRange(), lonRange(), (minLat + maxLat) / 2, scaleX, scaleY);
+    int v = spatialIndex.nearest((lon - minLon) / lonRange(), (lat - minLat) / latRange(), scaleX, scaleY);
+    return v >= 0 ? nodes[v].id : -1;
+}
+
+std::vector<long> Graph::snapToNodes(const std::vector<std::pair<double, double>>& latLon) const {
+    std::vector<std::pair<double, double>> points(latLon.size());
+    for (size_t i = 0; i < latLon.size(); ++i) {
+        points[i] = {(latLon[i].second - minLon) / lonRange(), (latLon[i].first - minLat) / latRange()};
+    }
+
+    double scaleX, scaleY;
+    metersPerUnit(latRange(), lonRange(), (minLat + maxLat) / 2, scaleX, scaleY);
+    return toIds(spatialIndex.nearestBatch(points, scaleX, scaleY));
+}
 
-    return bestNode.id;
+std::vector<long> Graph::kNearestNodes(double lat, double lon, int k) const {
+    double scaleX, scaleY;
+    metersPerUnit(latRange(), lonRange(), (minLat + maxLat) / 2, scaleX, scaleY);
+    return toIds(spatialIndex.kNearest((lon - minLon) / lonRange(), (lat - minLat) / latRange(), k, scaleX, scaleY));
+}
+
+std::vector<long> Graph::nodesWithinRadius(double lat, double lon, double meters) const {
+    double scaleX, scaleY;
+    metersPerUnit(latRange(), lonRange(), (minLat + maxLat) / 2, scaleX, scaleY);
+    return toIds(spatialIndex.withinRadius((lon - minLon) / lonRange(), (lat - minLat) / latRange(), meters, scaleX, scaleY));
+}
+
+std::vector<long> Graph::toIds(const std::vector<int>& indices) const {
+    std::vector<long> ids;
+    ids.reserve(indices.size());
+    for (int v : indices) ids.push_back(v >= 0 ? nodes[v].id : -1);
+    return ids;
+}
+
+std::vector<int> Graph::toIndices(const std::vector<long>& ids) const {
+    std::vector<int> indices;
+    indices.reserve(ids.size());
+    for (long id : ids) indices.push_back(indexOf(id));
+    return indices;
+}
+
+DistanceTable& Graph::sharedDistanceTable() const {
+    if (!distanceTable) distanceTable.reset(new DistanceTable(*this));
+    return *distanceTable;
+}
+
+std::vector<double> Graph::oneToMany(long sourceId, const std::vector<long>& targetIds) const {
+    std::lock_guard<std::mutex> lock(distanceTableMutex);
+    return sharedDistanceTable().oneToMany(indexOf(sourceId), toIndices(targetIds));
+}
+
+std::vector<double> Graph::distanceMatrix(const std::vector<long>& sourceIds, const std::vector<long>& targetIds,
+                                          int threadCount) const {
+    std::lock_guard<std::mutex> lock(distanceTableMutex);
+    return sharedDistanceTable().manyToMany(toIndices(sourceIds), toIndices(targetIds), threadCount);
+}
+
+std::vector<IsochroneBand> Graph::isochrone(long startId, const std::vector<double>& budgets) const {
+    Isochrone query(*this);
+    return query.compute(indexOf(startId), budgets);
 }
 
 std::vector<long> Graph::dijkstra(long startId, long endId) {
-    std::priority_queue<std::pair<double, long>,
-                        std::vector<std::pair<double, long>>,
-                        std::greater<std::pair<double, long>>> pq;
+    return route(startId, endId, BidirectionalDijkstra);
+}
+
+std::vector<long> Graph::route(long startId, long endId, RoutingAlgorithm algorithm) {
+    std::vector<long> path;
+    int start = indexOf(startId);
+    int end = indexOf(endId);
+    if (start < 0 || end < 0) return path;
+
+    if (!engine) {
+        engine.reset(new RouteEngine(*this));
+        engine->setRouteCache(&routeCache);
+    }
+    engine->setAlgorithm(algorithm);
+    std::vector<int> route = engine->shortestPath(start, end);
 
-    QMap<long, double> dist;
-    QMap<long, long> parent;
+    // Callers get the path from endId back to startId, as they always have.
+    for (auto it = route.rbegin(); it != route.rend(); ++it) {
+        path.push_back(nodes[*it].id);
+    }
+    return path;
+}
+
+RouteCache& Graph::getRouteCache() const { return routeCache; }
+
+// Files next to the map only ever hold preprocessing for the lengths of the
+// map file, i.e. weight state 0.
+bool Graph::prepareLandmarks(int count) {
+    if (sourcePath.isEmpty()) return false;
+
+    std::shared_ptr<const EdgeWeights> current = getWeights();
+    bool original = current->version == 0;
+    QString tablePath = sourcePath + ".landmarks";
+    auto table = std::make_shared<Landmarks>();
+    if (!original || !table->load(tablePath, *this) || table->count() != count) {
+        table->build(*this, *current, count);
+        if (table->isEmpty()) return false;
+        if (original) table->save(tablePath);
+    }
+    return publishLandmarks(current->version, table);
+}
+
+bool Graph::prepareContractionHierarchy() {
+    if (sourcePath.isEmpty()) return false;
+
+    std::shared_ptr<const EdgeWeights> current = getWeights();
+    bool original = current->version == 0;
+    QString hierarchyPath = sourcePath + ".ch";
+    auto ch = std::make_shared<ContractionHierarchy>();
+    if (!original || !ch->load(hierarchyPath, *this)) {
+        ch->build(*this, current->forward);
+        if (ch->isEmpty()) return false;
+        if (original) ch->save(hierarchyPath);
+    }
+    if (!publishHierarchy(current->version, ch)) return false;
+
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    if (!hierarchyWorker.joinable()) {
+        hierarchyStop = false;
+        hierarchyWorker = std::thread(&Graph::rebuildHierarchies, this);
+    }
+    return true;
+}
 
-    for (auto it = nodes.keyBegin(); it != nodes.keyEnd(); ++it) {
-        dist[*it] = std::numeric_limits<double>::max();
+// Worker loop. Each pass builds for the newest state; when that state has
+// been replaced by the time the build is done, the result is thrown away
+// and the next pass starts from the newer one.
+void Graph::rebuildHierarchies() {
+    std::unique_lock<std::mutex> lock(weightsMutex);
+    for (;;) {
+        hierarchyWake.wait(lock, [this] { return hierarchyStale || hierarchyStop; });
+        if (hierarchyStop) return;
+        hierarchyStale = false;
+        std::shared_ptr<const EdgeWeights> current = std::atomic_load(&weights);
+        std::shared_ptr<const ContractionHierarchy> previous = lastHierarchy;
+        if (current->hierarchy || !previous) continue;
+        lock.unlock();
+
+        auto ch = std::make_shared<ContractionHierarchy>();
+        ch->rebuild(*this, current->forward, *previous, 0, &hierarchyStop);
+        if (!ch->isEmpty()) publishHierarchy(current->version, ch);
+
+        lock.lock();
     }
+}
 
-    dist[startId] = 0;
-    pq.push({0, startId});
+void Graph::stopHierarchyWorker() {
+    {
+        std::lock_guard<std::mutex> lock(weightsMutex);
+        hierarchyStop = true;
+    }
+    hierarchyWake.notify_all();
+    hierarchyReady.notify_all();
+    if (hierarchyWorker.joinable()) hierarchyWorker.join();
+
+    // A build that was running may have published on its way out.
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    hierarchyStale = false;
+    lastHierarchy.reset();
+}
 
-    while (!pq.empty()) {
-        long u = pq.top().second;
-        double d = pq.top().first;
-        pq.pop();
+// Preprocessing is built outside the lock and attached to the state that is
+// current once it is done, so each call sets only its own field: whatever
+// the other one got in the meantime is kept.
+bool Graph::publishLandmarks(unsigned version, std::shared_ptr<const Landmarks> table) {
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    std::shared_ptr<const EdgeWeights> current = std::atomic_load(&weights);
+    if (current->version != version) return false;
+
+    auto next = std::make_shared<EdgeWeights>(*current);
+    next->landmarks = table;
+    std::atomic_store(&weights, std::shared_ptr<const EdgeWeights>(next));
+    return true;
+}
 
-        if (d > dist[u]) continue;
-        if (u == endId) break;
+bool Graph::publishHierarchy(unsigned version, std::shared_ptr<const ContractionHierarchy> ch) {
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    std::shared_ptr<const EdgeWeights> current = std::atomic_load(&weights);
+    if (current->version != version) return false;
+
+    auto next = std::make_shared<EdgeWeights>(*current);
+    next->hierarchy = ch;
+    lastHierarchy = ch;
+    std::atomic_store(&weights, std::shared_ptr<const EdgeWeights>(next));
+    hierarchyReady.notify_all();
+    return true;
+}
 
-        if (adjList.contains(u)) {
-            for (const auto& edge : adjList[u]) {
-                long v = edge.toNodeId;
-                double weight = edge.length;
+bool Graph::waitForContractionHierarchy() {
+    std::unique_lock<std::mutex> lock(weightsMutex);
+    hierarchyReady.wait(lock, [this] {
+        return !lastHierarchy || hierarchyStop || std::atomic_load(&weights)->hierarchy;
+    });
+    return std::atomic_load(&weights)->hierarchy != nullptr;
+}
 
-                if (dist[u] + weight < dist[v]) {
-                    dist[v] = dist[u] + weight;
-                    parent[v] = u;
-                    pq.push({dist[v], v});
-                }
-            }
+void Graph::initWeights() {
+    auto initial = std::make_shared<EdgeWeights>();
+    initial->version = 0;
+    initial->forward = edgeLengths;
+    initial->reverse = reverseLengths;
+    initial->lengthPerMeter = lengthPerMeter;
+    std::atomic_store(&weights, std::shared_ptr<const EdgeWeights>(initial));
+}
+
+std::shared_ptr<const EdgeWeights> Graph::getWeights() const {
+    return std::atomic_load(&weights);
+}
+
+int Graph::updateEdgeWeights(const std::vector<EdgeWeightUpdate>& updates) {
+    std::vector<std::pair<int, float>> changes;
+    for (const EdgeWeightUpdate& update : updates) {
+        int u = indexOf(update.fromNodeId);
+        int v = indexOf(update.toNodeId);
+        if (u < 0 || v < 0 || !(update.factor >= 0)) continue;
+        for (int e = edgeOffsets[u]; e < edgeOffsets[u + 1]; ++e) {
+            if (edgeTargets[e] != v) continue;
+            float length = std::isinf(update.factor) ? std::numeric_limits<float>::infinity()
+                                                     : static_cast<float>(edgeLengths[e] * update.factor);
+            changes.push_back({e, length});
         }
     }
 
-    std::vector<long> path;
-    if (dist[endId] == std::numeric_limits<double>::max()) return path;
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    return publishWeights(changes);
+}
 
-    long curr = endId;
-    while (curr != startId) {
-        path.push_back(curr);
-        curr = parent[curr];
+int Graph::resetEdgeWeights() {
+    std::lock_guard<std::mutex> lock(weightsMutex);
+    std::shared_ptr<const EdgeWeights> current = std::atomic_load(&weights);
+    std::vector<std::pair<int, float>> changes;
+    for (int e = 0; e < edgeCount(); ++e) {
+        if (current->forward[e] != edgeLengths[e]) changes.push_back({e, edgeLengths[e]});
     }
-    path.push_back(startId);
-    return path;
+    return publishWeights(changes, true);
+}
+
+// Copy-on-write: the new state is built next to the current one and swapped
+// in with a single pointer store. Called with weightsMutex held. With
+// restoreBound the changes put back every length of the map file, so the
+// A* bound can go back to the one of the map.
+int Graph::publishWeights(const std::vector<std::pair<int, float>>& changes, bool restoreBound) {
+    std::shared_ptr<const EdgeWeights> current = std::atomic_load(&weights);
+    auto next = std::make_shared<EdgeWeights>(*current);
+    if (restoreBound) next->lengthPerMeter = lengthPerMeter;
+
+    std::vector<int> shorter;
+    int changed = 0;
+    for (const auto& change : changes) {
+        int e = change.first;
+        float length = change.second;
+        if (next->forward[e] == length) continue;
+        if (length < next->forward[e]) shorter.push_back(e);
+        next->forward[e] = length;
+        next->reverse[reverseSlots[e]] = length;
+        ++changed;
+
+        const Node& a = nodes[reverseSources[reverseSlots[e]]];
+        const Node& b = nodes[edgeTargets[e]];
+        double meters = greatCircleMeters(a.lat, a.lon, b.lat, b.lon);
+        if (meters > 0) next->lengthPerMeter = std::min(next->lengthPerMeter, length / meters);
+    }
+    if (changed == 0) {
+        // Same lengths: the version and the preprocessing for it still hold.
+        if (next->lengthPerMeter != current->lengthPerMeter) {
+            std::atomic_store(&weights, std::shared_ptr<const EdgeWeights>(next));
+        }
+        return 0;
+    }
+
+    next->version = current->version + 1;
+    next->hierarchy.reset();
+    if (next->landmarks && !shorter.empty()) {
+        auto repaired = std::make_shared<Landmarks>(*next->landmarks);
+        repaired->repair(*this, *next, shorter);
+        next->landmarks = repaired;
+    }
+
+    std::atomic_store(&weights, std::shared_ptr<const EdgeWeights>(next));
+    routeCache.invalidate(next->version);
+    if (lastHierarchy) {
+        hierarchyStale = true;
+        hierarchyWake.notify_one();
+    }
+    return changed;
+}
+
+int Graph::nodeCount() const { return static_cast<int>(nodes.size()); }
+int Graph::edgeCount() const { return static_cast<int>(edgeTargets.size()); }
+
+unsigned long long Graph::fingerprint() const { return layoutFingerprint; }
+
+int Graph::indexOf(long id) const {
+    auto it = std::lower_bound(sortedIds.begin(), sortedIds.end(), id);
+    if (it == sortedIds.end() || *it != id) return -1;
+    return sortedIdIndex[it - sortedIds.begin()];
 }
 
-const QMap<long, Node>& Graph::getNodes() const { return nodes; }
-const QMap<long, std::vector<Edge>>& Graph::getAdjList() const { return adjList; }
+const std::vector<Node>& Graph::getNodes() const { return nodes; }
+const std::vector<int>& Graph::getEdgeOffsets() const { return edgeOffsets; }
+const std::vector<int>& Graph::getEdgeTargets() const { return edgeTargets; }
+const std::vector<float>& Graph::getEdgeLengths() const { return edgeLengths; }
+const std::vector<int>& Graph::getReverseEdgeOffsets() const { return reverseOffsets; }
+const std::vector<int>& Graph::getReverseEdgeSources() const { return reverseSources; }
+const std::vector<float>& Graph::getReverseEdgeLengths() const { return reverseLengths; }
+const std::vector<int>& Graph::getReverseEdgeSlots() const { return reverseSlots; }
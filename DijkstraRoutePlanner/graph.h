@@ -2,7 +2,6 @@
 #define GRAPH_H
 
 #include <QString>
-#include <QMap>
 #include <vector>
 #include <QXmlStreamReader>
 #include <QFile>
@@ -10,6 +9,20 @@
 #include <queue>
 #include <cmath>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include "edgeweights.h"
+#include "landmarks.h"
+#include "contractionhierarchy.h"
+#include "kdtree.h"
+#include "isochrone.h"
+#include "routeengine.h"
+#include "routecache.h"
+
+class DistanceTable;
 
 struct Node {
     long id;
@@ -19,45 +32,188 @@ struct Node {
     double y;
 };
 
-struct Edge {
+// Arc as read from the XML file, before the ids are mapped to dense indices.
+struct Arc {
+    long fromNodeId;
     long toNodeId;
     double length;
 };
 
-struct KdNode {
-    Node node;
-    KdNode* left;
-    KdNode* right;
-
-    KdNode(Node n) : node(n), left(nullptr), right(nullptr) {}
+// Layout of the node indices after loading. The file order has no
+// relation to geography, so by default nodes are renumbered along a Hilbert
+// curve over lat/lon; BreadthFirstOrder is a Cuthill-McKee numbering that
+// follows the road topology instead.
+enum NodeOrder {
+    FileOrder = 0,
+    HilbertOrder = 1,
+    BreadthFirstOrder = 2
 };
 
+// Road network in compressed sparse row form. Nodes are addressed by a dense
+// index 0..N-1; the outgoing edges of node u are the slots
+// [edgeOffsets[u], edgeOffsets[u + 1]) of edgeTargets/edgeLengths.
+// The reverse arrays hold the same edges grouped by target, for searches
+// that run backwards from the destination.
+// OSM ids are only used at the API boundary (dijkstra, getNearestNode).
+//
+// The structure is fixed once loaded, but the lengths routed on are not:
+// they live in EdgeWeights states that traffic updates replace as a whole.
+// Queries take the current state with getWeights() and keep it until they
+// finish, so updates never change lengths under a running search.
 class Graph {
 public:
     Graph();
     ~Graph();
 
+    // Takes effect on the next load.
+    void setNodeOrder(NodeOrder order);
+    NodeOrder getNodeOrder() const;
+
+    // Parses the map with MapLoader (falling back to QXmlStreamReader for
+    // layouts it does not recognise) and writes a binary snapshot next to
+    // it, <map>.graph. Later loads of an unchanged file read the snapshot.
     bool loadFromXml(const QString& filePath);
+    // Recomputes the x/y screen coordinates of every node. The spatial index
+    // lives in normalized lat/lon space and is not rebuilt.
     void normalizeCoordinates(int width, int height);
     std::vector<long> dijkstra(long startId, long endId);
+    std::vector<long> route(long startId, long endId, RoutingAlgorithm algorithm);
+
+    // Routes found by dijkstra()/route() and by engines given this cache,
+    // such as RouteService's. Cleared on every load.
+    RouteCache& getRouteCache() const;
+
+    // Loads the landmark tables stored next to the map file, or builds them
+    // and writes them there so the preprocessing is only paid once. Once the
+    // lengths have been updated the tables are built for the current ones
+    // and not stored. Returns false as well if an update arrived while they
+    // were being built.
+    bool prepareLandmarks(int count);
+
+    // Distances by node id, see DistanceTable. Unknown ids give
+    // SearchSpace::Infinity. The matrix is row-major, one row per source, and
+    // uses the contraction hierarchy when it has been prepared.
+    std::vector<double> oneToMany(long sourceId, const std::vector<long>& targetIds) const;
+    std::vector<double> distanceMatrix(const std::vector<long>& sourceIds, const std::vector<long>& targetIds,
+                                       int threadCount = 0) const;
+
+    // Reachable area within each budget from startId, see Isochrone.
+    std::vector<IsochroneBand> isochrone(long startId, const std::vector<double>& budgets) const;
 
+    // Same caching scheme for the contraction hierarchy (<map>.ch).
+    bool prepareContractionHierarchy();
+
+    // Applies a batch of traffic updates as one new weight state and returns
+    // the number of edges whose length changed. Updates naming an unknown
+    // edge or a negative factor are skipped; parallel edges are all updated.
+    // Landmarks are repaired only where edges got shorter. Once a contraction
+    // hierarchy has been prepared, a background thread rebuilds it for every
+    // new state in the order of the previous one and attaches it to that
+    // state; CH queries use bidirectional Dijkstra only until it is ready.
+    int updateEdgeWeights(const std::vector<EdgeWeightUpdate>& updates);
+    // Back to the lengths of the map file, as a new state.
+    int resetEdgeWeights();
+    std::shared_ptr<const EdgeWeights> getWeights() const;
+    // Blocks until the background rebuild has attached a hierarchy to the
+    // current state. False if no hierarchy has been prepared.
+    bool waitForContractionHierarchy();
+
+    // Nearest node to a point in the screen space of the last
+    // normalizeCoordinates() call.
     long getNearestNode(double x, double y);
 
-    const QMap<long, Node>& getNodes() const;
-    const QMap<long, std::vector<Edge>>& getAdjList() const;
+    // GPS snapping; distances are approximated in meters on an
+    // equirectangular projection around the middle of the map.
+    long snapToNode(double lat, double lon) const;
+    std::vector<long> snapToNodes(const std::vector<std::pair<double, double>>& latLon) const;
+    std::vector<long> kNearestNodes(double lat, double lon, int k) const;
+    std::vector<long> nodesWithinRadius(double lat, double lon, double meters) const;
+
+    int nodeCount() const;
+    int edgeCount() const;
+    int indexOf(long id) const;
+
+    // Hash of the node order and edge arrays, used to validate files that
+    // store per-node data computed for this exact graph.
+    unsigned long long fingerprint() const;
+
+    const std::vector<Node>& getNodes() const;
+    const std::vector<int>& getEdgeOffsets() const;
+    const std::vector<int>& getEdgeTargets() const;
+    // Lengths as read from the map file; routing uses getWeights().
+    const std::vector<float>& getEdgeLengths() const;
+    const std::vector<int>& getReverseEdgeOffsets() const;
+    const std::vector<int>& getReverseEdgeSources() const;
+    const std::vector<float>& getReverseEdgeLengths() const;
+    // Slot of each forward edge in the reverse arrays.
+    const std::vector<int>& getReverseEdgeSlots() const;
 
     double minLat, maxLat, minLon, maxLon;
+    // Extent of the bounding box, or 1 along a degenerate axis.
+    double latRange() const;
+    double lonRange() const;
 
 private:
-    QMap<long, Node> nodes;
-    QMap<long, std::vector<Edge>> adjList;
+    std::vector<Node> nodes;
+    std::vector<int> edgeOffsets;
+    std::vector<int> edgeTargets;
+    std::vector<float> edgeLengths;
+    std::vector<int> reverseOffsets;
+    std::vector<int> reverseSources;
+    std::vector<float> reverseLengths;
+    std::vector<int> reverseSlots;
+    // OSM ids sorted ascending, and the node index of each.
+    std::vector<long> sortedIds;
+    std::vector<int> sortedIdIndex;
+    QString sourcePath;
+    unsigned long long layoutFingerprint;
+    double lengthPerMeter;
+    NodeOrder nodeOrder;
+
+    // Guards publishing a new weight state; readers only load the pointer.
+    std::mutex weightsMutex;
+    std::shared_ptr<const EdgeWeights> weights;
+    std::unique_ptr<RouteEngine> engine;
+    mutable RouteCache routeCache;
+    // Kept for oneToMany() and distanceMatrix(), one call at a time.
+    mutable std::mutex distanceTableMutex;
+    mutable std::unique_ptr<DistanceTable> distanceTable;
 
+    // Rebuilds the hierarchy when a state without one is published;
+    // hierarchyStale and lastHierarchy, whose order is reused, are guarded
+    // by weightsMutex. hierarchyStop also cancels a rebuild in progress.
+    std::thread hierarchyWorker;
+    std::condition_variable hierarchyWake;
+    std::condition_variable hierarchyReady;
+    std::shared_ptr<const ContractionHierarchy> lastHierarchy;
+    bool hierarchyStale;
+    std::atomic<bool> hierarchyStop;
 
-    KdNode* root;
+    KdTree spatialIndex;
+    int viewWidth;
+    int viewHeight;
 
-    void clearKdTree(KdNode* node);
-    KdNode* buildKdTree(std::vector<Node>& nodes, int depth);
-    void searchKdTree(KdNode* node, double targetX, double targetY, int depth, Node& bestNode, double& minDstSq);
+    void clear();
+    bool readXmlStream(const QString& filePath, std::vector<Node>& parsedNodes, std::vector<Arc>& arcs);
+    void buildGraph(std::vector<Node>& parsedNodes, const std::vector<Arc>& arcs);
+    void buildIdIndex();
+    void buildCsr(const std::vector<Arc>& arcs);
+    void buildReverseCsr();
+    void buildReverseSlots();
+    void applyNodeOrder();
+    void computeMetadata();
+    bool loadSnapshot(const QString& snapshotPath, const QString& xmlPath);
+    bool saveSnapshot(const QString& snapshotPath, const QString& xmlPath) const;
+    void buildSpatialIndex();
+    void initWeights();
+    void rebuildHierarchies();
+    void stopHierarchyWorker();
+    int publishWeights(const std::vector<std::pair<int, float>>& changes, bool restoreBound = false);
+    bool publishLandmarks(unsigned version, std::shared_ptr<const Landmarks> table);
+    bool publishHierarchy(unsigned version, std::shared_ptr<const ContractionHierarchy> ch);
+    std::vector<long> toIds(const std::vector<int>& indices) const;
+    std::vector<int> toIndices(const std::vector<long>& ids) const;
+    DistanceTable& sharedDistanceTable() const;
 };
 
 #endif // GRAPH_H
@@ -0,0 +1,99 @@
+#ifndef INDEXEDHEAP_H
+#define INDEXEDHEAP_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// 4-ary min-heap over node indices with decrease-key. The position table is
+// sized once for the whole graph; clear() only touches the entries still in
+// the heap, so reusing the heap across queries costs nothing per query.
+class IndexedHeap {
+public:
+    void resize(int n) {
+        clear();
+        position.assign(n, -1);
+    }
+
+    bool empty() const { return items.empty(); }
+    int size() const { return static_cast<int>(items.size()); }
+    bool contains(int v) const { return position[v] >= 0; }
+
+    int top() const { return items.front().second; }
+    double topKey() const { return items.front().first; }
+
+    void clear() {
+        for (const auto& item : items) position[item.second] = -1;
+        items.clear();
+    }
+
+    // Inserts v, or lowers its key if it is already queued with a larger one.
+    void push(int v, double key) {
+        int i = position[v];
+        if (i < 0) {
+            i = static_cast<int>(items.size());
+            items.push_back({key, v});
+            position[v] = i;
+        } else if (key < items[i].first) {
+            items[i].first = key;
+        } else {
+            return;
+        }
+        siftUp(i);
+    }
+
+    int pop() {
+        int v = items.front().second;
+        position[v] = -1;
+        if (items.size() > 1) {
+            items.front() = items.back();
+            position[items.front().second] = 0;
+            items.pop_back();
+            siftDown(0);
+        } else {
+            items.pop_back();
+        }
+        return v;
+    }
+
+private:
+    static const int Arity = 4;
+
+    std::vector<std::pair<double, int>> items;
+    std::vector<int> position;
+
+    void siftUp(int i) {
+        std::pair<double, int> item = items[i];
+        while (i > 0) {
+            int p = (i - 1) / Arity;
+            if (items[p].first <= item.first) break;
+            items[i] = items[p];
+            position[items[i].second] = i;
+            i = p;
+        }
+        items[i] = item;
+        position[item.second] = i;
+    }
+
+    void siftDown(int i) {
+        int n = static_cast<int>(items.size());
+        std::pair<double, int> item = items[i];
+        while (true) {
+            int first = i * Arity + 1;
+            if (first >= n) break;
+            int last = std::min(first + Arity, n);
+            int best = first;
+            for (int c = first + 1; c < last; ++c) {
+                if (items[c].first < items[best].first) best = c;
+            }
+            if (items[best].first >= item.first) break;
+            items[i] = items[best];
+            position[items[i].second] = i;
+            i = best;
+        }
+        items[i] = item;
+        position[item.second] = i;
+    }
+};
+
+#endif // INDEXEDHEAP_H
@@ -0,0 +1,234 @@
+#include "isochrone.h"
+#include "graph.h"
+#include "geo.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Cells around the reachable area, so the closing and the tracing never
+// have to handle the border of the grid.
+const int GridPadding = 2;
+
+struct CellGrid {
+    double originLat;
+    double originLon;
+    double cellLat;
+    double cellLon;
+    int rows;
+    int columns;
+
+    void mark(std::vector<char>& cover, double lat, double lon) const {
+        int r = static_cast<int>(std::floor((lat - originLat) / cellLat));
+        int c = static_cast<int>(std::floor((lon - originLon) / cellLon));
+        r = std::min(rows - 1, std::max(0, r));
+        c = std::min(columns - 1, std::max(0, c));
+        cover[r * columns + c] = 1;
+    }
+};
+
+// Morphological closing with a 3x3 square: fills gaps of one cell between
+// roads without growing the outline.
+std::vector<char> closeGaps(const std::vector<char>& cover, int rows, int columns) {
+    auto pass = [rows, columns](const std::vector<char>& in, bool dilate) {
+        std::vector<char> out(in.size(), 0);
+        for (int r = 1; r + 1 < rows; ++r) {
+            for (int c = 1; c + 1 < columns; ++c) {
+                bool any = false;
+                bool all = true;
+                for (int dr = -1; dr <= 1; ++dr) {
+                    for (int dc = -1; dc <= 1; ++dc) {
+                        bool set = in[(r + dr) * columns + c + dc] != 0;
+                        any = any || set;
+                        all = all && set;
+                    }
+                }
+                out[r * columns + c] = dilate ? any : all;
+            }
+        }
+        return out;
+    };
+    return pass(pass(cover, true), false);
+}
+
+// Walks the borders of the covered cells into closed rings. Every border
+// edge is directed with the covered cell on its left, so each lattice
+// vertex has as many edges in as out and a walk can only end where it
+// started.
+std::vector<std::vector<std::pair<double, double>>> traceRings(const std::vector<char>& cover, const CellGrid& grid) {
+    int rows = grid.rows;
+    int columns = grid.columns;
+    int stride = columns + 1;
+    auto covered = [&](int r, int c) {
+        return r >= 0 && c >= 0 && r < rows && c < columns && cover[r * columns + c];
+    };
+
+    // Two covered cells touching at a corner give that vertex two outgoing
+    // edges, hence two slots.
+    std::vector<int> out1((rows + 1) * stride, -1);
+    std::vector<int> out2((rows + 1) * stride, -1);
+    auto addEdge = [&](int x0, int y0, int x1, int y1) {
+        int from = y0 * stride + x0;
+        int to = y1 * stride + x1;
+        if (out1[from] < 0) out1[from] = to;
+        else out2[from] = to;
+    };
+
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < columns; ++c) {
+            if (!covered(r, c)) continue;
+            if (!covered(r - 1, c)) addEdge(c, r, c + 1, r);
+            if (!covered(r, c + 1)) addEdge(c + 1, r, c + 1, r + 1);
+            if (!covered(r + 1, c)) addEdge(c + 1, r + 1, c, r + 1);
+            if (!covered(r, c - 1)) addEdge(c, r + 1, c, r);
+        }
+    }
+
+    std::vector<std::vector<std::pair<double, double>>> rings;
+    for (int start = 0; start < static_cast<int>(out1.size()); ++start) {
+        while (out1[start] >= 0 || out2[start] >= 0) {
+            std::vector<int> ring;
+            int v = start;
+            do {
+                ring.push_back(v);
+                int& slot = out1[v] >= 0 ? out1[v] : out2[v];
+                int next = slot;
+                slot = -1;
+                v = next;
+            } while (v != start);
+
+            // Keep only the corners.
+            std::vector<std::pair<double, double>> points;
+            int count = static_cast<int>(ring.size());
+            for (int i = 0; i < count; ++i) {
+                int prev = ring[(i + count - 1) % count];
+                int cur = ring[i];
+                int next = ring[(i + 1) % count];
+                bool straight = (cur - prev) == (next - cur);
+                if (straight) continue;
+                int x = cur % stride;
+                int y = cur / stride;
+                points.push_back({grid.originLat + y * grid.cellLat, grid.originLon + x * grid.cellLon});
+            }
+            rings.push_back(points);
+        }
+    }
+    return rings;
+}
+
+}
+
+Isochrone::Isochrone(const Graph& graph) : graph(graph), cancelFlag(nullptr), pollCounter(0), cancelled(false) {}
+
+void Isochrone::setCancelFlag(const std::atomic<bool>* flag) {
+    cancelFlag = flag;
+}
+
+bool Isochrone::wasCancelled() const {
+    return cancelled;
+}
+
+// Polled every few hundred settled nodes, or right away between bands.
+bool Isochrone::interrupted(bool now) {
+    if (cancelFlag == nullptr || (!now && (++pollCounter & 255) != 0)) return false;
+    cancelled = cancelFlag->load(std::memory_order_relaxed);
+    return cancelled;
+}
+
+std::vector<IsochroneBand> Isochrone::compute(int source, const std::vector<double>& budgets, int resolution) {
+    cancelled = false;
+    std::vector<IsochroneBand> bands(budgets.size());
+    for (size_t i = 0; i < budgets.size(); ++i) bands[i].budget = budgets[i];
+    if (source < 0 || budgets.empty()) return bands;
+
+    const auto& nodes = graph.getNodes();
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    std::shared_ptr<const EdgeWeights> weights = graph.getWeights();
+    const auto& lengths = weights->forward;
+    double maxBudget = *std::max_element(budgets.begin(), budgets.end());
+
+    if (space.size() != graph.nodeCount()) space.resize(graph.nodeCount());
+    space.reset();
+    space.relax(source, 0, -1);
+    space.heap.push(source, 0);
+
+    // Settle order is by distance, so each band is a prefix of it.
+    std::vector<int> order;
+    while (!space.heap.empty()) {
+        if (interrupted()) return {};
+        int u = space.heap.pop();
+        space.settle(u);
+        order.push_back(u);
+
+        double du = space.distance(u);
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = targets[e];
+            double dv = du + lengths[e];
+            if (dv <= maxBudget && space.relax(v, dv, u)) space.heap.push(v, dv);
+        }
+    }
+
+    // One grid for every band, sized from the largest one including the far
+    // ends of its partial edges.
+    double minLat = nodes[source].lat, maxLat = minLat;
+    double minLon = nodes[source].lon, maxLon = minLon;
+    for (int u : order) {
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            const Node& v = nodes[targets[e]];
+            minLat = std::min(minLat, std::min(v.lat, nodes[u].lat));
+            maxLat = std::max(maxLat, std::max(v.lat, nodes[u].lat));
+            minLon = std::min(minLon, std::min(v.lon, nodes[u].lon));
+            maxLon = std::max(maxLon, std::max(v.lon, nodes[u].lon));
+        }
+    }
+    double midLat = (minLat + maxLat) / 2;
+    double cosLat = std::max(1e-6, std::cos(midLat * DegToRad));
+    double extentMeters = std::max((maxLat - minLat) * DegToRad * EarthRadiusMeters,
+                                   (maxLon - minLon) * DegToRad * EarthRadiusMeters * cosLat);
+    double cellMeters = std::max(1.0, extentMeters / std::max(1, resolution));
+
+    CellGrid grid;
+    grid.cellLat = cellMeters / (DegToRad * EarthRadiusMeters);
+    grid.cellLon = grid.cellLat / cosLat;
+    grid.originLat = minLat - GridPadding * grid.cellLat;
+    grid.originLon = minLon - GridPadding * grid.cellLon;
+    grid.rows = static_cast<int>(std::ceil((maxLat - minLat) / grid.cellLat)) + 2 * GridPadding + 1;
+    grid.columns = static_cast<int>(std::ceil((maxLon - minLon) / grid.cellLon)) + 2 * GridPadding + 1;
+
+    for (IsochroneBand& band : bands) {
+        if (interrupted(true)) return {};
+        double budget = band.budget;
+        std::vector<char> cover(static_cast<size_t>(grid.rows) * grid.columns, 0);
+
+        for (int u : order) {
+            double du = space.distance(u);
+            if (du > budget) break;
+            band.nodes.push_back(u);
+
+            const Node& a = nodes[u];
+            grid.mark(cover, a.lat, a.lon);
+            for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+                const Node& b = nodes[targets[e]];
+                double reach = 1.0;
+                if (du + lengths[e] > budget) {
+                    reach = lengths[e] > 0 ? (budget - du) / lengths[e] : 0.0;
+                    if (reach <= 0) continue;
+                    band.partialEdges.push_back({u, targets[e], reach});
+                }
+
+                // Two samples per cell along the reachable part of the edge.
+                double cells = std::max(std::abs(b.lat - a.lat) / grid.cellLat,
+                                        std::abs(b.lon - a.lon) / grid.cellLon) * reach;
+                int steps = static_cast<int>(std::ceil(cells * 2)) + 1;
+                for (int k = 1; k <= steps; ++k) {
+                    double t = reach * k / steps;
+                    grid.mark(cover, a.lat + (b.lat - a.lat) * t, a.lon + (b.lon - a.lon) * t);
+                }
+            }
+        }
+
+        band.outline = traceRings(closeGaps(cover, grid.rows, grid.columns), grid);
+    }
+    return bands;
+}
@@ -0,0 +1,59 @@
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+#include <vector>
+#include <utility>
+#include <atomic>
+#include "searchspace.h"
+
+class Graph;
+
+// Edge u -> v of which only the first `fraction` is within the budget.
+struct PartialEdge {
+    int from;
+    int to;
+    double fraction;
+};
+
+struct IsochroneBand {
+    double budget;
+    // Node indices within the budget, nearest first.
+    std::vector<int> nodes;
+    std::vector<PartialEdge> partialEdges;
+    // Outline of the reachable area as closed (lat, lon) rings; holes are
+    // separate rings, so fill with the odd-even rule.
+    std::vector<std::vector<std::pair<double, double>>> outline;
+};
+
+// Service areas around a start node. A single Dijkstra search bounded by the
+// largest budget answers every budget at once; nodes beyond it are never
+// pushed onto the heap. The search uses the weight state current when it
+// starts.
+//
+// The outline is grid based: the reachable parts of the roads are rasterized
+// onto cells `resolution` times smaller than the extent of the largest band,
+// one-cell gaps between neighbouring roads are closed, and the cell borders
+// are traced into rings.
+class Isochrone {
+public:
+    explicit Isochrone(const Graph& graph);
+
+    // Bands are returned in the order of the budgets given.
+    std::vector<IsochroneBand> compute(int source, const std::vector<double>& budgets, int resolution = 64);
+
+    // As in RouteEngine: while a flag is set, compute() polls it and gives
+    // up with no bands once it becomes true.
+    void setCancelFlag(const std::atomic<bool>* flag);
+    bool wasCancelled() const;
+
+private:
+    const Graph& graph;
+    SearchSpace space;
+    const std::atomic<bool>* cancelFlag;
+    unsigned pollCounter;
+    bool cancelled;
+
+    bool interrupted(bool now = false);
+};
+
+#endif // ISOCHRONE_H
@@ -0,0 +1,237 @@
+#include "kdtree.h"
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <thread>
+
+struct KdTree::Query {
+    double x;
+    double y;
+    double scaleX;
+    double scaleY;
+
+    int best;
+    double bestDistSq;
+
+    int k;
+    std::priority_queue<std::pair<double, int>> heap;
+
+    double radiusSq;
+    std::vector<int>* result;
+
+    double distSq(double px, double py) const {
+        double dx = (px - x) * scaleX;
+        double dy = (py - y) * scaleY;
+        return dx * dx + dy * dy;
+    }
+
+    // Squared scaled distance from the query to the splitting line.
+    double planeDistSq(int axis, double split) const {
+        double d = axis == 0 ? (x - split) * scaleX : (y - split) * scaleY;
+        return d * d;
+    }
+};
+
+KdTree::KdTree() {}
+
+void KdTree::clear() {
+    index.clear();
+    px.clear();
+    py.clear();
+}
+
+bool KdTree::isEmpty() const {
+    return index.empty();
+}
+
+void KdTree::build(const std::vector<double>& xs, const std::vector<double>& ys) {
+    int n = static_cast<int>(xs.size());
+    index.resize(n);
+    for (int i = 0; i < n; ++i) index[i] = i;
+
+    buildRange(0, n, 0, xs, ys);
+
+    // Coordinates are gathered into tree order so a search walks memory
+    // in the same order it walks the tree.
+    px.resize(n);
+    py.resize(n);
+    for (int i = 0; i < n; ++i) {
+        px[i] = xs[index[i]];
+        py[i] = ys[index[i]];
+    }
+}
+
+void KdTree::buildRange(int lo, int hi, int depth, const std::vector<double>& xs, const std::vector<double>& ys) {
+    if (hi - lo <= BucketSize) return;
+
+    int mid = lo + (hi - lo) / 2;
+    const std::vector<double>& key = depth % 2 == 0 ? xs : ys;
+    std::nth_element(index.begin() + lo, index.begin() + mid, index.begin() + hi,
+                     [&key](int a, int b) { return key[a] < key[b]; });
+
+    buildRange(lo, mid, depth + 1, xs, ys);
+    buildRange(mid + 1, hi, depth + 1, xs, ys);
+}
+
+void KdTree::searchNearest(int lo, int hi, int depth, Query& q) const {
+    if (hi - lo <= BucketSize) {
+        for (int i = lo; i < hi; ++i) {
+            double d = q.distSq(px[i], py[i]);
+            if (d < q.bestDistSq) {
+                q.bestDistSq = d;
+                q.best = i;
+            }
+        }
+        return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    double d = q.distSq(px[mid], py[mid]);
+    if (d < q.bestDistSq) {
+        q.bestDistSq = d;
+        q.best = mid;
+    }
+
+    int axis = depth % 2;
+    double split = axis == 0 ? px[mid] : py[mid];
+    bool leftFirst = (axis == 0 ? q.x : q.y) < split;
+
+    if (leftFirst) searchNearest(lo, mid, depth + 1, q);
+    else searchNearest(mid + 1, hi, depth + 1, q);
+
+    if (q.planeDistSq(axis, split) < q.bestDistSq) {
+        if (leftFirst) searchNearest(mid + 1, hi, depth + 1, q);
+        else searchNearest(lo, mid, depth + 1, q);
+    }
+}
+
+void KdTree::searchKNearest(int lo, int hi, int depth, Query& q) const {
+    auto offer = [&q](int i, double d) {
+        if (static_cast<int>(q.heap.size()) < q.k) {
+            q.heap.push({d, i});
+        } else if (d < q.heap.top().first) {
+            q.heap.pop();
+            q.heap.push({d, i});
+        }
+    };
+    auto worst = [&q]() {
+        return static_cast<int>(q.heap.size()) < q.k ? std::numeric_limits<double>::max() : q.heap.top().first;
+    };
+
+    if (hi - lo <= BucketSize) {
+        for (int i = lo; i < hi; ++i) offer(i, q.distSq(px[i], py[i]));
+        return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    offer(mid, q.distSq(px[mid], py[mid]));
+
+    int axis = depth % 2;
+    double split = axis == 0 ? px[mid] : py[mid];
+    bool leftFirst = (axis == 0 ? q.x : q.y) < split;
+
+    if (leftFirst) searchKNearest(lo, mid, depth + 1, q);
+    else searchKNearest(mid + 1, hi, depth + 1, q);
+
+    if (q.planeDistSq(axis, split) < worst()) {
+        if (leftFirst) searchKNearest(mid + 1, hi, depth + 1, q);
+        else searchKNearest(lo, mid, depth + 1, q);
+    }
+}
+
+void KdTree::searchRadius(int lo, int hi, int depth, Query& q) const {
+    if (hi - lo <= BucketSize) {
+        for (int i = lo; i < hi; ++i) {
+            if (q.distSq(px[i], py[i]) <= q.radiusSq) q.result->push_back(index[i]);
+        }
+        return;
+    }
+
+    int mid = lo + (hi - lo) / 2;
+    if (q.distSq(px[mid], py[mid]) <= q.radiusSq) q.result->push_back(index[mid]);
+
+    int axis = depth % 2;
+    double split = axis == 0 ? px[mid] : py[mid];
+    double side = (axis == 0 ? q.x : q.y) - split;
+    bool crosses = q.planeDistSq(axis, split) <= q.radiusSq;
+
+    if (side < 0 || crosses) searchRadius(lo, mid, depth + 1, q);
+    if (side >= 0 || crosses) searchRadius(mid + 1, hi, depth + 1, q);
+}
+
+int KdTree::nearest(double x, double y, double scaleX, double scaleY) const {
+    if (index.empty()) return -1;
+
+    Query q;
+    q.x = x;
+    q.y = y;
+    q.scaleX = scaleX;
+    q.scaleY = scaleY;
+    q.best = -1;
+    q.bestDistSq = std::numeric_limits<double>::max();
+    searchNearest(0, static_cast<int>(index.size()), 0, q);
+    // A NaN or infinite query is no closer to any point than max().
+    return q.best >= 0 ? index[q.best] : -1;
+}
+
+std::vector<int> KdTree::kNearest(double x, double y, int k, double scaleX, double scaleY) const {
+    std::vector<int> result;
+    if (index.empty() || k <= 0) return result;
+
+    Query q;
+    q.x = x;
+    q.y = y;
+    q.scaleX = scaleX;
+    q.scaleY = scaleY;
+    q.k = k;
+    searchKNearest(0, static_cast<int>(index.size()), 0, q);
+
+    // The heap pops farthest first; the result is nearest first.
+    result.resize(q.heap.size());
+    for (int i = static_cast<int>(result.size()) - 1; i >= 0; --i) {
+        result[i] = index[q.heap.top().second];
+        q.heap.pop();
+    }
+    return result;
+}
+
+std::vector<int> KdTree::withinRadius(double x, double y, double radius, double scaleX, double scaleY) const {
+    std::vector<int> result;
+    if (index.empty()) return result;
+
+    Query q;
+    q.x = x;
+    q.y = y;
+    q.scaleX = scaleX;
+    q.scaleY = scaleY;
+    q.radiusSq = radius * radius;
+    q.result = &result;
+    searchRadius(0, static_cast<int>(index.size()), 0, q);
+    return result;
+}
+
+std::vector<int> KdTree::nearestBatch(const std::vector<std::pair<double, double>>& points,
+                                      double scaleX, double scaleY, int threadCount) const {
+    std::vector<int> result(points.size(), -1);
+    if (index.empty()) return result;
+
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int count = static_cast<int>(points.size());
+    threadCount = std::max(1, std::min(threadCount, count / 1024));
+
+    auto work = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            // -1 for points nearest() cannot place, as in an empty tree.
+            result[i] = nearest(points[i].first, points[i].second, scaleX, scaleY);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) {
+        threads.emplace_back(work, static_cast<int>(static_cast<long long>(count) * t / threadCount),
+                             static_cast<int>(static_cast<long long>(count) * (t + 1) / threadCount));
+    }
+    work(0, static_cast<int>(static_cast<long long>(count) / threadCount));
+    for (auto& t : threads) t.join();
+    return result;
+}
@@ -0,0 +1,49 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <vector>
+#include <utility>
+
+// Pointer-free 2-d tree. The tree is implicit in a permutation of the
+// points: the range [lo, hi) is split at its middle element, which holds the
+// median along the axis of that depth, with the left subtree in [lo, mid) and
+// the right one in [mid + 1, hi). Small ranges are left as unsorted buckets.
+//
+// Points are stored in a fixed normalized space. Queries pass a scale per
+// axis, so distances can be measured in pixels of any widget size or in
+// meters without rebuilding: scaling each axis keeps every split valid.
+class KdTree {
+public:
+    KdTree();
+
+    void build(const std::vector<double>& xs, const std::vector<double>& ys);
+    void clear();
+    bool isEmpty() const;
+
+    // All queries return indices into the arrays given to build(); nearest()
+    // gives -1 for an empty tree or a query that is NaN or infinite.
+    int nearest(double x, double y, double scaleX, double scaleY) const;
+    std::vector<int> kNearest(double x, double y, int k, double scaleX, double scaleY) const;
+    std::vector<int> withinRadius(double x, double y, double radius, double scaleX, double scaleY) const;
+
+    // Nearest point for every query, split across threadCount threads
+    // (threadCount <= 0 uses every available core).
+    std::vector<int> nearestBatch(const std::vector<std::pair<double, double>>& points,
+                                  double scaleX, double scaleY, int threadCount = 0) const;
+
+private:
+    static const int BucketSize = 8;
+
+    std::vector<int> index;
+    std::vector<double> px;
+    std::vector<double> py;
+
+    void buildRange(int lo, int hi, int depth, const std::vector<double>& xs, const std::vector<double>& ys);
+
+    struct Query;
+    void searchNearest(int lo, int hi, int depth, Query& q) const;
+    void searchKNearest(int lo, int hi, int depth, Query& q) const;
+    void searchRadius(int lo, int hi, int depth, Query& q) const;
+};
+
+#endif // KDTREE_H
@@ -0,0 +1,374 @@
+#include "landmarks.h"
+#include "graph.h"
+#include "indexedheap.h"
+#include <QFile>
+#include <QSaveFile>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+namespace {
+
+const quint32 LandmarkFileMagic = 0x314c5441; // "ALT1"
+const quint32 LandmarkFileVersion = 1;
+
+struct LandmarkFileHeader {
+    quint32 magic;
+    quint32 version;
+    quint64 fingerprint;
+    qint32 nodeCount;
+    qint32 landmarkCount;
+};
+
+void distancesFrom(const std::vector<int>& offsets, const std::vector<int>& adj,
+                   const std::vector<float>& lengths, const std::vector<int>& sources,
+                   IndexedHeap& heap, std::vector<double>& dist) {
+    dist.assign(offsets.size() - 1, std::numeric_limits<double>::infinity());
+    heap.clear();
+    for (int s : sources) {
+        dist[s] = 0;
+        heap.push(s, 0);
+    }
+    while (!heap.empty()) {
+        int u = heap.pop();
+        double du = dist[u];
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = adj[e];
+            double dv = du + lengths[e];
+            if (dv < dist[v]) {
+                dist[v] = dv;
+                heap.push(v, dv);
+            }
+        }
+    }
+}
+
+// A node of the largest strongly connected component (Kosaraju, with
+// explicit stacks), ignoring closed edges. Seeding the landmark selection
+// there keeps a small island around node 0 from capturing every landmark.
+int largestComponentNode(const std::vector<int>& offsets, const std::vector<int>& adj,
+                         const std::vector<float>& lengths, const std::vector<int>& revOffsets,
+                         const std::vector<int>& revAdj, const std::vector<float>& revLengths) {
+    int n = static_cast<int>(offsets.size()) - 1;
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<char> visited(n, 0);
+    std::vector<std::pair<int, int>> stack;
+    for (int s = 0; s < n; ++s) {
+        if (visited[s]) continue;
+        visited[s] = 1;
+        stack.push_back({s, offsets[s]});
+        while (!stack.empty()) {
+            int u = stack.back().first;
+            int& e = stack.back().second;
+            if (e == offsets[u + 1]) {
+                order.push_back(u);
+                stack.pop_back();
+                continue;
+            }
+            int v = adj[e];
+            bool open = !std::isinf(lengths[e]);
+            ++e;
+            if (open && !visited[v]) {
+                visited[v] = 1;
+                stack.push_back({v, offsets[v]});
+            }
+        }
+    }
+
+    // Reverse searches in decreasing finish order each collect one component.
+    std::vector<char> assigned(n, 0);
+    std::vector<int> pending;
+    int best = 0;
+    int bestSize = 0;
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        if (assigned[*it]) continue;
+        assigned[*it] = 1;
+        pending.assign(1, *it);
+        int size = 0;
+        while (!pending.empty()) {
+            int u = pending.back();
+            pending.pop_back();
+            ++size;
+            for (int e = revOffsets[u]; e < revOffsets[u + 1]; ++e) {
+                int v = revAdj[e];
+                if (!assigned[v] && !std::isinf(revLengths[e])) {
+                    assigned[v] = 1;
+                    pending.push_back(v);
+                }
+            }
+        }
+        if (size > bestSize) {
+            bestSize = size;
+            best = *it;
+        }
+    }
+    return best;
+}
+
+// Dijkstra from the nodes already queued in heap, lowering one column of a
+// node-major table wherever it finds a shorter distance.
+void lowerColumn(const std::vector<int>& offsets, const std::vector<int>& adj, const std::vector<float>& lengths,
+                 std::vector<float>& table, int stride, int column, IndexedHeap& heap) {
+    while (!heap.empty()) {
+        double du = heap.topKey();
+        int u = heap.pop();
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = adj[e];
+            double dv = du + lengths[e];
+            float& slot = table[static_cast<size_t>(v) * stride + column];
+            if (static_cast<float>(dv) < slot) {
+                slot = static_cast<float>(dv);
+                heap.push(v, dv);
+            }
+        }
+    }
+}
+
+template <typename T>
+bool readArray(QFile& file, std::vector<T>& out, size_t count) {
+    out.resize(count);
+    qint64 bytes = static_cast<qint64>(count * sizeof(T));
+    return bytes == 0 || file.read(reinterpret_cast<char*>(out.data()), bytes) == bytes;
+}
+
+template <typename T>
+bool writeArray(QSaveFile& file, const std::vector<T>& data) {
+    qint64 bytes = static_cast<qint64>(data.size() * sizeof(T));
+    return bytes == 0 || file.write(reinterpret_cast<const char*>(data.data()), bytes) == bytes;
+}
+
+}
+
+Landmarks::Landmarks() : landmarkCount(0), nodeCount(0), graphFingerprint(0) {}
+
+void Landmarks::clear() {
+    landmarkCount = 0;
+    nodeCount = 0;
+    graphFingerprint = 0;
+    landmarkNodes.clear();
+    fromLandmark.clear();
+    toLandmark.clear();
+    boundLengths.clear();
+    boundReverseLengths.clear();
+}
+
+void Landmarks::build(const Graph& graph, const EdgeWeights& weights, int count) {
+    clear();
+    int n = graph.nodeCount();
+    if (n == 0 || count <= 0) return;
+
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& lengths = weights.forward;
+    const auto& revOffsets = graph.getReverseEdgeOffsets();
+    const auto& revSources = graph.getReverseEdgeSources();
+    const auto& revLengths = weights.reverse;
+
+    IndexedHeap heap;
+    heap.resize(n);
+    std::vector<double> dist;
+
+    // Farthest selection: each new landmark is the node farthest from all the
+    // ones picked so far, which spreads them towards the border of the map.
+    // The first is the node farthest from a node of the largest component.
+    std::vector<int> sources(1, largestComponentNode(offsets, targets, lengths, revOffsets, revSources, revLengths));
+    for (int i = 0; i < count; ++i) {
+        distancesFrom(offsets, targets, lengths, sources, heap, dist);
+        int farthest = -1;
+        for (int v = 0; v < n; ++v) {
+            if (std::isinf(dist[v]) || dist[v] == 0) continue;
+            if (farthest < 0 || dist[v] > dist[farthest]) farthest = v;
+        }
+        if (farthest < 0) break;
+        landmarkNodes.push_back(farthest);
+        sources = landmarkNodes;
+    }
+
+    landmarkCount = static_cast<int>(landmarkNodes.size());
+    nodeCount = n;
+    graphFingerprint = graph.fingerprint();
+    boundLengths = lengths;
+    boundReverseLengths = revLengths;
+    fromLandmark.assign(static_cast<size_t>(n) * landmarkCount, 0.0f);
+    toLandmark.assign(static_cast<size_t>(n) * landmarkCount, 0.0f);
+
+    std::atomic<int> nextJob(0);
+    auto worker = [&]() {
+        IndexedHeap localHeap;
+        localHeap.resize(n);
+        std::vector<double> localDist;
+        for (int job = nextJob++; job < 2 * landmarkCount; job = nextJob++) {
+            int i = job / 2;
+            bool backward = job % 2 == 1;
+            std::vector<int> source(1, landmarkNodes[i]);
+            if (backward) {
+                distancesFrom(revOffsets, revSources, revLengths, source, localHeap, localDist);
+            } else {
+                distancesFrom(offsets, targets, lengths, source, localHeap, localDist);
+            }
+            std::vector<float>& table = backward ? toLandmark : fromLandmark;
+            for (int v = 0; v < n; ++v) {
+                table[static_cast<size_t>(v) * landmarkCount + i] = static_cast<float>(localDist[v]);
+            }
+        }
+    };
+
+    int threadCount = std::max(1, std::min<int>(std::thread::hardware_concurrency(), 2 * landmarkCount));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+// Landmarks are nodes of the graph and distances are numbers >= 0, infinite
+// where a node cannot be reached.
+bool Landmarks::validTables(int nodes) const {
+    for (int v : landmarkNodes) {
+        if (v < 0 || v >= nodes) return false;
+    }
+    for (size_t i = 0; i < fromLandmark.size(); ++i) {
+        if (!(fromLandmark[i] >= 0) || !(toLandmark[i] >= 0)) return false;
+    }
+    return true;
+}
+
+bool Landmarks::load(const QString& filePath, const Graph& graph) {
+    clear();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    LandmarkFileHeader header;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != LandmarkFileMagic || header.version != LandmarkFileVersion) return false;
+    if (header.fingerprint != graph.fingerprint() || header.nodeCount != graph.nodeCount()) return false;
+    if (header.landmarkCount <= 0) return false;
+
+    // The counts have to match the file length before they size anything.
+    size_t cells = static_cast<size_t>(header.nodeCount) * header.landmarkCount;
+    qint64 expected = static_cast<qint64>(sizeof(header)) + static_cast<qint64>(header.landmarkCount) * sizeof(int) +
+                      2 * static_cast<qint64>(cells) * sizeof(float);
+    if (file.size() != expected) return false;
+
+    if (!readArray(file, landmarkNodes, header.landmarkCount) ||
+        !readArray(file, fromLandmark, cells) ||
+        !readArray(file, toLandmark, cells) ||
+        !validTables(header.nodeCount)) {
+        clear();
+        return false;
+    }
+
+    landmarkCount = header.landmarkCount;
+    nodeCount = header.nodeCount;
+    graphFingerprint = header.fingerprint;
+    boundLengths = graph.getEdgeLengths();
+    boundReverseLengths = graph.getReverseEdgeLengths();
+    return true;
+}
+
+void Landmarks::repair(const Graph& graph, const EdgeWeights& weights, const std::vector<int>& shorter) {
+    if (isEmpty()) return;
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& revOffsets = graph.getReverseEdgeOffsets();
+    const auto& revSources = graph.getReverseEdgeSources();
+    const auto& revSlots = graph.getReverseEdgeSlots();
+
+    // Edges the tables have to take in; they stay exact for the shortest
+    // length each edge has had, which bounds every later state that only
+    // lengthens edges from there.
+    std::vector<int> lowered;
+    for (int e : shorter) {
+        float length = weights.forward[e];
+        if (length < boundLengths[e]) {
+            boundLengths[e] = length;
+            boundReverseLengths[revSlots[e]] = length;
+            lowered.push_back(e);
+        }
+    }
+    if (lowered.empty()) return;
+
+    std::atomic<int> nextJob(0);
+    auto worker = [&]() {
+        IndexedHeap heap;
+        heap.resize(nodeCount);
+        for (int job = nextJob++; job < 2 * landmarkCount; job = nextJob++) {
+            int i = job / 2;
+            bool backward = job % 2 == 1;
+            std::vector<float>& table = backward ? toLandmark : fromLandmark;
+            for (int e : lowered) {
+                int u = revSources[revSlots[e]];
+                int v = targets[e];
+                // Forward: L -> u -> v may now beat L -> v. Backward:
+                // u -> v -> L may now beat u -> L.
+                int from = backward ? v : u;
+                int to = backward ? u : v;
+                double d = static_cast<double>(table[static_cast<size_t>(from) * landmarkCount + i]) + boundLengths[e];
+                float& slot = table[static_cast<size_t>(to) * landmarkCount + i];
+                if (static_cast<float>(d) < slot) {
+                    slot = static_cast<float>(d);
+                    heap.push(to, d);
+                }
+            }
+            if (backward) {
+                lowerColumn(revOffsets, revSources, boundReverseLengths, table, landmarkCount, i, heap);
+            } else {
+                lowerColumn(offsets, targets, boundLengths, table, landmarkCount, i, heap);
+            }
+        }
+    };
+
+    int threadCount = std::max(1, std::min<int>(std::thread::hardware_concurrency(), 2 * landmarkCount));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+bool Landmarks::save(const QString& filePath) const {
+    if (isEmpty()) return false;
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    LandmarkFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = LandmarkFileMagic;
+    header.version = LandmarkFileVersion;
+    header.fingerprint = graphFingerprint;
+    header.nodeCount = nodeCount;
+    header.landmarkCount = landmarkCount;
+
+    if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (!writeArray(file, landmarkNodes) || !writeArray(file, fromLandmark) || !writeArray(file, toLandmark)) {
+        return false;
+    }
+    return file.commit();
+}
+
+bool Landmarks::isEmpty() const { return landmarkCount == 0; }
+int Landmarks::count() const { return landmarkCount; }
+const std::vector<int>& Landmarks::getLandmarkNodes() const { return landmarkNodes; }
+
+double Landmarks::lowerBound(int v, int target) const {
+    const float* fromV = &fromLandmark[static_cast<size_t>(v) * landmarkCount];
+    const float* fromT = &fromLandmark[static_cast<size_t>(target) * landmarkCount];
+    const float* toV = &toLandmark[static_cast<size_t>(v) * landmarkCount];
+    const float* toT = &toLandmark[static_cast<size_t>(target) * landmarkCount];
+
+    // The tables are stored as float; the small relative slack keeps the
+    // bound admissible despite the rounding of both operands.
+    double best = 0;
+    for (int i = 0; i < landmarkCount; ++i) {
+        if (!std::isinf(fromV[i]) && !std::isinf(fromT[i])) {
+            double a = fromT[i];
+            double b = fromV[i];
+            best = std::max(best, a - b - (a + b) * 1e-6);
+        }
+        if (!std::isinf(toV[i]) && !std::isinf(toT[i])) {
+            double a = toV[i];
+            double b = toT[i];
+            best = std::max(best, a - b - (a + b) * 1e-6);
+        }
+    }
+    return best;
+}
@@ -0,0 +1,59 @@
+#ifndef LANDMARKS_H
+#define LANDMARKS_H
+
+#include <QString>
+#include <vector>
+#include "edgeweights.h"
+
+class Graph;
+
+// ALT preprocessing: distances from and to a small set of landmark nodes,
+// stored node-major so one lookup touches a single cache line per node.
+// Lower bounds follow from the triangle inequality:
+//   d(v, t) >= d(L, t) - d(L, v)   and   d(v, t) >= d(v, L) - d(t, L).
+//
+// The tables are exact for their own copy of the edge lengths. While the
+// live lengths are at least as long, which traffic updates that only slow
+// edges down preserve, the bounds stay admissible for them as well.
+class Landmarks {
+public:
+    Landmarks();
+
+    // Picks count landmarks by repeated farthest-node selection and fills
+    // the distance tables, one forward and one backward search per landmark
+    // spread over the available cores.
+    void build(const Graph& graph, const EdgeWeights& weights, int count);
+
+    // Takes in the forward edges of `shorter` whose length in weights is
+    // below the one the tables were computed for. Only landmarks whose
+    // distances drop are searched, and only from where they drop.
+    void repair(const Graph& graph, const EdgeWeights& weights, const std::vector<int>& shorter);
+
+    // The table file is only accepted if it was written for a graph with the
+    // same fingerprint, so a changed or re-ordered map forces a rebuild.
+    // Loaded tables hold the lengths of the map file.
+    bool load(const QString& filePath, const Graph& graph);
+    bool save(const QString& filePath) const;
+
+    void clear();
+    bool isEmpty() const;
+    int count() const;
+    const std::vector<int>& getLandmarkNodes() const;
+
+    double lowerBound(int v, int target) const;
+
+private:
+    bool validTables(int nodes) const;
+
+    int landmarkCount;
+    int nodeCount;
+    unsigned long long graphFingerprint;
+    std::vector<int> landmarkNodes;
+    std::vector<float> fromLandmark;
+    std::vector<float> toLandmark;
+    // Lengths the tables are exact for, forward and reverse.
+    std::vector<float> boundLengths;
+    std::vector<float> boundReverseLengths;
+};
+
+#endif // LANDMARKS_H
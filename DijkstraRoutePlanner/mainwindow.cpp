@@ -9,6 +9,7 @@ MainWindow::MainWindow(QWidget *parent)
     setCentralWidget(mapWidget);
 
     if (graph.loadFromXml("Harta_Luxemburg.xml")) {
+        graph.prepareLandmarks(16);
         mapWidget->setGraph(&graph);
     }
 }
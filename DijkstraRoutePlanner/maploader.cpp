@@ -0,0 +1,274 @@
+#include "maploader.h"
+#include <QByteArray>
+#include <QFile>
+#include <thread>
+#include <functional>
+#include <cstring>
+
+namespace {
+
+struct ChunkResult {
+    std::vector<Node> nodes;
+    std::vector<Arc> arcs;
+    // Start of the first markup the chunk read and the end of the last one,
+    // which may lie past the chunk; see parseXml().
+    const char* first;
+    const char* stop;
+    bool ok;
+};
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool parseInteger(const char* p, const char* end, long& out) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end) return false;
+
+    long value = 0;
+    for (; p < end; ++p) {
+        if (!isDigit(*p)) return false;
+        value = value * 10 + (*p - '0');
+    }
+    out = negative ? -value : value;
+    return true;
+}
+
+// Decimal parser for attribute values. Up to 19 significant digits and a
+// power of ten within 1e22 are converted exactly with a single multiply or
+// divide; anything else goes through Qt's (locale independent) conversion.
+bool parseDecimal(const char* begin, const char* end, double& out) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = begin;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+    bool truncated = false;
+
+    for (; p < end && isDigit(*p); ++p) {
+        anyDigit = true;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0) ++significant;
+        } else {
+            ++exponent;
+            truncated = true;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            anyDigit = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0) ++significant;
+                --exponent;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+    if (!anyDigit) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        long e = 0;
+        if (!parseInteger(p + 1, end, e)) return false;
+        exponent += static_cast<int>(e);
+        p = end;
+    }
+    if (p != end) return false;
+
+    if (!truncated && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    bool ok = false;
+    out = QByteArray(begin, static_cast<int>(end - begin)).toDouble(&ok);
+    return ok;
+}
+
+inline bool nameIs(const char* p, const char* end, const char* name) {
+    size_t length = std::strlen(name);
+    return static_cast<size_t>(end - p) == length && std::memcmp(p, name, length) == 0;
+}
+
+// Calls visit(name, nameEnd, value, valueEnd) for each attribute of the tag
+// body [p, end). Returns false on a value without quotes around it.
+template <typename Visitor>
+bool forEachAttribute(const char* p, const char* end, Visitor visit) {
+    while (p < end) {
+        while (p < end && isSpace(*p)) ++p;
+        const char* name = p;
+        while (p < end && *p != '=' && !isSpace(*p) && *p != '/') ++p;
+        const char* nameEnd = p;
+        while (p < end && isSpace(*p)) ++p;
+        if (p >= end || *p != '=') {
+            if (p < end) ++p;
+            continue;
+        }
+        ++p;
+        while (p < end && isSpace(*p)) ++p;
+        if (p >= end || (*p != '"' && *p != '\'')) return false;
+        char quote = *p++;
+        const char* value = p;
+        while (p < end && *p != quote) ++p;
+        if (p >= end) return false;
+        visit(name, nameEnd, value, p);
+        ++p;
+    }
+    return true;
+}
+
+// Position just past the first occurrence of terminator in [p, end), or
+// null if there is none.
+const char* skipPast(const char* p, const char* end, const char* terminator) {
+    size_t length = std::strlen(terminator);
+    for (; end - p >= static_cast<ptrdiff_t>(length); ++p) {
+        if (std::memcmp(p, terminator, length) == 0) return p + length;
+    }
+    return nullptr;
+}
+
+// Reads the markup starting in [begin, end). Sets out.ok to false on an
+// unterminated tag, comment or CDATA section, and on a node or arc whose
+// attributes are missing or do not parse.
+void scanChunk(const char* begin, const char* end, const char* bufferEnd, ChunkResult& out) {
+    out.first = nullptr;
+    out.stop = begin;
+    out.ok = false;
+    const char* p = begin;
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, '<', end - p));
+        if (p == nullptr) break;
+        if (out.first == nullptr) out.first = p;
+
+        if (bufferEnd - p >= 4 && std::memcmp(p, "<!--", 4) == 0) {
+            p = skipPast(p + 4, bufferEnd, "-->");
+            if (p == nullptr) return;
+            out.stop = p;
+            continue;
+        }
+        if (bufferEnd - p >= 9 && std::memcmp(p, "<![CDATA[", 9) == 0) {
+            p = skipPast(p + 9, bufferEnd, "]]>");
+            if (p == nullptr) return;
+            out.stop = p;
+            continue;
+        }
+
+        const char* tagEnd = static_cast<const char*>(std::memchr(p, '>', bufferEnd - p));
+        if (tagEnd == nullptr) return;
+
+        const char* name = p + 1;
+        const char* nameEnd = name;
+        while (nameEnd < tagEnd && !isSpace(*nameEnd) && *nameEnd != '/') ++nameEnd;
+
+        if (nameIs(name, nameEnd, "node")) {
+            Node n = {0, 0, 0, 0, 0};
+            int found = 0;
+            bool valid = forEachAttribute(nameEnd, tagEnd, [&](const char* a, const char* ae, const char* v, const char* ve) {
+                if (nameIs(a, ae, "id")) found |= parseInteger(v, ve, n.id) ? 1 : 8;
+                else if (nameIs(a, ae, "latitude")) found |= parseDecimal(v, ve, n.lat) ? 2 : 8;
+                else if (nameIs(a, ae, "longitude")) found |= parseDecimal(v, ve, n.lon) ? 4 : 8;
+            });
+            if (!valid || found != 7) return;
+            out.nodes.push_back(n);
+        } else if (nameIs(name, nameEnd, "arc")) {
+            Arc arc = {0, 0, 0};
+            int found = 0;
+            bool valid = forEachAttribute(nameEnd, tagEnd, [&](const char* a, const char* ae, const char* v, const char* ve) {
+                if (nameIs(a, ae, "from")) found |= parseInteger(v, ve, arc.fromNodeId) ? 1 : 8;
+                else if (nameIs(a, ae, "to")) found |= parseInteger(v, ve, arc.toNodeId) ? 2 : 8;
+                else if (nameIs(a, ae, "length")) found |= parseDecimal(v, ve, arc.length) ? 4 : 8;
+            });
+            if (!valid || found != 7) return;
+            out.arcs.push_back(arc);
+        }
+        p = tagEnd + 1;
+        out.stop = p;
+    }
+    out.ok = true;
+}
+
+}
+
+bool MapLoader::parseXml(const QString& filePath, std::vector<Node>& nodes, std::vector<Arc>& arcs,
+                         int threadCount) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    qint64 size = file.size();
+    if (size <= 0) return false;
+    const char* data = reinterpret_cast<const char*>(file.map(0, size));
+    if (data == nullptr) return false;
+    const char* dataEnd = data + size;
+
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    // Chunks smaller than a few megabytes are not worth a thread.
+    qint64 minChunk = 4 << 20;
+    int chunkCount = static_cast<int>(std::max<qint64>(1, std::min<qint64>(threadCount, size / minChunk)));
+
+    std::vector<ChunkResult> results(chunkCount);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < chunkCount; ++i) {
+        const char* begin = data + size * i / chunkCount;
+        const char* end = data + size * (i + 1) / chunkCount;
+        if (i + 1 < chunkCount) {
+            threads.emplace_back(scanChunk, begin, end, dataEnd, std::ref(results[i]));
+        } else {
+            scanChunk(begin, end, dataEnd, results[i]);
+        }
+    }
+    for (auto& t : threads) t.join();
+
+    // A chunk is only right if it started reading where the previous one
+    // stopped: past a tag that crosses the boundary, at the next '<'. One
+    // that began inside a comment or CDATA section read its text as tags,
+    // and the whole file goes to the full parser instead.
+    bool ok = true;
+    const char* stop = data;
+    for (int i = 0; i < chunkCount && ok; ++i) {
+        const ChunkResult& r = results[i];
+        const char* end = data + size * (i + 1) / chunkCount;
+        ok = r.ok;
+        if (stop > data + size * i / chunkCount) {
+            const char* next = static_cast<const char*>(std::memchr(stop, '<', std::max(end, stop) - stop));
+            if (r.first != next) ok = false;
+        }
+        stop = r.first != nullptr ? r.stop : std::max(stop, end);
+    }
+    file.unmap(const_cast<uchar*>(reinterpret_cast<const uchar*>(data)));
+    if (!ok) return false;
+
+    size_t nodeTotal = 0;
+    size_t arcTotal = 0;
+    for (const auto& r : results) {
+        nodeTotal += r.nodes.size();
+        arcTotal += r.arcs.size();
+    }
+    if (nodeTotal == 0) return false;
+
+    nodes.clear();
+    arcs.clear();
+    nodes.reserve(nodeTotal);
+    arcs.reserve(arcTotal);
+    for (auto& r : results) {
+        nodes.insert(nodes.end(), r.nodes.begin(), r.nodes.end());
+        arcs.insert(arcs.end(), r.arcs.begin(), r.arcs.end());
+        r = ChunkResult();
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef MAPLOADER_H
+#define MAPLOADER_H
+
+#include <QString>
+#include <vector>
+#include "graph.h"
+
+// Fast reader for the <node id latitude longitude/> and <arc from to length/>
+// map format. The file is memory-mapped and split into one chunk per thread;
+// each thread owns the tags that start inside its chunk, and the results are
+// concatenated in chunk order so nodes keep their file order.
+class MapLoader {
+public:
+    // Returns false if the file cannot be mapped, contains no <node> tags or
+    // is malformed (an unterminated tag or comment, a node or arc with a
+    // missing or unreadable attribute), in which case the caller should fall
+    // back to a full XML parser.
+    static bool parseXml(const QString& filePath, std::vector<Node>& nodes, std::vector<Arc>& arcs,
+                         int threadCount = 0);
+};
+
+#endif // MAPLOADER_H
@@ -1,4 +1,14 @@
 #include "mapwidget.h"
+#include <QPainterPath>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Map length units; the bundled maps store lengths in meters.
+const std::vector<double> IsochroneBudgets = {1000, 2000, 5000};
+
+}
 
 MapWidget::MapWidget(QWidget *parent) : QWidget(parent), graph(nullptr) {
     scaleFactor = 1.0;
@@ -8,18 +18,47 @@ MapWidget::MapWidget(QWidget *parent) : QWidget(parent), graph(nullptr) {
     endNodeId = -1;
     isDragging = false;
     setMouseTracking(true);
+
+    zoomSettleTimer = new QTimer(this);
+    zoomSettleTimer->setSingleShot(true);
+    zoomSettleTimer->setInterval(150);
+    connect(zoomSettleTimer, &QTimer::timeout, this, [this]() { update(); });
+
+    tileCache = new TileCache(this);
+    connect(tileCache, &TileCache::tileReady, this, [this]() { update(); });
+
+    routeRequest = 0;
+    previewRequest = 0;
+    isochroneRequest = 0;
+    previewNodeId = -1;
+    routeService = new RouteService(this);
+    connect(routeService, &RouteService::routeReady, this,
+            [this](int requestId, const std::vector<long>& route, double) { onRouteReady(requestId, route); });
+    connect(routeService, &RouteService::isochroneReady, this,
+            [this](int requestId, const std::vector<IsochroneBand>& bands) {
+                if (requestId != isochroneRequest) return;
+                isochrones = bands;
+                update();
+            });
 }
 
 void MapWidget::setGraph(Graph* g) {
     graph = g;
-    if(width() > 0 && height() > 0)
+    tileCache->setSource(nullptr, nullptr);
+    edgeGrid.build(*graph);
+    tileCache->setSource(graph, &edgeGrid);
+    routeService->setGraph(graph);
+    if(width() > 0 && height() > 0) {
         graph->normalizeCoordinates(width(), height());
+        tileCache->setBaseSize(width(), height());
+    }
     update();
 }
 
 void MapWidget::resizeEvent(QResizeEvent *event) {
     if (graph) {
         graph->normalizeCoordinates(width(), height());
+        tileCache->setBaseSize(width(), height());
         update();
     }
     QWidget::resizeEvent(event);
@@ -30,61 +69,127 @@ void MapWidget::paintEvent(QPaintEvent *event) {
     if (!graph) return;
 
     QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
+    drawTiles(painter);
 
+    painter.setRenderHint(QPainter::Antialiasing);
     painter.translate(offsetX, offsetY);
     painter.scale(scaleFactor, scaleFactor);
 
-    QPen penEdge(Qt::lightGray, 1);
-    penEdge.setCosmetic(true);
-    painter.setPen(penEdge);
+    drawIsochrones(painter);
 
     const auto& nodes = graph->getNodes();
-    const auto& adjList = graph->getAdjList();
-
-    for (auto it = adjList.begin(); it != adjList.end(); ++it) {
-        long u = it.key();
-        if (!nodes.contains(u)) continue;
-        QPointF p1(nodes[u].x, nodes[u].y);
-
-        for (const auto& edge : it.value()) {
-            long v = edge.toNodeId;
-            if (nodes.contains(v)) {
-                QPointF p2(nodes[v].x, nodes[v].y);
-                painter.drawLine(p1, p2);
-            }
-        }
-    }
 
     if (!path.empty()) {
         QPen penPath(Qt::red, 3);
         penPath.setCosmetic(true);
         painter.setPen(penPath);
-
-        for (size_t i = 0; i < path.size() - 1; ++i) {
-            long u = path[i];
-            long v = path[i+1];
-            if (nodes.contains(u) && nodes.contains(v)) {
-                painter.drawLine(QPointF(nodes[u].x, nodes[u].y),
-                                 QPointF(nodes[v].x, nodes[v].y));
-            }
-        }
+        drawPath(painter, path);
+    } else if (!previewPath.empty()) {
+        QPen penPreview(Qt::red, 2, Qt::DashLine);
+        penPreview.setCosmetic(true);
+        painter.setPen(penPreview);
+        drawPath(painter, previewPath);
     }
 
     double nodeRadius = 5.0 / scaleFactor;
 
     painter.setPen(Qt::NoPen);
     painter.setBrush(Qt::blue);
-    if (startNodeId != -1) {
-        painter.drawEllipse(QPointF(nodes[startNodeId].x, nodes[startNodeId].y), nodeRadius, nodeRadius);
+    int startIndex = graph->indexOf(startNodeId);
+    if (startIndex >= 0) {
+        painter.drawEllipse(QPointF(nodes[startIndex].x, nodes[startIndex].y), nodeRadius, nodeRadius);
     }
 
     painter.setBrush(Qt::green);
-    if (endNodeId != -1) {
-        painter.drawEllipse(QPointF(nodes[endNodeId].x, nodes[endNodeId].y), nodeRadius, nodeRadius);
+    int endIndex = graph->indexOf(endNodeId);
+    if (endIndex >= 0) {
+        painter.drawEllipse(QPointF(nodes[endIndex].x, nodes[endIndex].y), nodeRadius, nodeRadius);
+    }
+}
+
+void MapWidget::drawPath(QPainter& painter, const std::vector<long>& ids) {
+    const auto& nodes = graph->getNodes();
+    for (size_t i = 0; i + 1 < ids.size(); ++i) {
+        int u = graph->indexOf(ids[i]);
+        int v = graph->indexOf(ids[i + 1]);
+        if (u >= 0 && v >= 0) {
+            painter.drawLine(QPointF(nodes[u].x, nodes[u].y),
+                             QPointF(nodes[v].x, nodes[v].y));
+        }
     }
 }
 
+void MapWidget::drawIsochrones(QPainter& painter) {
+    if (isochrones.empty()) return;
+
+    // Largest band first so the smaller ones are drawn on top of it.
+    std::vector<const IsochroneBand*> bands;
+    for (const auto& band : isochrones) bands.push_back(&band);
+    std::sort(bands.begin(), bands.end(),
+              [](const IsochroneBand* a, const IsochroneBand* b) { return a->budget > b->budget; });
+
+    const QColor colors[] = {QColor(255, 160, 0, 60), QColor(255, 100, 0, 70), QColor(220, 40, 0, 80)};
+    painter.setPen(Qt::NoPen);
+    for (size_t i = 0; i < bands.size(); ++i) {
+        QPainterPath area;
+        area.setFillRule(Qt::OddEvenFill);
+        for (const auto& ring : bands[i]->outline) {
+            QPolygonF polygon;
+            for (const auto& point : ring) {
+                double x = (point.second - graph->minLon) / graph->lonRange() * width();
+                double y = height() - (point.first - graph->minLat) / graph->latRange() * height();
+                polygon.append(QPointF(x, y));
+            }
+            area.addPolygon(polygon);
+            area.closeSubpath();
+        }
+        painter.setBrush(colors[std::min(i, sizeof(colors) / sizeof(colors[0]) - 1)]);
+        painter.drawPath(area);
+    }
+    painter.setBrush(Qt::NoBrush);
+}
+
+void MapWidget::onRouteReady(int requestId, const std::vector<long>& route) {
+    if (requestId == routeRequest) {
+        path = route;
+    } else if (requestId == previewRequest) {
+        previewPath = route;
+    } else {
+        return;
+    }
+    update();
+}
+
+void MapWidget::drawTiles(QPainter& painter) {
+    if (width() <= 0 || height() <= 0) return;
+
+    // Tiles of the nearest zoom level, scaled by at most a factor of two
+    // either way to the exact scale.
+    int z = TileCache::zoomLevelFor(scaleFactor);
+    double tileScale = scaleFactor / std::ldexp(1.0, z);
+    double span = TileCache::TileSize * tileScale;
+
+    int tx0 = std::max(0, static_cast<int>(std::floor(-offsetX / span)));
+    int ty0 = std::max(0, static_cast<int>(std::floor(-offsetY / span)));
+    int tx1 = std::min(tileCache->tilesAcross(z) - 1, static_cast<int>(std::floor((width() - offsetX) / span)));
+    int ty1 = std::min(tileCache->tilesDown(z) - 1, static_cast<int>(std::floor((height() - offsetY) / span)));
+
+    bool interacting = isDragging || zoomSettleTimer->isActive();
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, !interacting);
+
+    tileCache->beginFrame();
+    QImage image;
+    QRectF source;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            if (!tileCache->tileFor(z, tx, ty, image, source)) continue;
+            QRectF target(offsetX + tx * span, offsetY + ty * span, span, span);
+            painter.drawImage(target, image, source);
+        }
+    }
+    tileCache->endFrame();
+}
+
 void MapWidget::mousePressEvent(QMouseEvent *event) {
     if (event->button() == Qt::LeftButton) {
         if (!graph) return;
@@ -94,17 +199,29 @@ void MapWidget::mousePressEvent(QMouseEvent *event) {
 
         long clickedNode = graph->getNearestNode(clickX, clickY);
 
+        if (event->modifiers() & Qt::ShiftModifier) {
+            isochroneRequest = routeService->requestIsochrone(clickedNode, IsochroneBudgets);
+            return;
+        }
+
+        previewRequest = 0;
+        previewNodeId = -1;
+        previewPath.clear();
+
         if (startNodeId == -1) {
             startNodeId = clickedNode;
             path.clear();
             endNodeId = -1;
         } else if (endNodeId == -1) {
             endNodeId = clickedNode;
-            path = graph->dijkstra(startNodeId, endNodeId);
+            path.clear();
+            routeRequest = routeService->requestRoute(startNodeId, endNodeId, AltAStar);
         } else {
             startNodeId = clickedNode;
             endNodeId = -1;
             path.clear();
+            routeRequest = 0;
+            routeService->cancel();
         }
         update();
     } else if (event->button() == Qt::RightButton) {
@@ -124,6 +241,15 @@ void MapWidget::mouseMoveEvent(QMouseEvent *event) {
 
         lastMousePos = event->pos();
         update();
+    } else if (graph && startNodeId != -1 && endNodeId == -1) {
+        double hoverX = (event->pos().x() - offsetX) / scaleFactor;
+        double hoverY = (event->pos().y() - offsetY) / scaleFactor;
+
+        long hoveredNode = graph->getNearestNode(hoverX, hoverY);
+        if (hoveredNode != -1 && hoveredNode != previewNodeId) {
+            previewNodeId = hoveredNode;
+            previewRequest = routeService->requestRoute(startNodeId, hoveredNode, AltAStar);
+        }
     }
 }
 
@@ -131,6 +257,7 @@ void MapWidget::mouseReleaseEvent(QMouseEvent *event) {
     if (event->button() == Qt::RightButton) {
         isDragging = false;
         setCursor(Qt::ArrowCursor);
+        update();
     }
 }
 
@@ -151,5 +278,6 @@ void MapWidget::wheelEvent(QWheelEvent *event) {
     offsetX = mouseX - (mouseX - offsetX) * (scaleFactor / oldScale);
     offsetY = mouseY - (mouseY - offsetY) * (scaleFactor / oldScale);
 
+    zoomSettleTimer->start();
     update();
 }
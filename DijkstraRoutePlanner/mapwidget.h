@@ -5,7 +5,11 @@
 #include <QPainter>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <QTimer>
 #include "graph.h"
+#include "edgegrid.h"
+#include "tilecache.h"
+#include "routeservice.h"
 
 class MapWidget : public QWidget {
     Q_OBJECT
@@ -24,6 +28,8 @@ protected:
 
 private:
     Graph* graph;
+    EdgeGrid edgeGrid;
+    TileCache* tileCache;
     double scaleFactor;
     double offsetX;
     double offsetY;
@@ -32,8 +38,30 @@ private:
     long endNodeId;
     std::vector<long> path;
 
+    // Routes are computed off the GUI thread. While only the start is set,
+    // hovering previews the route to the node under the cursor.
+    RouteService* routeService;
+    int routeRequest;
+    int previewRequest;
+    long previewNodeId;
+    std::vector<long> previewPath;
+
+    // Shift+click shows the area reachable within IsochroneBudgets, also
+    // computed by routeService.
+    std::vector<IsochroneBand> isochrones;
+    int isochroneRequest;
+
     QPoint lastMousePos;
     bool isDragging;
+
+    // Restarted on every wheel step; while it runs tiles are scaled without
+    // smoothing, and a full quality frame is painted when it fires.
+    QTimer* zoomSettleTimer;
+
+    void drawTiles(QPainter& painter);
+    void drawPath(QPainter& painter, const std::vector<long>& ids);
+    void drawIsochrones(QPainter& painter);
+    void onRouteReady(int requestId, const std::vector<long>& route);
 };
 
 #endif // MAPWIDGET_H
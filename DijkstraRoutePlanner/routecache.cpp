@@ -0,0 +1,105 @@
+#include "routecache.h"
+
+RouteCache::RouteCache(size_t capacityBytes)
+    : weightsVersion(0), capacity(capacityBytes), usedBytes(0), hits(0), misses(0), treeHits(0), evictions(0) {}
+
+unsigned long long RouteCache::keyOf(int source, int target) {
+    return (static_cast<unsigned long long>(static_cast<unsigned>(source)) << 32) | static_cast<unsigned>(target);
+}
+
+// The path itself plus the list node and the hash map node that hold it.
+size_t RouteCache::entryBytes(const Entry& entry) {
+    return sizeof(Entry) + entry.path.size() * sizeof(int) + 6 * sizeof(void*);
+}
+
+void RouteCache::evictTo(size_t bytes) {
+    while (usedBytes > bytes && !entries.empty()) {
+        usedBytes -= entryBytes(entries.back());
+        index.erase(entries.back().key);
+        entries.pop_back();
+        ++evictions;
+    }
+}
+
+void RouteCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = bytes;
+    evictTo(capacity);
+}
+
+bool RouteCache::lookup(unsigned version, int source, int target, std::vector<int>& path, double& distance) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = version == weightsVersion ? index.find(keyOf(source, target)) : index.end();
+    if (it == index.end()) {
+        ++misses;
+        return false;
+    }
+    ++hits;
+    entries.splice(entries.begin(), entries, it->second);
+    path = it->second->path;
+    distance = it->second->distance;
+    return true;
+}
+
+void RouteCache::insert(unsigned version, int source, int target, const std::vector<int>& path,
+                        double distance) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (version != weightsVersion) return;
+    unsigned long long key = keyOf(source, target);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        usedBytes -= entryBytes(*it->second);
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    Entry entry = {key, path, distance};
+    size_t bytes = entryBytes(entry);
+    if (bytes > capacity) return;
+    evictTo(capacity - bytes);
+
+    entries.push_front(std::move(entry));
+    index[key] = entries.begin();
+    usedBytes += bytes;
+}
+
+void RouteCache::recordTreeHit() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++treeHits;
+}
+
+void RouteCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+void RouteCache::invalidate(unsigned version) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+    weightsVersion = version;
+}
+
+void RouteCache::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    hits = 0;
+    misses = 0;
+    treeHits = 0;
+    evictions = 0;
+}
+
+RouteCacheStats RouteCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    RouteCacheStats s;
+    s.hits = hits;
+    s.misses = misses;
+    s.treeHits = treeHits;
+    s.evictions = evictions;
+    s.entries = static_cast<int>(entries.size());
+    s.bytes = usedBytes;
+    s.capacityBytes = capacity;
+    return s;
+}
@@ -0,0 +1,76 @@
+#ifndef ROUTECACHE_H
+#define ROUTECACHE_H
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+
+struct RouteCacheStats {
+    long long hits;
+    long long misses;
+    // Queries a RouteEngine answered from the shortest-path tree it kept
+    // from an earlier query with the same source, without settling a node.
+    long long treeHits;
+    long long evictions;
+    int entries;
+    size_t bytes;
+    size_t capacityBytes;
+};
+
+// Least recently used cache of finished routes, keyed by the (source,
+// target) node indices the positions were snapped to. Unreachable pairs are
+// cached too, as empty paths. One cache can be shared by the engines of
+// several threads; every call locks.
+//
+// Routes belong to one weight state of the graph (EdgeWeights::version).
+// invalidate() moves the cache to a new state. Lookups and inserts name the
+// state their query runs on, and miss or are dropped when it is not the
+// cache's, so a query never mixes routes of two states: neither one still
+// running on an older state, nor one that already sees weights published a
+// moment before the cache was invalidated.
+class RouteCache {
+public:
+    static const size_t DefaultCapacity = 16 * 1024 * 1024;
+
+    explicit RouteCache(size_t capacityBytes = DefaultCapacity);
+
+    // Evicts the oldest routes until the cache fits the new capacity.
+    void setCapacity(size_t bytes);
+
+    bool lookup(unsigned version, int source, int target, std::vector<int>& path, double& distance);
+    void insert(unsigned version, int source, int target, const std::vector<int>& path, double distance);
+    void recordTreeHit();
+
+    // Drop every route; the counters keep running.
+    void clear();
+    void invalidate(unsigned version);
+    void resetStats();
+    RouteCacheStats stats() const;
+
+private:
+    struct Entry {
+        unsigned long long key;
+        std::vector<int> path;
+        double distance;
+    };
+
+    mutable std::mutex mutex;
+    // Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<unsigned long long, std::list<Entry>::iterator> index;
+    unsigned weightsVersion;
+    size_t capacity;
+    size_t usedBytes;
+    long long hits;
+    long long misses;
+    long long treeHits;
+    long long evictions;
+
+    static unsigned long long keyOf(int source, int target);
+    static size_t entryBytes(const Entry& entry);
+    void evictTo(size_t bytes);
+};
+
+#endif // ROUTECACHE_H
@@ -0,0 +1,337 @@
+#include "routeengine.h"
+#include "graph.h"
+#include "geo.h"
+#include "routecache.h"
+#include <algorithm>
+
+RouteEngine::RouteEngine(const Graph& graph)
+    : graph(graph), treeSource(-1), treeVersion(0), lastSource(-1), cache(nullptr), algorithm(BidirectionalDijkstra), lastDist(SearchSpace::Infinity), lastSettled(0),
+      cancelFlag(nullptr), pollCounter(0), cancelled(false) {}
+
+void RouteEngine::setAlgorithm(RoutingAlgorithm algorithm) {
+    this->algorithm = algorithm;
+}
+
+RoutingAlgorithm RouteEngine::getAlgorithm() const {
+    return algorithm;
+}
+
+void RouteEngine::setRouteCache(RouteCache* cache) {
+    this->cache = cache;
+}
+
+void RouteEngine::setCancelFlag(const std::atomic<bool>* flag) {
+    cancelFlag = flag;
+}
+
+bool RouteEngine::wasCancelled() const {
+    return cancelled;
+}
+
+bool RouteEngine::interrupted() {
+    if (cancelFlag == nullptr || (++pollCounter & 255) != 0) return false;
+    cancelled = cancelFlag->load(std::memory_order_relaxed);
+    return cancelled;
+}
+
+void RouteEngine::prepare() {
+    if (forward.size() != graph.nodeCount()) {
+        forward.resize(graph.nodeCount());
+        backward.resize(graph.nodeCount());
+        treeSource = -1;
+        lastSource = -1;
+    }
+    forward.reset();
+    backward.reset();
+
+    weights = graph.getWeights();
+    if (weights->version != treeVersion) {
+        treeSource = -1;
+        treeVersion = weights->version;
+    }
+}
+
+std::vector<int> RouteEngine::shortestPath(int source, int target) {
+    prepare();
+    lastDist = SearchSpace::Infinity;
+    lastSettled = 0;
+    cancelled = false;
+    if (source < 0 || target < 0) return {};
+
+    std::vector<int> path;
+    if (cache && cache->lookup(weights->version, source, target, path, lastDist)) return path;
+
+    path = search(source, target);
+    lastSource = source;
+    if (cache && !cancelled) cache->insert(weights->version, source, target, path, lastDist);
+    return path;
+}
+
+std::vector<int> RouteEngine::search(int source, int target) {
+    bool hierarchy = algorithm == ContractionHierarchies && weights->hierarchy;
+    bool covered = source == treeSource && tree.isSettled(target);
+    bool resume = algorithm == BidirectionalDijkstra && source == lastSource;
+    if (covered || resume) return treePath(source, target);
+
+    switch (algorithm) {
+    case AStar:
+        return goalDirectedPath(source, target, false);
+    case AltAStar:
+        return goalDirectedPath(source, target, weights->landmarks && !weights->landmarks->isEmpty());
+    case ContractionHierarchies:
+        if (hierarchy) return hierarchyPath(source, target);
+        return bidirectionalPath(source, target);
+    default:
+        return bidirectionalPath(source, target);
+    }
+}
+
+// Plain Dijkstra that keeps its labels and heap between queries from the
+// same source. Stopping at a cancellation leaves the tree consistent, so the
+// next query can still resume it.
+std::vector<int> RouteEngine::treePath(int source, int target) {
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& lengths = weights->forward;
+
+    if (tree.size() != graph.nodeCount()) {
+        tree.resize(graph.nodeCount());
+        treeSource = -1;
+    }
+    if (treeSource != source) {
+        tree.reset();
+        tree.relax(source, 0, -1);
+        tree.heap.push(source, 0);
+        treeSource = source;
+    }
+
+    int settledBefore = tree.settledNodes();
+    if (tree.isSettled(target) && cache) cache->recordTreeHit();
+    while (!tree.isSettled(target) && !tree.heap.empty()) {
+        if (interrupted()) return {};
+        int u = tree.heap.pop();
+        tree.settle(u);
+
+        double du = tree.distance(u);
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = targets[e];
+            double dv = du + lengths[e];
+            if (tree.relax(v, dv, u)) tree.heap.push(v, dv);
+        }
+    }
+
+    lastSettled = tree.settledNodes() - settledBefore;
+    if (!tree.isSettled(target)) return {};
+
+    lastDist = tree.distance(target);
+    std::vector<int> path;
+    for (int v = target; v >= 0; v = tree.parentOf(v)) {
+        path.push_back(v);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+std::vector<int> RouteEngine::bidirectionalPath(int source, int target) {
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& lengths = weights->forward;
+    const auto& revOffsets = graph.getReverseEdgeOffsets();
+    const auto& revSources = graph.getReverseEdgeSources();
+    const auto& revLengths = weights->reverse;
+
+    forward.relax(source, 0, -1);
+    forward.heap.push(source, 0);
+    backward.relax(target, 0, -1);
+    backward.heap.push(target, 0);
+
+    double best = source == target ? 0 : SearchSpace::Infinity;
+    int meet = source == target ? source : -1;
+
+    while (!forward.heap.empty() || !backward.heap.empty()) {
+        double forwardMin = forward.heap.empty() ? SearchSpace::Infinity : forward.heap.topKey();
+        double backwardMin = backward.heap.empty() ? SearchSpace::Infinity : backward.heap.topKey();
+        if (forwardMin + backwardMin >= best) break;
+        if (interrupted()) return {};
+
+        bool stepForward = forwardMin <= backwardMin;
+        SearchSpace& self = stepForward ? forward : backward;
+        SearchSpace& other = stepForward ? backward : forward;
+        const auto& off = stepForward ? offsets : revOffsets;
+        const auto& adj = stepForward ? targets : revSources;
+        const auto& len = stepForward ? lengths : revLengths;
+
+        int u = self.heap.pop();
+        self.settle(u);
+        double du = self.distance(u);
+
+        for (int e = off[u]; e < off[u + 1]; ++e) {
+            int v = adj[e];
+            double dv = du + len[e];
+            if (!self.relax(v, dv, u)) continue;
+            self.heap.push(v, dv);
+
+            if (other.reached(v) && dv + other.distance(v) < best) {
+                best = dv + other.distance(v);
+                meet = v;
+            }
+        }
+    }
+
+    lastSettled = forward.settledNodes() + backward.settledNodes();
+    if (meet < 0) return {};
+
+    lastDist = best;
+    return buildPath(meet);
+}
+
+double RouteEngine::potential(int v, int target, bool useLandmarks) const {
+    const Node& a = graph.getNodes()[v];
+    const Node& b = graph.getNodes()[target];
+    double bound = weights->lengthPerMeter * greatCircleMeters(a.lat, a.lon, b.lat, b.lon);
+    if (useLandmarks) {
+        bound = std::max(bound, weights->landmarks->lowerBound(v, target));
+    }
+    return bound;
+}
+
+// Unidirectional A*. Nodes are re-opened if a shorter path to them is found
+// after they were settled, so the result stays exact even where the float
+// landmark tables make the potential marginally inconsistent.
+std::vector<int> RouteEngine::goalDirectedPath(int source, int target, bool useLandmarks) {
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& lengths = weights->forward;
+
+    forward.relax(source, 0, -1);
+    forward.heap.push(source, potential(source, target, useLandmarks));
+
+    bool found = false;
+    while (!forward.heap.empty()) {
+        if (interrupted()) return {};
+        int u = forward.heap.pop();
+        forward.settle(u);
+        if (u == target) {
+            found = true;
+            break;
+        }
+
+        double du = forward.distance(u);
+        for (int e = offsets[u]; e < offsets[u + 1]; ++e) {
+            int v = targets[e];
+            double dv = du + lengths[e];
+            if (forward.relax(v, dv, u)) {
+                forward.heap.push(v, dv + potential(v, target, useLandmarks));
+            }
+        }
+    }
+
+    lastSettled = forward.settledNodes();
+    if (!found) return {};
+
+    lastDist = forward.distance(target);
+    std::vector<int> path;
+    for (int v = target; v >= 0; v = forward.parentOf(v)) {
+        path.push_back(v);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// Bidirectional search on the hierarchy: forward over up-edges from the
+// source, backward over down-edges from the target. A node is stalled, i.e.
+// not expanded, when a higher node already proves its label is too long.
+std::vector<int> RouteEngine::hierarchyPath(int source, int target) {
+    const ContractionHierarchy& ch = *weights->hierarchy;
+    const auto& upOffsets = ch.getUpOffsets();
+    const auto& upTargets = ch.getUpTargets();
+    const auto& upWeights = ch.getUpWeights();
+    const auto& downOffsets = ch.getDownOffsets();
+    const auto& downSources = ch.getDownSources();
+    const auto& downWeights = ch.getDownWeights();
+
+    forward.relax(source, 0, -1);
+    forward.heap.push(source, 0);
+    backward.relax(target, 0, -1);
+    backward.heap.push(target, 0);
+
+    double best = source == target ? 0 : SearchSpace::Infinity;
+    int meet = source == target ? source : -1;
+
+    while (!forward.heap.empty() || !backward.heap.empty()) {
+        bool forwardDone = forward.heap.empty() || forward.heap.topKey() >= best;
+        bool backwardDone = backward.heap.empty() || backward.heap.topKey() >= best;
+        if (forwardDone && backwardDone) break;
+        if (interrupted()) return {};
+
+        bool stepForward = backwardDone ||
+                           (!forwardDone && forward.heap.topKey() <= backward.heap.topKey());
+        SearchSpace& self = stepForward ? forward : backward;
+        SearchSpace& other = stepForward ? backward : forward;
+        const auto& off = stepForward ? upOffsets : downOffsets;
+        const auto& adj = stepForward ? upTargets : downSources;
+        const auto& weight = stepForward ? upWeights : downWeights;
+        const auto& stallOff = stepForward ? downOffsets : upOffsets;
+        const auto& stallAdj = stepForward ? downSources : upTargets;
+        const auto& stallWeight = stepForward ? downWeights : upWeights;
+
+        int u = self.heap.pop();
+        self.settle(u);
+        double du = self.distance(u);
+
+        if (other.reached(u) && du + other.distance(u) < best) {
+            best = du + other.distance(u);
+            meet = u;
+        }
+
+        bool stalled = false;
+        for (int e = stallOff[u]; e < stallOff[u + 1]; ++e) {
+            if (self.distance(stallAdj[e]) + stallWeight[e] < du) {
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled) continue;
+
+        for (int e = off[u]; e < off[u + 1]; ++e) {
+            int v = adj[e];
+            double dv = du + weight[e];
+            if (self.relax(v, dv, u)) self.heap.push(v, dv);
+        }
+    }
+
+    lastSettled = forward.settledNodes() + backward.settledNodes();
+    if (meet < 0) return {};
+
+    lastDist = best;
+
+    std::vector<int> upward;
+    for (int v = meet; v >= 0; v = forward.parentOf(v)) {
+        upward.push_back(v);
+    }
+    std::reverse(upward.begin(), upward.end());
+
+    std::vector<int> path(1, source);
+    for (size_t i = 0; i + 1 < upward.size(); ++i) {
+        ch.unpackEdge(upward[i], upward[i + 1], path);
+    }
+    for (int v = meet, next = backward.parentOf(meet); next >= 0; v = next, next = backward.parentOf(next)) {
+        ch.unpackEdge(v, next, path);
+    }
+    return path;
+}
+
+std::vector<int> RouteEngine::buildPath(int meet) const {
+    std::vector<int> path;
+    for (int v = meet; v >= 0; v = forward.parentOf(v)) {
+        path.push_back(v);
+    }
+    std::reverse(path.begin(), path.end());
+    for (int v = backward.parentOf(meet); v >= 0; v = backward.parentOf(v)) {
+        path.push_back(v);
+    }
+    return path;
+}
+
+double RouteEngine::lastDistance() const { return lastDist; }
+int RouteEngine::lastSettledCount() const { return lastSettled; }
@@ -0,0 +1,88 @@
+#ifndef ROUTEENGINE_H
+#define ROUTEENGINE_H
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include "searchspace.h"
+#include "edgeweights.h"
+
+class Graph;
+class RouteCache;
+
+enum RoutingAlgorithm {
+    BidirectionalDijkstra = 0,
+    AStar = 1,
+    AltAStar = 2,
+    ContractionHierarchies = 3
+};
+
+// Point-to-point query engine over a loaded Graph. The engine owns its
+// search workspaces, so a query only touches the region it settles; give
+// each thread its own engine to run queries concurrently on one Graph.
+// Every query runs on the weight state current when it starts.
+class RouteEngine {
+public:
+    explicit RouteEngine(const Graph& graph);
+
+    // AStar uses a great-circle lower bound scaled by the smallest
+    // length-per-meter ratio of any edge, so it stays admissible whatever unit
+    // the map stores lengths in. AltAStar additionally takes the landmark
+    // bound when the graph has landmarks, falling back to AStar otherwise.
+    // ContractionHierarchies needs a hierarchy for the current weight state
+    // and falls back to BidirectionalDijkstra without one.
+    void setAlgorithm(RoutingAlgorithm algorithm);
+    RoutingAlgorithm getAlgorithm() const;
+
+    // Shortest path between two node indices, ordered from source to target.
+    // Empty if the target is unreachable.
+    //
+    // With bidirectional Dijkstra, a query that repeats the source of the
+    // previous one switches to a plain Dijkstra search whose shortest-path
+    // tree it keeps: later targets from that source are read off the tree,
+    // or resume the search where it stopped. The other algorithms only take
+    // targets the tree already covers from it, since growing the tree
+    // towards a far target would settle far more than their own search.
+    std::vector<int> shortestPath(int source, int target);
+
+    // Finished routes are looked up in, and added to, this cache. The cache
+    // is not owned and may be shared with other engines.
+    void setRouteCache(RouteCache* cache);
+
+    double lastDistance() const;
+    int lastSettledCount() const;
+
+    // While a flag is set, the searches poll it every few hundred settled
+    // nodes and give up with an empty path once it becomes true.
+    void setCancelFlag(const std::atomic<bool>* flag);
+    bool wasCancelled() const;
+
+private:
+    const Graph& graph;
+    SearchSpace forward;
+    SearchSpace backward;
+    std::shared_ptr<const EdgeWeights> weights;
+    SearchSpace tree;
+    int treeSource;
+    unsigned treeVersion;
+    int lastSource;
+    RouteCache* cache;
+    RoutingAlgorithm algorithm;
+    double lastDist;
+    int lastSettled;
+    const std::atomic<bool>* cancelFlag;
+    unsigned pollCounter;
+    bool cancelled;
+
+    void prepare();
+    bool interrupted();
+    std::vector<int> search(int source, int target);
+    std::vector<int> treePath(int source, int target);
+    std::vector<int> bidirectionalPath(int source, int target);
+    std::vector<int> goalDirectedPath(int source, int target, bool useLandmarks);
+    double potential(int v, int target, bool useLandmarks) const;
+    std::vector<int> hierarchyPath(int source, int target);
+    std::vector<int> buildPath(int meet) const;
+};
+
+#endif // ROUTEENGINE_H
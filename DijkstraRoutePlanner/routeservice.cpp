@@ -0,0 +1,128 @@
+#include "routeservice.h"
+#include "graph.h"
+#include <QMutexLocker>
+#include <QMetaObject>
+
+RouteService::RouteService(QObject* parent)
+    : QObject(parent), graph(nullptr), hasPending(false), nextId(1), cancelRequested(false),
+      hasPendingIsochrone(false), isochroneCancelRequested(false) {
+    // A bare QObject living in the worker thread; lambdas queued on it run
+    // there, in order.
+    worker = new QObject();
+    worker->moveToThread(&thread);
+    thread.start();
+}
+
+RouteService::~RouteService() {
+    cancel();
+    thread.quit();
+    thread.wait();
+    delete worker;
+}
+
+void RouteService::setGraph(const Graph* g) {
+    cancel();
+    QMetaObject::invokeMethod(worker, [this, g]() {
+        engine.reset();
+        isochrone.reset();
+        graph = g;
+    }, Qt::BlockingQueuedConnection);
+}
+
+int RouteService::requestRoute(long startId, long endId, RoutingAlgorithm algorithm) {
+    int id;
+    {
+        QMutexLocker locker(&mutex);
+        id = nextId++;
+        pending = {id, startId, endId, algorithm};
+        hasPending = true;
+        cancelRequested = true;
+    }
+    QMetaObject::invokeMethod(worker, [this]() { runPending(); }, Qt::QueuedConnection);
+    return id;
+}
+
+int RouteService::requestIsochrone(long startId, const std::vector<double>& budgets) {
+    int id;
+    {
+        QMutexLocker locker(&mutex);
+        id = nextId++;
+        pendingIsochrone = {id, startId, budgets};
+        hasPendingIsochrone = true;
+        isochroneCancelRequested = true;
+    }
+    QMetaObject::invokeMethod(worker, [this]() { runPendingIsochrone(); }, Qt::QueuedConnection);
+    return id;
+}
+
+void RouteService::cancel() {
+    QMutexLocker locker(&mutex);
+    hasPending = false;
+    cancelRequested = true;
+    hasPendingIsochrone = false;
+    isochroneCancelRequested = true;
+}
+
+// Worker thread. Every request queues a call, but a call only runs the
+// newest request, so the ones it replaced find nothing to do.
+void RouteService::runPending() {
+    Request request;
+    {
+        QMutexLocker locker(&mutex);
+        if (!hasPending) return;
+        request = pending;
+        hasPending = false;
+        cancelRequested = false;
+    }
+    if (graph == nullptr) return;
+
+    if (!engine) {
+        engine.reset(new RouteEngine(*graph));
+        engine->setCancelFlag(&cancelRequested);
+        engine->setRouteCache(&graph->getRouteCache());
+    }
+    engine->setAlgorithm(request.algorithm);
+
+    int start = graph->indexOf(request.startId);
+    int end = graph->indexOf(request.endId);
+    std::vector<int> route = engine->shortestPath(start, end);
+    if (engine->wasCancelled()) return;
+
+    std::vector<long> path;
+    path.reserve(route.size());
+    const auto& nodes = graph->getNodes();
+    for (auto it = route.rbegin(); it != route.rend(); ++it) {
+        path.push_back(nodes[*it].id);
+    }
+
+    int id = request.id;
+    double distance = engine->lastDistance();
+    QMetaObject::invokeMethod(this, [this, id, path, distance]() {
+        emit routeReady(id, path, distance);
+    }, Qt::QueuedConnection);
+}
+
+// Worker thread, same scheme as runPending().
+void RouteService::runPendingIsochrone() {
+    IsochroneRequest request;
+    {
+        QMutexLocker locker(&mutex);
+        if (!hasPendingIsochrone) return;
+        request = pendingIsochrone;
+        hasPendingIsochrone = false;
+        isochroneCancelRequested = false;
+    }
+    if (graph == nullptr) return;
+
+    if (!isochrone) {
+        isochrone.reset(new Isochrone(*graph));
+        isochrone->setCancelFlag(&isochroneCancelRequested);
+    }
+    std::vector<IsochroneBand> bands = isochrone->compute(graph->indexOf(request.startId), request.budgets);
+    if (isochrone->wasCancelled()) return;
+
+    int id = request.id;
+    QMetaObject::invokeMethod(this, [this, id, bands]() {
+        emit isochroneReady(id, bands);
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,78 @@
+#ifndef ROUTESERVICE_H
+#define ROUTESERVICE_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "routeengine.h"
+#include "isochrone.h"
+
+class Graph;
+
+// Runs route and isochrone queries on a worker thread with its own
+// RouteEngine and Isochrone. Only the newest request of each kind matters:
+// a new one cancels the query of that kind in flight and replaces any
+// request still waiting, so bursts of clicks or hover moves never queue up
+// work.
+class RouteService : public QObject {
+    Q_OBJECT
+
+public:
+    explicit RouteService(QObject* parent = nullptr);
+    ~RouteService();
+
+    // Waits for the worker to go idle. The graph must not change while
+    // queries can run on it.
+    void setGraph(const Graph* graph);
+
+    // Returns the id that routeReady() will carry for this request.
+    int requestRoute(long startId, long endId, RoutingAlgorithm algorithm);
+    // Same for the service areas around startId, see Graph::isochrone().
+    int requestIsochrone(long startId, const std::vector<double>& budgets);
+    // Cancels both kinds.
+    void cancel();
+
+signals:
+    // Emitted on the thread that owns the service. The path is ordered from
+    // endId back to startId, like Graph::route(), and is empty when there is
+    // no route.
+    void routeReady(int requestId, const std::vector<long>& path, double distance);
+    void isochroneReady(int requestId, const std::vector<IsochroneBand>& bands);
+
+private:
+    struct Request {
+        int id;
+        long startId;
+        long endId;
+        RoutingAlgorithm algorithm;
+    };
+
+    QThread thread;
+    QObject* worker;
+    const Graph* graph;
+    std::unique_ptr<RouteEngine> engine;
+    std::unique_ptr<Isochrone> isochrone;
+
+    QMutex mutex;
+    Request pending;
+    bool hasPending;
+    int nextId;
+    std::atomic<bool> cancelRequested;
+
+    struct IsochroneRequest {
+        int id;
+        long startId;
+        std::vector<double> budgets;
+    };
+    IsochroneRequest pendingIsochrone;
+    bool hasPendingIsochrone;
+    std::atomic<bool> isochroneCancelRequested;
+
+    void runPending();
+    void runPendingIsochrone();
+};
+
+#endif // ROUTESERVICE_H
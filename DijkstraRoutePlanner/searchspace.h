@@ -0,0 +1,70 @@
+#ifndef SEARCHSPACE_H
+#define SEARCHSPACE_H
+
+#include <vector>
+#include <limits>
+#include "indexedheap.h"
+
+// Per-query labels of one search direction. Distances and parents are only
+// valid for nodes stamped with the current generation, so starting a new
+// query is O(1) instead of refilling arrays the size of the map.
+class SearchSpace {
+public:
+    static constexpr double Infinity = std::numeric_limits<double>::max();
+
+    void resize(int n) {
+        dist.assign(n, Infinity);
+        parent.assign(n, -1);
+        stamp.assign(n, 0);
+        settled.assign(n, 0);
+        generation = 1;
+        heap.resize(n);
+        settledCount = 0;
+    }
+
+    void reset() {
+        heap.clear();
+        settledCount = 0;
+        if (++generation == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            std::fill(settled.begin(), settled.end(), 0);
+            generation = 1;
+        }
+    }
+
+    int size() const { return static_cast<int>(dist.size()); }
+
+    bool reached(int v) const { return stamp[v] == generation; }
+    bool isSettled(int v) const { return settled[v] == generation; }
+    double distance(int v) const { return reached(v) ? dist[v] : Infinity; }
+    int parentOf(int v) const { return reached(v) ? parent[v] : -1; }
+
+    // Records a tentative label for v if it improves on the current one.
+    // Labels over closed (infinitely long) edges are never recorded.
+    bool relax(int v, double d, int from) {
+        if (d >= Infinity || (reached(v) && d >= dist[v])) return false;
+        stamp[v] = generation;
+        dist[v] = d;
+        parent[v] = from;
+        return true;
+    }
+
+    void settle(int v) {
+        settled[v] = generation;
+        ++settledCount;
+    }
+
+    int settledNodes() const { return settledCount; }
+
+    IndexedHeap heap;
+
+private:
+    std::vector<double> dist;
+    std::vector<int> parent;
+    std::vector<unsigned> stamp;
+    std::vector<unsigned> settled;
+    unsigned generation = 0;
+    int settledCount = 0;
+};
+
+#endif // SEARCHSPACE_H
@@ -0,0 +1,36 @@
+QT = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+# The routing core is compiled straight from the planner; none of these
+# files depend on QtGui or QtWidgets.
+CORE = ..
+INCLUDEPATH += $$CORE
+
+SOURCES += \
+    tst_edgeweights.cpp \
+    $$CORE/contractionhierarchy.cpp \
+    $$CORE/distancetable.cpp \
+    $$CORE/graph.cpp \
+    $$CORE/isochrone.cpp \
+    $$CORE/kdtree.cpp \
+    $$CORE/landmarks.cpp \
+    $$CORE/maploader.cpp \
+    $$CORE/routecache.cpp \
+    $$CORE/routeengine.cpp
+
+HEADERS += \
+    $$CORE/contractionhierarchy.h \
+    $$CORE/distancetable.h \
+    $$CORE/edgeweights.h \
+    $$CORE/geo.h \
+    $$CORE/graph.h \
+    $$CORE/indexedheap.h \
+    $$CORE/isochrone.h \
+    $$CORE/kdtree.h \
+    $$CORE/landmarks.h \
+    $$CORE/maploader.h \
+    $$CORE/routecache.h \
+    $$CORE/routeengine.h \
+    $$CORE/searchspace.h
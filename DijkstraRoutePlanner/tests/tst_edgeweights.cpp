@@ -0,0 +1,185 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <functional>
+#include <queue>
+#include <random>
+#include "geo.h"
+#include "graph.h"
+
+namespace {
+
+const int Side = 40;
+
+// Side x Side grid of two-way roads about 100 m apart, each direction
+// between one and two times its straight-line length.
+bool writeGridMap(const QString& path, unsigned seed) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) return false;
+    QTextStream out(&file);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> detour(1, 2);
+
+    auto lat = [](int v) { return 46.0 + (v / Side) * 0.0009; };
+    auto lon = [](int v) { return 24.0 + (v % Side) * 0.0013; };
+    out << "<map>\n";
+    for (int v = 0; v < Side * Side; ++v) {
+        out << "<node id=\"" << v + 1 << "\" latitude=\"" << QString::number(lat(v), 'f', 7)
+            << "\" longitude=\"" << QString::number(lon(v), 'f', 7) << "\"/>\n";
+    }
+    auto road = [&](int a, int b) {
+        double meters = greatCircleMeters(lat(a), lon(a), lat(b), lon(b));
+        out << "<arc from=\"" << a + 1 << "\" to=\"" << b + 1 << "\" length=\""
+            << QString::number(meters * detour(rng), 'f', 2) << "\"/>\n";
+        out << "<arc from=\"" << b + 1 << "\" to=\"" << a + 1 << "\" length=\""
+            << QString::number(meters * detour(rng), 'f', 2) << "\"/>\n";
+    };
+    for (int v = 0; v < Side * Side; ++v) {
+        if (v % Side + 1 < Side) road(v, v + 1);
+        if (v + Side < Side * Side) road(v, v + Side);
+    }
+    out << "</map>\n";
+    return true;
+}
+
+// Plain Dijkstra over the lengths of one weight state.
+std::vector<double> reference(const Graph& graph, const EdgeWeights& weights, int source) {
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    std::vector<double> dist(graph.nodeCount(), SearchSpace::Infinity);
+    std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<>> queue;
+    dist[source] = 0;
+    queue.push({0, source});
+    while (!queue.empty()) {
+        std::pair<double, int> top = queue.top();
+        queue.pop();
+        if (top.first > dist[top.second]) continue;
+        for (int e = offsets[top.second]; e < offsets[top.second + 1]; ++e) {
+            double d = top.first + weights.forward[e];
+            if (d < dist[targets[e]]) {
+                dist[targets[e]] = d;
+                queue.push({d, targets[e]});
+            }
+        }
+    }
+    return dist;
+}
+
+std::vector<EdgeWeightUpdate> randomBatch(const Graph& graph, int count, std::mt19937& rng) {
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& nodes = graph.getNodes();
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<EdgeWeightUpdate> updates;
+    for (int i = 0; i < count; ++i) {
+        int u = static_cast<int>(rng() % graph.nodeCount());
+        int e = offsets[u] + static_cast<int>(rng() % (offsets[u + 1] - offsets[u]));
+        double kind = unit(rng);
+        double factor = kind < 0.4 ? 1 + 3 * unit(rng)
+                      : kind < 0.8 ? 0.3 + 0.7 * unit(rng)
+                      : kind < 0.9 ? EdgeWeightUpdate::Closed
+                                   : 1;
+        updates.push_back({nodes[u].id, nodes[targets[e]].id, factor});
+    }
+    return updates;
+}
+
+}
+
+class TestEdgeWeights : public QObject {
+    Q_OBJECT
+
+private slots:
+    void algorithmsAgreeAfterUpdates();
+    void resetRestoresLengthBound();
+    void destroyDuringRebuild();
+};
+
+// Every algorithm, and a route cache shared by all of them, has to give the
+// reference distance after batches that lengthen, shorten, close and reset
+// edges; CH once the hierarchy has been rebuilt for the batch.
+void TestEdgeWeights::algorithmsAgreeAfterUpdates() {
+    QTemporaryDir dir;
+    QString path = dir.filePath("grid.xml");
+    QVERIFY(writeGridMap(path, 7));
+
+    Graph graph;
+    QVERIFY(graph.loadFromXml(path));
+    QVERIFY(graph.prepareLandmarks(4));
+    QVERIFY(graph.prepareContractionHierarchy());
+
+    RouteCache cache;
+    std::vector<std::unique_ptr<RouteEngine>> engines;
+    for (RoutingAlgorithm algorithm : {BidirectionalDijkstra, AStar, AltAStar, ContractionHierarchies}) {
+        engines.emplace_back(new RouteEngine(graph));
+        engines.back()->setAlgorithm(algorithm);
+        engines.back()->setRouteCache(&cache);
+    }
+
+    std::mt19937 rng(3);
+    int n = graph.nodeCount();
+    for (int batch = 0; batch < 6; ++batch) {
+        if (batch == 4) graph.resetEdgeWeights();
+        else if (batch > 0) QVERIFY(graph.updateEdgeWeights(randomBatch(graph, n / 4, rng)) > 0);
+        QVERIFY(graph.waitForContractionHierarchy());
+        std::shared_ptr<const EdgeWeights> weights = graph.getWeights();
+        QVERIFY(weights->landmarks);
+
+        // The same pairs in every batch, so cached routes are asked again.
+        std::mt19937 pairs(11);
+        for (int i = 0; i < 8; ++i) {
+            int source = static_cast<int>(pairs() % n);
+            std::vector<double> dist = reference(graph, *weights, source);
+            for (int j = 0; j < 20; ++j) {
+                int target = static_cast<int>(pairs() % n);
+                for (auto& engine : engines) {
+                    std::vector<int> path = engine->shortestPath(source, target);
+                    if (dist[target] >= SearchSpace::Infinity) {
+                        QVERIFY(path.empty());
+                    } else {
+                        QVERIFY(!path.empty());
+                        QVERIFY(qAbs(engine->lastDistance() - dist[target]) <= 1e-6 * dist[target] + 1e-6);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void TestEdgeWeights::resetRestoresLengthBound() {
+    QTemporaryDir dir;
+    QString path = dir.filePath("grid.xml");
+    QVERIFY(writeGridMap(path, 5));
+
+    Graph graph;
+    QVERIFY(graph.loadFromXml(path));
+    double original = graph.getWeights()->lengthPerMeter;
+    const auto& nodes = graph.getNodes();
+    const auto& targets = graph.getEdgeTargets();
+    QVERIFY(graph.updateEdgeWeights({{nodes[0].id, nodes[targets[graph.getEdgeOffsets()[0]]].id, 0.1}}) == 1);
+    QVERIFY(graph.getWeights()->lengthPerMeter < original);
+    QVERIFY(graph.resetEdgeWeights() == 1);
+    QCOMPARE(graph.getWeights()->lengthPerMeter, original);
+}
+
+// The rebuild in the background is cancelled, not waited for.
+void TestEdgeWeights::destroyDuringRebuild() {
+    QTemporaryDir dir;
+    QString path = dir.filePath("grid.xml");
+    QVERIFY(writeGridMap(path, 9));
+
+    std::mt19937 rng(1);
+    auto graph = std::make_unique<Graph>();
+    QVERIFY(graph->loadFromXml(path));
+    QVERIFY(graph->prepareContractionHierarchy());
+    QVERIFY(graph->updateEdgeWeights(randomBatch(*graph, 200, rng)) > 0);
+    QVERIFY(graph->loadFromXml(path));
+    QVERIFY(!graph->getWeights()->hierarchy);
+    QVERIFY(graph->prepareContractionHierarchy());
+    QVERIFY(graph->updateEdgeWeights(randomBatch(*graph, 200, rng)) > 0);
+    graph.reset();
+}
+
+QTEST_APPLESS_MAIN(TestEdgeWeights)
+
+#include "tst_edgeweights.moc"
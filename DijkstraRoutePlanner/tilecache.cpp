@@ -0,0 +1,217 @@
+#include "tilecache.h"
+#include "graph.h"
+#include "edgegrid.h"
+#include <QPainter>
+#include <QPen>
+#include <QVector>
+#include <QLineF>
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// Segments shorter than this on screen are skipped.
+const double MinSegmentPixels = 0.5;
+// Number of lines handed to QPainter per drawLines() call.
+const int LineBatchSize = 4096;
+// How many zoom levels down a missing tile may borrow from.
+const int FallbackLevels = 4;
+const int MaxCachedTiles = 256;
+
+QImage renderTile(const Graph& graph, const EdgeGrid& grid, int baseWidth, int baseHeight,
+                  int z, int tx, int ty) {
+    QImage image(TileCache::TileSize, TileCache::TileSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+
+    // Tile pixels per normalized unit; v grows upwards while y grows down.
+    double zoom = std::ldexp(1.0, z);
+    double pixelsPerU = baseWidth * zoom;
+    double pixelsPerV = baseHeight * zoom;
+    double left = static_cast<double>(tx) * TileCache::TileSize;
+    double top = static_cast<double>(ty) * TileCache::TileSize;
+
+    // One pixel of margin so lines ending just outside still get their
+    // antialiased edge drawn.
+    double minU = (left - 1) / pixelsPerU;
+    double maxU = (left + TileCache::TileSize + 1) / pixelsPerU;
+    double minV = 1.0 - (top + TileCache::TileSize + 1) / pixelsPerV;
+    double maxV = 1.0 - (top - 1) / pixelsPerV;
+
+    std::vector<int> segments;
+    grid.query(minU, minV, maxU, maxV, pixelsPerU, pixelsPerV, MinSegmentPixels, segments);
+    if (segments.empty()) return image;
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    QPen penEdge(Qt::lightGray, 1);
+    painter.setPen(penEdge);
+
+    const auto& nodes = graph.getNodes();
+    auto x = [&](const Node& n) { return (n.lon - graph.minLon) / graph.lonRange() * pixelsPerU - left; };
+    auto y = [&](const Node& n) { return (1.0 - (n.lat - graph.minLat) / graph.latRange()) * pixelsPerV - top; };
+
+    QVector<QLineF> lines;
+    lines.reserve(LineBatchSize);
+    for (int s : segments) {
+        const Node& a = nodes[grid.segmentFrom(s)];
+        const Node& b = nodes[grid.segmentTo(s)];
+        lines.append(QLineF(x(a), y(a), x(b), y(b)));
+        if (lines.size() == LineBatchSize) {
+            painter.drawLines(lines);
+            lines.clear();
+        }
+    }
+    if (!lines.isEmpty()) painter.drawLines(lines);
+    return image;
+}
+
+}
+
+class TileCache::Job : public QRunnable {
+public:
+    Job(TileCache* cache, int z, int tx, int ty)
+        : cache(cache), z(z), tx(tx), ty(ty),
+          key(keyOf(z, tx, ty)), generation(cache->generation.load()),
+          graph(cache->graph), grid(cache->grid),
+          baseWidth(cache->baseWidth), baseHeight(cache->baseHeight) {}
+
+    void run() override {
+        QImage image;
+        if (cache->isWanted(key)) {
+            image = renderTile(*graph, *grid, baseWidth, baseHeight, z, tx, ty);
+        }
+
+        TileCache* target = cache;
+        quint64 k = key;
+        int g = generation;
+        QMetaObject::invokeMethod(target, [target, k, g, image]() {
+            target->finishTile(k, g, image);
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    TileCache* cache;
+    int z, tx, ty;
+    quint64 key;
+    int generation;
+    const Graph* graph;
+    const EdgeGrid* grid;
+    int baseWidth, baseHeight;
+};
+
+TileCache::TileCache(QObject* parent)
+    : QObject(parent), graph(nullptr), grid(nullptr), baseWidth(0), baseHeight(0),
+      tiles(MaxCachedTiles), generation(0) {
+    // Leave a core to the GUI thread.
+    int threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    pool.setMaxThreadCount(std::max(1, threads));
+}
+
+TileCache::~TileCache() {
+    pool.clear();
+    pool.waitForDone();
+}
+
+void TileCache::invalidate() {
+    pool.clear();
+    ++generation;
+    tiles.clear();
+    pending.clear();
+}
+
+void TileCache::setSource(const Graph* g, const EdgeGrid* edgeGrid) {
+    invalidate();
+    pool.waitForDone();
+    graph = g;
+    grid = edgeGrid;
+}
+
+void TileCache::setBaseSize(int width, int height) {
+    if (width == baseWidth && height == baseHeight) return;
+    invalidate();
+    baseWidth = width;
+    baseHeight = height;
+}
+
+int TileCache::zoomLevelFor(double scaleFactor) {
+    int z = static_cast<int>(std::lround(std::log2(scaleFactor)));
+    return std::min(MaxZoomLevel, std::max(MinZoomLevel, z));
+}
+
+int TileCache::tilesAcross(int z) const {
+    return std::max(1, static_cast<int>(std::ceil(baseWidth * std::ldexp(1.0, z) / TileSize)));
+}
+
+int TileCache::tilesDown(int z) const {
+    return std::max(1, static_cast<int>(std::ceil(baseHeight * std::ldexp(1.0, z) / TileSize)));
+}
+
+quint64 TileCache::keyOf(int z, int tx, int ty) {
+    return (static_cast<quint64>(z - MinZoomLevel) << 56) |
+           (static_cast<quint64>(tx) << 28) |
+           static_cast<quint64>(ty);
+}
+
+void TileCache::beginFrame() {
+    frameTiles.clear();
+}
+
+void TileCache::endFrame() {
+    QMutexLocker locker(&wantedMutex);
+    wanted = frameTiles;
+}
+
+bool TileCache::isWanted(quint64 key) {
+    QMutexLocker locker(&wantedMutex);
+    return wanted.contains(key);
+}
+
+void TileCache::request(int z, int tx, int ty) {
+    quint64 key = keyOf(z, tx, ty);
+    frameTiles.insert(key);
+    if (pending.contains(key) || graph == nullptr || grid == nullptr || baseWidth <= 0 || baseHeight <= 0) {
+        return;
+    }
+
+    // The job must not be skipped before this frame ends.
+    {
+        QMutexLocker locker(&wantedMutex);
+        wanted.insert(key);
+    }
+    pending.insert(key);
+    pool.start(new Job(this, z, tx, ty));
+}
+
+bool TileCache::tileFor(int z, int tx, int ty, QImage& image, QRectF& source) {
+    if (QImage* tile = tiles.object(keyOf(z, tx, ty))) {
+        image = *tile;
+        source = QRectF(0, 0, TileSize, TileSize);
+        return true;
+    }
+    request(z, tx, ty);
+
+    for (int dz = 1; dz <= FallbackLevels && z - dz >= MinZoomLevel; ++dz) {
+        QImage* parentTile = tiles.object(keyOf(z - dz, tx >> dz, ty >> dz));
+        if (parentTile == nullptr) continue;
+
+        double span = static_cast<double>(TileSize) / (1 << dz);
+        int mask = (1 << dz) - 1;
+        image = *parentTile;
+        source = QRectF((tx & mask) * span, (ty & mask) * span, span, span);
+        return true;
+    }
+    return false;
+}
+
+void TileCache::finishTile(quint64 key, int jobGeneration, const QImage& image) {
+    if (jobGeneration != generation.load()) return;
+
+    pending.remove(key);
+    if (image.isNull()) return;
+
+    tiles.insert(key, new QImage(image));
+    emit tileReady();
+}
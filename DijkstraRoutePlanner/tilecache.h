@@ -0,0 +1,84 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QObject>
+#include <QImage>
+#include <QRectF>
+#include <QCache>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+
+class Graph;
+class EdgeGrid;
+
+// Raster tiles of the road layer. At zoom level z the map is drawn
+// 2^z times the widget size, cut into TileSize squares addressed by
+// (z, tx, ty). Tiles are rendered on a private thread pool from the
+// normalized lat/lon data, which the widget never changes after load, and
+// kept in an LRU cache.
+class TileCache : public QObject {
+    Q_OBJECT
+
+public:
+    static const int TileSize = 256;
+    static const int MinZoomLevel = -8;
+    static const int MaxZoomLevel = 20;
+
+    explicit TileCache(QObject* parent = nullptr);
+    ~TileCache();
+
+    // Waits for running jobs and drops every tile. The graph and grid must
+    // stay unchanged until the next call.
+    void setSource(const Graph* graph, const EdgeGrid* grid);
+    // Size of the map at zoom level 0; a change drops every tile.
+    void setBaseSize(int width, int height);
+
+    static int zoomLevelFor(double scaleFactor);
+    int tilesAcross(int z) const;
+    int tilesDown(int z) const;
+
+    // Tiles requested between beginFrame() and endFrame() replace the set of
+    // wanted tiles; queued jobs for tiles no longer wanted are skipped.
+    void beginFrame();
+    void endFrame();
+
+    // Finds the tile, or the nearest lower zoom level that covers it, and
+    // the part of that image to draw. A missing tile is queued for
+    // rendering and tileReady() is emitted once it is available.
+    bool tileFor(int z, int tx, int ty, QImage& image, QRectF& source);
+
+signals:
+    void tileReady();
+
+private:
+    class Job;
+
+    const Graph* graph;
+    const EdgeGrid* grid;
+    int baseWidth;
+    int baseHeight;
+
+    QThreadPool pool;
+    QCache<quint64, QImage> tiles;
+    QSet<quint64> pending;
+
+    // Tiles of the frame being painted, and of the last painted frame; the
+    // latter is read by the workers.
+    QSet<quint64> frameTiles;
+    QMutex wantedMutex;
+    QSet<quint64> wanted;
+
+    // Bumped whenever the cached tiles become invalid, so results of jobs
+    // started before are thrown away.
+    std::atomic<int> generation;
+
+    static quint64 keyOf(int z, int tx, int ty);
+    void request(int z, int tx, int ty);
+    bool isWanted(quint64 key);
+    void finishTile(quint64 key, int jobGeneration, const QImage& image);
+    void invalidate();
+};
+
+#endif // TILECACHE_H
@@ -9,13 +9,32 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    allpairs.cpp \
+    cityloader.cpp \
+    delaunay.cpp \
+    dynamicallpairs.cpp \
+    floydwarshall.cpp \
     graph.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    spanningtree.cpp \
+    tourimprove.cpp
 
 HEADERS += \
+    allpairs.h \
+    cityloader.h \
+    delaunay.h \
+    disjointsets.h \
+    distancematrix.h \
+    dynamicallpairs.h \
+    floydwarshall.h \
     graph.h \
-    mainwindow.h
+    mainwindow.h \
+    matrix.h \
+    nexthopmatrix.h \
+    spanningtree.h \
+    sparsegraph.h \
+    tourimprove.h
 
 FORMS += \
     mainwindow.ui
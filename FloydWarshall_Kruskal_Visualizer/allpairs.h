@@ -0,0 +1,27 @@
+#ifndef ALLPAIRS_H
+#define ALLPAIRS_H
+
+#include "distancematrix.h"
+#include "nexthopmatrix.h"
+#include "sparsegraph.h"
+
+// All-pairs shortest paths on a sparse graph: one Dijkstra per source,
+// sources spread over threadCount threads (<= 0 uses every core). Each
+// search writes its distances and first hops straight into its row of the
+// output, so apart from the output the only memory used is the graph and
+// O(n) scratch per thread. Distances are stored times dist.scale() in the
+// matrix's entry type; unreachable pairs are Matrix<T>::infinity() / -1.
+//
+// Negative weights are handled with Johnson's reweighting: Bellman-Ford
+// from a virtual source gives potentials h with w(u, v) + h(u) - h(v) >= 0,
+// Dijkstra runs on those, and the distances are shifted back. Returns false
+// without touching dist or next if there is a negative cycle.
+template <typename T>
+bool dijkstraAllPairs(const SparseGraph& graph, Matrix<T>& dist, NextHopMatrix& next, int threadCount = 0);
+
+// Rough cost model choosing between the above and floydWarshall(): n
+// Dijkstras cost about n (m + n log n) steps, Floyd-Warshall n^3 cheaper
+// vectorised min-plus steps.
+bool preferSparseAllPairs(int nodeCount, int arcCount);
+
+#endif
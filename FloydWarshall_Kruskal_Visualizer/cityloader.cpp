@@ -0,0 +1,550 @@
+#include "cityloader.h"
+#include <QByteArray>
+#include <QFile>
+#include <QSaveFile>
+#include <QString>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const quint32 BinaryMagic = 0x31425746; // "FWB1"
+const quint32 BinaryVersion = 1;
+
+struct BinaryHeader {
+    quint32 magic;
+    quint32 version;
+    qint32 cityCount;
+    qint32 roadCount;
+    qint64 nameBytes;
+};
+
+// Past this many only a note that there are more is kept.
+const size_t MaxProblems = 100;
+
+void report(std::vector<std::string>& problems, int line, const std::string& what, const char* unit = "line") {
+    if (problems.size() < MaxProblems) problems.push_back(unit + (" " + std::to_string(line)) + ": " + what);
+    else if (problems.size() == MaxProblems) problems.push_back("more lines skipped");
+}
+
+// A whole file, mapped for as long as this object lives. Empty files are
+// open with no data.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename)
+        : file(QString::fromStdString(filename)), data(nullptr), size(0), opened(false) {
+        if (!file.open(QIODevice::ReadOnly)) return;
+        size = file.size();
+        if (size > 0) data = reinterpret_cast<const char*>(file.map(0, size));
+        opened = size == 0 || data != nullptr;
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) file.unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+    }
+
+    bool isOpen() const { return opened; }
+    const char* begin() const { return data; }
+    const char* end() const { return data + size; }
+    qint64 length() const { return size; }
+
+private:
+    QFile file;
+    const char* data;
+    qint64 size;
+    bool opened;
+};
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+struct Token {
+    const char* begin;
+    const char* end;
+
+    bool is(const char* word) const {
+        size_t length = std::strlen(word);
+        return static_cast<size_t>(end - begin) == length && std::memcmp(begin, word, length) == 0;
+    }
+    std::string text() const { return std::string(begin, end); }
+};
+
+bool nextToken(const char*& p, const char* end, Token& token) {
+    while (p < end && isSpace(*p)) ++p;
+    if (p == end) return false;
+    token.begin = p;
+    while (p < end && !isSpace(*p)) ++p;
+    token.end = p;
+    return true;
+}
+
+// Fills up to max tokens and returns how many the line has in all.
+int splitTokens(const char* p, const char* end, Token* tokens, int max) {
+    int count = 0;
+    Token token;
+    while (nextToken(p, end, token)) {
+        if (count < max) tokens[count] = token;
+        ++count;
+    }
+    return count;
+}
+
+Token trimmed(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) ++p;
+    while (end > p && isSpace(end[-1])) --end;
+    return {p, end};
+}
+
+// Calls visit(lineNumber, begin, end) for every line without its line
+// break, until visit returns false.
+template <typename Visitor>
+void forEachLine(const char* p, const char* end, Visitor visit) {
+    int number = 0;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (eol == nullptr) eol = end;
+        if (!visit(++number, p, eol)) return;
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+bool parseInteger(const Token& token, int& out) {
+    const char* p = token.begin;
+    bool negative = false;
+    if (p < token.end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == token.end || token.end - p > 10) return false;
+
+    long long value = 0;
+    for (; p < token.end; ++p) {
+        if (!isDigit(*p)) return false;
+        value = value * 10 + (*p - '0');
+    }
+    if (negative) value = -value;
+    if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) return false;
+    out = static_cast<int>(value);
+    return true;
+}
+
+// Up to 19 significant digits and a power of ten within 1e22 are converted
+// exactly with one multiply or divide; anything else goes through Qt's
+// (locale independent) conversion.
+bool parseNumber(const Token& token, double& out) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = token.begin;
+    const char* end = token.end;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    unsigned long long mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool anyDigit = false;
+    bool truncated = false;
+
+    for (; p < end && isDigit(*p); ++p) {
+        anyDigit = true;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0) ++significant;
+        } else {
+            ++exponent;
+            truncated = true;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && isDigit(*p); ++p) {
+            anyDigit = true;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0) ++significant;
+                --exponent;
+            } else {
+                truncated = true;
+            }
+        }
+    }
+    if (!anyDigit) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int e = 0;
+        if (!parseInteger({p + 1, end}, e)) return false;
+        exponent += e;
+        p = end;
+    }
+    if (p != end) return false;
+
+    if (!truncated && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+
+    bool ok = false;
+    out = QByteArray(token.begin, static_cast<int>(end - token.begin)).toDouble(&ok);
+    return ok;
+}
+
+// Calls cell(i, j) in the order the TSPLIB layout lists its weights and
+// returns how many there are, or -1 for a layout it does not know. The
+// matrix is symmetric, so every *_COL layout lists the same cells as the
+// opposite *_ROW one.
+template <typename Cell>
+long long forEachWeightCell(const std::string& format, int n, Cell cell) {
+    long long count = 0;
+    bool full = format == "FULL_MATRIX";
+    bool upper = format == "UPPER_ROW" || format == "LOWER_COL";
+    bool lower = format == "LOWER_ROW" || format == "UPPER_COL";
+    bool upperDiagonal = format == "UPPER_DIAG_ROW" || format == "LOWER_DIAG_COL";
+    bool lowerDiagonal = format == "LOWER_DIAG_ROW" || format == "UPPER_DIAG_COL";
+    if (!full && !upper && !lower && !upperDiagonal && !lowerDiagonal) return -1;
+
+    for (int i = 0; i < n; ++i) {
+        int from = full || lower || lowerDiagonal ? 0 : (upper ? i + 1 : i);
+        int to = full || upper || upperDiagonal ? n : (lower ? i : i + 1);
+        for (int j = from; j < to; ++j) {
+            cell(i, j);
+            ++count;
+        }
+    }
+    return count;
+}
+
+}
+
+bool CityLoader::read(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                      std::vector<std::string>& problems) {
+    std::string extension;
+    size_t dot = filename.rfind('.');
+    if (dot != std::string::npos) extension = filename.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+    if (extension == "tsp") return readTsplib(filename, cities, roads, problems);
+    if (extension == "fwb") return readBinary(filename, cities, roads, problems);
+    return readText(filename, cities, roads, problems);
+}
+
+bool CityLoader::readText(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                          std::vector<std::string>& problems) {
+    MappedFile file(filename);
+    if (!file.isOpen()) return false;
+
+    cities.clear();
+    roads.clear();
+    problems.clear();
+    bool inCities = true;
+    forEachLine(file.begin(), file.end(), [&](int line, const char* p, const char* end) {
+        Token tokens[3];
+        int count = splitTokens(p, end, tokens, 3);
+        if (count == 0) return true;
+
+        if (inCities) {
+            if (tokens[0].is("EndCities")) {
+                inCities = false;
+                if (count > 1) report(problems, line, "text after EndCities ignored");
+                return true;
+            }
+            int x, y;
+            if (count != 3 || !parseInteger(tokens[1], x) || !parseInteger(tokens[2], y)) {
+                report(problems, line, "expected a city as 'name x y'");
+                return true;
+            }
+            cities.push_back({tokens[0].text(), x, y, static_cast<int>(cities.size())});
+            return true;
+        }
+
+        int u, v;
+        double w;
+        if (count != 3 || !parseInteger(tokens[0], u) || !parseInteger(tokens[1], v) || !parseNumber(tokens[2], w)) {
+            report(problems, line, "expected a road as 'from to length'");
+        } else if (u < 0 || v < 0 || u >= static_cast<int>(cities.size()) || v >= static_cast<int>(cities.size())) {
+            report(problems, line, "road to a city that does not exist");
+        } else {
+            roads.push_back({u, v, w});
+        }
+        return true;
+    });
+    return true;
+}
+
+bool CityLoader::readTsplib(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                            std::vector<std::string>& problems) {
+    MappedFile file(filename);
+    if (!file.isOpen()) return false;
+
+    cities.clear();
+    roads.clear();
+    problems.clear();
+
+    enum Section { Header, Coordinates, Weights, Ignored };
+    Section section = Header;
+    int n = 0;
+    std::string weightType;
+    std::string weightFormat = "FULL_MATRIX";
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<char> placed;
+    std::vector<double> weights;
+    bool failed = false;
+
+    forEachLine(file.begin(), file.end(), [&](int line, const char* p, const char* end) {
+        Token first;
+        const char* rest = p;
+        if (!nextToken(rest, end, first)) return true;
+
+        bool keyword = (*first.begin >= 'A' && *first.begin <= 'Z') || (*first.begin >= 'a' && *first.begin <= 'z');
+        if (!keyword) {
+            if (section == Coordinates) {
+                Token tokens[3];
+                int id;
+                double cx, cy;
+                if (splitTokens(p, end, tokens, 3) < 3 || !parseInteger(tokens[0], id) ||
+                    !parseNumber(tokens[1], cx) || !parseNumber(tokens[2], cy)) {
+                    report(problems, line, "expected a node as 'id x y'");
+                } else if (id < 1 || id > n) {
+                    report(problems, line, "node " + std::to_string(id) + " is outside DIMENSION");
+                } else {
+                    x[id - 1] = cx;
+                    y[id - 1] = cy;
+                    placed[id - 1] = 1;
+                }
+            } else if (section == Weights) {
+                Token token;
+                double w;
+                for (const char* q = p; nextToken(q, end, token);) {
+                    if (!parseNumber(token, w)) {
+                        report(problems, line, "expected a weight, found '" + token.text() + "'");
+                        break;
+                    }
+                    weights.push_back(w);
+                }
+            } else if (section == Header) {
+                report(problems, line, "unexpected line");
+            }
+            return true;
+        }
+
+        // "KEY : value", "KEY: value" or a bare section name.
+        const char* colon = static_cast<const char*>(std::memchr(p, ':', end - p));
+        Token key = colon != nullptr ? trimmed(p, colon) : first;
+        Token value = trimmed(colon != nullptr ? colon + 1 : first.end, end);
+
+        if (key.is("EOF")) return false;
+        if (key.is("DIMENSION")) {
+            if (!parseInteger(value, n) || n <= 0) {
+                report(problems, line, "bad DIMENSION");
+                failed = true;
+                return false;
+            }
+            x.assign(n, 0);
+            y.assign(n, 0);
+            placed.assign(n, 0);
+            section = Header;
+        } else if (key.is("EDGE_WEIGHT_TYPE")) {
+            weightType = value.text();
+            section = Header;
+        } else if (key.is("EDGE_WEIGHT_FORMAT")) {
+            weightFormat = value.text();
+            section = Header;
+        } else if (key.is("NODE_COORD_SECTION") || key.is("DISPLAY_DATA_SECTION") || key.is("EDGE_WEIGHT_SECTION")) {
+            if (n == 0) {
+                report(problems, line, key.text() + " before DIMENSION");
+                failed = true;
+                return false;
+            }
+            section = key.is("EDGE_WEIGHT_SECTION") ? Weights : Coordinates;
+        } else if (key.end - key.begin > 8 && std::memcmp(key.end - 8, "_SECTION", 8) == 0) {
+            // FIXED_EDGES_SECTION, TOUR_SECTION and the like.
+            section = Ignored;
+        } else {
+            section = Header;
+        }
+        return true;
+    });
+
+    if (failed) return false;
+    if (n == 0) {
+        problems.push_back("no DIMENSION");
+        return false;
+    }
+
+    if (weightType == "EUC_2D" || weightType == "CEIL_2D") {
+        int missing = static_cast<int>(std::count(placed.begin(), placed.end(), 0));
+        if (missing > 0) problems.push_back(std::to_string(missing) + " nodes without coordinates");
+    } else if (weightType == "EXPLICIT") {
+        std::vector<double> matrix(static_cast<size_t>(n) * n, 0);
+        size_t k = 0;
+        long long expected = forEachWeightCell(weightFormat, n, [&](int i, int j) {
+            if (k < weights.size()) matrix[static_cast<size_t>(i) * n + j] = weights[k];
+            ++k;
+        });
+        if (expected < 0) {
+            problems.push_back("EDGE_WEIGHT_FORMAT " + weightFormat + " is not supported");
+            return false;
+        }
+        if (static_cast<long long>(weights.size()) != expected) {
+            problems.push_back("EDGE_WEIGHT_SECTION has " + std::to_string(weights.size()) + " weights, " +
+                               weightFormat + " needs " + std::to_string(expected));
+            if (static_cast<long long>(weights.size()) < expected) return false;
+        }
+
+        // Triangular layouts fill one side only; a full matrix may differ
+        // between the two directions, and the shorter one is the road.
+        bool full = weightFormat == "FULL_MATRIX";
+        roads.reserve(static_cast<size_t>(n) * (n - 1) / 2);
+        for (int i = 0; i < n; ++i) {
+            for (int j = i + 1; j < n; ++j) {
+                double there = matrix[static_cast<size_t>(i) * n + j];
+                double back = matrix[static_cast<size_t>(j) * n + i];
+                roads.push_back({i, j, full ? std::min(there, back) : there + back});
+            }
+        }
+
+        if (std::count(placed.begin(), placed.end(), 0) > 0) {
+            const double pi = std::acos(-1.0);
+            for (int i = 0; i < n; ++i) {
+                x[i] = 400 + 250 * std::cos(2 * pi * i / n);
+                y[i] = 320 + 250 * std::sin(2 * pi * i / n);
+            }
+        }
+    } else {
+        problems.push_back("EDGE_WEIGHT_TYPE " + (weightType.empty() ? std::string("missing") : weightType) +
+                           " is not supported");
+        return false;
+    }
+
+    cities.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        cities.push_back({std::to_string(i + 1), static_cast<int>(std::lround(x[i])),
+                          static_cast<int>(std::lround(y[i])), i});
+    }
+    return true;
+}
+
+bool CityLoader::readBinary(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                            std::vector<std::string>& problems) {
+    MappedFile file(filename);
+    if (!file.isOpen()) return false;
+    problems.clear();
+
+    BinaryHeader header;
+    if (file.length() < static_cast<qint64>(sizeof(header))) return false;
+    std::memcpy(&header, file.begin(), sizeof(header));
+    if (header.magic != BinaryMagic || header.version != BinaryVersion || header.cityCount < 0 ||
+        header.roadCount < 0 || header.nameBytes < 0) {
+        return false;
+    }
+
+    size_t n = header.cityCount;
+    size_t m = header.roadCount;
+    qint64 expected = static_cast<qint64>(sizeof(header) + n * 2 * sizeof(qint32) + (n + 1) * sizeof(qint64) +
+                                          m * 2 * sizeof(qint32) + m * sizeof(double)) + header.nameBytes;
+    if (expected != file.length()) return false;
+
+    const char* p = file.begin() + sizeof(header);
+    auto section = [&p](size_t bytes) {
+        const char* start = p;
+        p += bytes;
+        return start;
+    };
+    const char* xs = section(n * sizeof(qint32));
+    const char* ys = section(n * sizeof(qint32));
+    const char* nameOffsets = section((n + 1) * sizeof(qint64));
+    const char* names = section(header.nameBytes);
+    const char* froms = section(m * sizeof(qint32));
+    const char* tos = section(m * sizeof(qint32));
+    const char* lengths = section(m * sizeof(double));
+
+    std::vector<qint32> column(std::max(n, m));
+    std::vector<qint64> offsets(n + 1);
+    std::memcpy(offsets.data(), nameOffsets, offsets.size() * sizeof(qint64));
+    for (size_t i = 0; i < n; ++i) {
+        if (offsets[i] < 0 || offsets[i] > offsets[i + 1] || offsets[i + 1] > header.nameBytes) return false;
+    }
+
+    cities.resize(n);
+    std::memcpy(column.data(), xs, n * sizeof(qint32));
+    for (size_t i = 0; i < n; ++i) cities[i].x = column[i];
+    std::memcpy(column.data(), ys, n * sizeof(qint32));
+    for (size_t i = 0; i < n; ++i) {
+        cities[i].y = column[i];
+        cities[i].id = static_cast<int>(i);
+        cities[i].name.assign(names + offsets[i], names + offsets[i + 1]);
+    }
+
+    std::vector<double> weights(m);
+    std::memcpy(weights.data(), lengths, m * sizeof(double));
+    roads.resize(m);
+    std::memcpy(column.data(), froms, m * sizeof(qint32));
+    for (size_t i = 0; i < m; ++i) roads[i].source = column[i];
+    std::memcpy(column.data(), tos, m * sizeof(qint32));
+    size_t kept = 0;
+    for (size_t i = 0; i < m; ++i) {
+        Edge road = {roads[i].source, column[i], weights[i]};
+        if (road.source < 0 || road.dest < 0 || road.source >= header.cityCount || road.dest >= header.cityCount) {
+            report(problems, static_cast<int>(i), "to a city that does not exist", "road");
+            continue;
+        }
+        roads[kept++] = road;
+    }
+    roads.resize(kept);
+    return true;
+}
+
+bool CityLoader::writeBinary(const std::string& filename, const std::vector<City>& cities,
+                             const std::vector<Edge>& roads) {
+    QSaveFile file(QString::fromStdString(filename));
+    if (!file.open(QIODevice::WriteOnly)) return false;
+
+    size_t n = cities.size();
+    size_t m = roads.size();
+    std::vector<qint32> xs(n);
+    std::vector<qint32> ys(n);
+    std::vector<qint64> offsets(n + 1, 0);
+    std::string names;
+    for (size_t i = 0; i < n; ++i) {
+        xs[i] = cities[i].x;
+        ys[i] = cities[i].y;
+        names += cities[i].name;
+        offsets[i + 1] = static_cast<qint64>(names.size());
+    }
+    std::vector<qint32> froms(m);
+    std::vector<qint32> tos(m);
+    std::vector<double> lengths(m);
+    for (size_t i = 0; i < m; ++i) {
+        froms[i] = roads[i].source;
+        tos[i] = roads[i].dest;
+        lengths[i] = roads[i].weight;
+    }
+
+    BinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.magic = BinaryMagic;
+    header.version = BinaryVersion;
+    header.cityCount = static_cast<qint32>(n);
+    header.roadCount = static_cast<qint32>(m);
+    header.nameBytes = static_cast<qint64>(names.size());
+
+    auto write = [&file](const void* data, size_t bytes) {
+        return file.write(static_cast<const char*>(data), static_cast<qint64>(bytes)) == static_cast<qint64>(bytes);
+    };
+    if (!write(&header, sizeof(header)) || !write(xs.data(), n * sizeof(qint32)) ||
+        !write(ys.data(), n * sizeof(qint32)) || !write(offsets.data(), offsets.size() * sizeof(qint64)) ||
+        !write(names.data(), names.size()) || !write(froms.data(), m * sizeof(qint32)) ||
+        !write(tos.data(), m * sizeof(qint32)) || !write(lengths.data(), m * sizeof(double))) {
+        return false;
+    }
+    return file.commit();
+}
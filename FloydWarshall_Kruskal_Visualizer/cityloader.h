@@ -0,0 +1,40 @@
+#ifndef CITYLOADER_H
+#define CITYLOADER_H
+
+#include <string>
+#include <vector>
+#include "graph.h"
+
+// Readers and writers for instance files. Files are memory-mapped and
+// parsed in place with hand-rolled number parsing. A reader returns false
+// only if the file cannot be read as that format at all; lines it has to
+// skip are described (with their line numbers) in problems.
+class CityLoader {
+public:
+    // Picks a reader by extension: .tsp for TSPLIB, .fwb for the binary
+    // form, anything else as text.
+    static bool read(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                     std::vector<std::string>& problems);
+
+    // The data.txt format: "name x y" per city up to "EndCities", then
+    // "from to length" per road, cities numbered from 0 in file order.
+    static bool readText(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                         std::vector<std::string>& problems);
+
+    // TSPLIB .tsp files. EUC_2D (and CEIL_2D) instances give cities without
+    // roads, so the tree and tour use straight lines. EXPLICIT instances
+    // give a road between every pair, from any of the FULL_MATRIX, *_ROW or
+    // *_COL layouts; cities are placed by DISPLAY_DATA_SECTION when there is
+    // one and on a circle otherwise. Coordinates are rounded to integers.
+    static bool readTsplib(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                           std::vector<std::string>& problems);
+
+    // The binary form: a header, then every city field and road field as
+    // one contiguous column, so each is a single copy out of the mapping.
+    static bool readBinary(const std::string& filename, std::vector<City>& cities, std::vector<Edge>& roads,
+                           std::vector<std::string>& problems);
+    static bool writeBinary(const std::string& filename, const std::vector<City>& cities,
+                            const std::vector<Edge>& roads);
+};
+
+#endif
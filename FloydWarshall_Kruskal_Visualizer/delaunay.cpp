@@ -0,0 +1,377 @@
+#include "delaunay.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+const double Infinity = std::numeric_limits<double>::infinity();
+
+// True if r lies to the right of the line from p to q.
+bool orient(double px, double py, double qx, double qy, double rx, double ry) {
+    return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0;
+}
+
+// True if p lies inside the circumcircle of a, b, c.
+bool inCircle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py) {
+    double dx = ax - px;
+    double dy = ay - py;
+    double ex = bx - px;
+    double ey = by - py;
+    double fx = cx - px;
+    double fy = cy - py;
+    double ap = dx * dx + dy * dy;
+    double bp = ex * ex + ey * ey;
+    double cp = fx * fx + fy * fy;
+    return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0;
+}
+
+// Squared circumradius of a, b, c, and its centre.
+double circumradius(double ax, double ay, double bx, double by, double cx, double cy) {
+    double dx = bx - ax;
+    double dy = by - ay;
+    double ex = cx - ax;
+    double ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = 0.5 / (dx * ey - dy * ex);
+    double x = (ey * bl - dy * cl) * d;
+    double y = (dx * cl - ex * bl) * d;
+    double r = x * x + y * y;
+    return std::isfinite(r) ? r : Infinity;
+}
+
+void circumcenter(double ax, double ay, double bx, double by, double cx, double cy, double& ox, double& oy) {
+    double dx = bx - ax;
+    double dy = by - ay;
+    double ex = cx - ax;
+    double ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = 0.5 / (dx * ey - dy * ex);
+    ox = ax + (ey * bl - dy * cl) * d;
+    oy = ay + (dx * cl - ex * bl) * d;
+}
+
+// Monotone in the angle of (dx, dy), in [0, 1].
+double pseudoAngle(double dx, double dy) {
+    double p = dx / (std::abs(dx) + std::abs(dy));
+    return (dy > 0 ? 3 - p : 1 + p) / 4;
+}
+
+// Triangles as index triples; halfedge h is the edge from triangles[h] to
+// the next corner of its triangle, and opposite[h] is the same edge in the
+// neighbouring triangle, -1 on the hull.
+class Triangulation {
+public:
+    Triangulation(const std::vector<double>& x, const std::vector<double>& y) : x(x), y(y) {}
+
+    std::vector<Arc> edges();
+
+private:
+    const std::vector<double>& x;
+    const std::vector<double>& y;
+    std::vector<int> triangles;
+    std::vector<int> opposite;
+    std::vector<int> hullPrev;
+    std::vector<int> hullNext;
+    std::vector<int> hullTri;
+    std::vector<int> hullHash;
+    std::vector<int> edgeStack;
+    int hullStart;
+    double cx;
+    double cy;
+    // Points left out because they round onto one already in, each with an
+    // edge to the previously inserted point.
+    std::vector<Arc> skipped;
+
+    double length(int a, int b) const { return std::hypot(x[a] - x[b], y[a] - y[b]); }
+    int hashKey(double px, double py) const {
+        int size = static_cast<int>(hullHash.size());
+        return static_cast<int>(std::floor(pseudoAngle(px - cx, py - cy) * size)) % size;
+    }
+    void link(int a, int b) {
+        opposite[a] = b;
+        if (b >= 0) opposite[b] = a;
+    }
+    int addTriangle(int i0, int i1, int i2, int a, int b, int c);
+    int legalize(int a);
+    bool triangulate();
+    std::vector<Arc> collinearEdges() const;
+};
+
+int Triangulation::addTriangle(int i0, int i1, int i2, int a, int b, int c) {
+    int t = static_cast<int>(triangles.size());
+    triangles.push_back(i0);
+    triangles.push_back(i1);
+    triangles.push_back(i2);
+    opposite.resize(t + 3, -1);
+    link(t, a);
+    link(t + 1, b);
+    link(t + 2, c);
+    return t;
+}
+
+// Flips the edge a and, through a stack, every edge a flip exposes, until
+// all of them are locally Delaunay. Returns the halfedge that ends up where
+// a's predecessor was, for the caller's hull bookkeeping.
+int Triangulation::legalize(int a) {
+    edgeStack.clear();
+    int ar = 0;
+    while (true) {
+        int b = opposite[a];
+        int a0 = a - a % 3;
+        ar = a0 + (a + 2) % 3;
+        if (b < 0) {
+            if (edgeStack.empty()) break;
+            a = edgeStack.back();
+            edgeStack.pop_back();
+            continue;
+        }
+
+        int b0 = b - b % 3;
+        int al = a0 + (a + 1) % 3;
+        int bl = b0 + (b + 2) % 3;
+        int p0 = triangles[ar];
+        int pr = triangles[a];
+        int pl = triangles[al];
+        int p1 = triangles[bl];
+        if (inCircle(x[p0], y[p0], x[pr], y[pr], x[pl], y[pl], x[p1], y[p1])) {
+            triangles[a] = p1;
+            triangles[b] = p0;
+            int hbl = opposite[bl];
+            // The flip moved a hull edge; point the hull at its new halfedge.
+            if (hbl < 0) {
+                int e = hullStart;
+                do {
+                    if (hullTri[e] == bl) {
+                        hullTri[e] = a;
+                        break;
+                    }
+                    e = hullPrev[e];
+                } while (e != hullStart);
+            }
+            link(a, hbl);
+            link(b, opposite[ar]);
+            link(ar, bl);
+            edgeStack.push_back(b0 + (b + 1) % 3);
+        } else {
+            if (edgeStack.empty()) break;
+            a = edgeStack.back();
+            edgeStack.pop_back();
+        }
+    }
+    return ar;
+}
+
+// False when every point is on one line and there is no triangle.
+bool Triangulation::triangulate() {
+    int n = static_cast<int>(x.size());
+    double minX = *std::min_element(x.begin(), x.end());
+    double maxX = *std::max_element(x.begin(), x.end());
+    double minY = *std::min_element(y.begin(), y.end());
+    double maxY = *std::max_element(y.begin(), y.end());
+    double midX = (minX + maxX) / 2;
+    double midY = (minY + maxY) / 2;
+
+    // Seed triangle: the point nearest the middle, its nearest neighbour,
+    // and the point making the smallest circumcircle with them.
+    int i0 = 0;
+    double best = Infinity;
+    for (int i = 0; i < n; ++i) {
+        double d = (x[i] - midX) * (x[i] - midX) + (y[i] - midY) * (y[i] - midY);
+        if (d < best) {
+            i0 = i;
+            best = d;
+        }
+    }
+    int i1 = -1;
+    best = Infinity;
+    for (int i = 0; i < n; ++i) {
+        double d = (x[i] - x[i0]) * (x[i] - x[i0]) + (y[i] - y[i0]) * (y[i] - y[i0]);
+        if (i != i0 && d > 0 && d < best) {
+            i1 = i;
+            best = d;
+        }
+    }
+    if (i1 < 0) return false;
+    int i2 = -1;
+    best = Infinity;
+    for (int i = 0; i < n; ++i) {
+        if (i == i0 || i == i1) continue;
+        double r = circumradius(x[i0], y[i0], x[i1], y[i1], x[i], y[i]);
+        if (r < best) {
+            i2 = i;
+            best = r;
+        }
+    }
+    if (i2 < 0) return false;
+    if (orient(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2])) std::swap(i1, i2);
+
+    circumcenter(x[i0], y[i0], x[i1], y[i1], x[i2], y[i2], cx, cy);
+    std::vector<double> dist(n);
+    for (int i = 0; i < n; ++i) dist[i] = (x[i] - cx) * (x[i] - cx) + (y[i] - cy) * (y[i] - cy);
+    std::vector<int> ids(n);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(), [&dist](int a, int b) { return dist[a] < dist[b]; });
+
+    hullPrev.assign(n, 0);
+    hullNext.assign(n, 0);
+    hullTri.assign(n, 0);
+    hullHash.assign(static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n)))), -1);
+    hullStart = i0;
+    hullNext[i0] = hullPrev[i2] = i1;
+    hullNext[i1] = hullPrev[i0] = i2;
+    hullNext[i2] = hullPrev[i1] = i0;
+    hullTri[i0] = 0;
+    hullTri[i1] = 1;
+    hullTri[i2] = 2;
+    hullHash[hashKey(x[i0], y[i0])] = i0;
+    hullHash[hashKey(x[i1], y[i1])] = i1;
+    hullHash[hashKey(x[i2], y[i2])] = i2;
+
+    int maxTriangles = std::max(2 * n - 5, 1);
+    triangles.reserve(3 * maxTriangles);
+    opposite.reserve(3 * maxTriangles);
+    addTriangle(i0, i1, i2, -1, -1, -1);
+
+    int previous = i0;
+    for (int k = 0; k < n; ++k) {
+        int i = ids[k];
+        double px = x[i];
+        double py = y[i];
+        if (i == i0 || i == i1 || i == i2) {
+            previous = i;
+            continue;
+        }
+
+        // A hull point near the new point's angle, then the first hull edge
+        // from there that the point sees.
+        int start = 0;
+        int key = hashKey(px, py);
+        for (size_t j = 0; j < hullHash.size(); ++j) {
+            start = hullHash[(key + j) % hullHash.size()];
+            if (start >= 0 && start != hullNext[start]) break;
+        }
+        start = hullPrev[start];
+        int e = start;
+        int q = hullNext[e];
+        while (!orient(px, py, x[e], y[e], x[q], y[q])) {
+            e = q;
+            if (e == start) {
+                e = -1;
+                break;
+            }
+            q = hullNext[e];
+        }
+        // Sees no edge: within rounding of a point already in.
+        if (e < 0) {
+            skipped.push_back({i, previous, length(i, previous)});
+            continue;
+        }
+        previous = i;
+
+        int t = addTriangle(e, i, hullNext[e], -1, -1, hullTri[e]);
+        hullTri[i] = legalize(t + 2);
+        hullTri[e] = t;
+
+        // Fan forward along the hull while the point still sees the edges.
+        int m = hullNext[e];
+        q = hullNext[m];
+        while (orient(px, py, x[m], y[m], x[q], y[q])) {
+            t = addTriangle(m, i, q, hullTri[i], -1, hullTri[m]);
+            hullTri[i] = legalize(t + 2);
+            hullNext[m] = m; // removed from the hull
+            m = q;
+            q = hullNext[m];
+        }
+        // And backward.
+        if (e == start) {
+            q = hullPrev[e];
+            while (orient(px, py, x[q], y[q], x[e], y[e])) {
+                t = addTriangle(q, i, e, -1, hullTri[e], hullTri[q]);
+                legalize(t + 2);
+                hullTri[q] = t;
+                hullNext[e] = e;
+                e = q;
+                q = hullPrev[e];
+            }
+        }
+
+        hullStart = hullPrev[i] = e;
+        hullNext[e] = hullPrev[m] = i;
+        hullNext[i] = m;
+        hullHash[hashKey(px, py)] = i;
+        hullHash[hashKey(x[e], y[e])] = e;
+    }
+    return true;
+}
+
+// Neighbours in order along the line.
+std::vector<Arc> Triangulation::collinearEdges() const {
+    int n = static_cast<int>(x.size());
+    int far = 0;
+    for (int i = 1; i < n; ++i) {
+        if (length(0, i) > length(0, far)) far = i;
+    }
+    double dx = x[far] - x[0];
+    double dy = y[far] - y[0];
+    std::vector<double> along(n);
+    for (int i = 0; i < n; ++i) along[i] = (x[i] - x[0]) * dx + (y[i] - y[0]) * dy;
+    std::vector<int> ids(n);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(), [&along](int a, int b) { return along[a] < along[b]; });
+
+    std::vector<Arc> result;
+    for (int k = 1; k < n; ++k) result.push_back({ids[k - 1], ids[k], length(ids[k - 1], ids[k])});
+    return result;
+}
+
+std::vector<Arc> Triangulation::edges() {
+    if (x.size() < 2) return std::vector<Arc>();
+    if (!triangulate()) return collinearEdges();
+
+    std::vector<Arc> result = skipped;
+    result.reserve(skipped.size() + triangles.size() / 2 + 1);
+    for (int h = 0; h < static_cast<int>(triangles.size()); ++h) {
+        // Interior edges appear twice; keep the copy with the larger index.
+        if (h < opposite[h]) continue;
+        int a = triangles[h];
+        int b = triangles[h % 3 == 2 ? h - 2 : h + 1];
+        result.push_back({a, b, length(a, b)});
+    }
+    return result;
+}
+
+}
+
+std::vector<Arc> delaunayEdges(const std::vector<double>& x, const std::vector<double>& y) {
+    // Triangulate distinct positions only; every repeat gets a zero edge to
+    // the first point at its position.
+    int n = static_cast<int>(x.size());
+    std::vector<int> ids(n);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::sort(ids.begin(), ids.end(), [&](int a, int b) { return x[a] < x[b] || (x[a] == x[b] && y[a] < y[b]); });
+
+    std::vector<Arc> result;
+    std::vector<int> distinct;
+    std::vector<double> ux;
+    std::vector<double> uy;
+    for (int k = 0; k < n; ++k) {
+        int i = ids[k];
+        if (k > 0 && x[i] == ux.back() && y[i] == uy.back()) {
+            result.push_back({distinct.back(), i, 0});
+            continue;
+        }
+        distinct.push_back(i);
+        ux.push_back(x[i]);
+        uy.push_back(y[i]);
+    }
+
+    Triangulation triangulation(ux, uy);
+    for (const Arc& edge : triangulation.edges()) {
+        result.push_back({distinct[edge.from], distinct[edge.to], edge.weight});
+    }
+    return result;
+}
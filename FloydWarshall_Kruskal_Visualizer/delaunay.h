@@ -0,0 +1,22 @@
+#ifndef DELAUNAY_H
+#define DELAUNAY_H
+
+#include <vector>
+#include "sparsegraph.h"
+
+// Edges of the Delaunay triangulation of the points (x[i], y[i]), each
+// once, weighted by Euclidean length. There are at most 3n of them and the
+// Euclidean minimum spanning tree is a subset.
+//
+// Sweep-hull construction: points are inserted in order of distance from
+// the centre of a seed triangle, each one is joined to the convex hull
+// edges it sees (found through a hash of hull points by angle), and new
+// triangles are flipped until they are locally Delaunay. O(n log n) in
+// practice.
+//
+// Points at the same position are triangulated once, and the others get a
+// zero-length edge to that one, so the result still connects every point.
+// All points on one line give the path along that line.
+std::vector<Arc> delaunayEdges(const std::vector<double>& x, const std::vector<double>& y);
+
+#endif
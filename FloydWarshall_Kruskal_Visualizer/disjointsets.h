@@ -0,0 +1,44 @@
+#ifndef DISJOINTSETS_H
+#define DISJOINTSETS_H
+
+#include <vector>
+#include <utility>
+
+// Union-find with union by rank and path halving: every node visited by
+// find() is pointed at its grandparent, so paths shrink without recursion
+// or a second pass.
+class DisjointSets {
+public:
+    explicit DisjointSets(int size = 0) { reset(size); }
+
+    void reset(int size) {
+        parent.resize(size);
+        rank.assign(size, 0);
+        for (int i = 0; i < size; ++i) parent[i] = i;
+    }
+
+    int find(int i) {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    // False if x and y were already in the same set.
+    bool unite(int x, int y) {
+        x = find(x);
+        y = find(y);
+        if (x == y) return false;
+        if (rank[x] < rank[y]) std::swap(x, y);
+        parent[y] = x;
+        if (rank[x] == rank[y]) ++rank[x];
+        return true;
+    }
+
+private:
+    std::vector<int> parent;
+    std::vector<unsigned char> rank;
+};
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef DISTANCEMATRIX_H
+#define DISTANCEMATRIX_H
+
+#include "matrix.h"
+
+// The full-precision matrix; see Matrix for the float and int32 forms.
+typedef Matrix<double> DistanceMatrix;
+
+#endif
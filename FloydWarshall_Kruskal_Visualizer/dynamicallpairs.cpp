@@ -0,0 +1,184 @@
+#include "dynamicallpairs.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <thread>
+
+namespace {
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&](int thread) {
+        for (int i = next++; i < count; i = next++) fn(i, thread);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < std::min(threadCount, count); ++t) threads.emplace_back(worker, t);
+    worker(0);
+    for (auto& t : threads) t.join();
+}
+
+int resolveThreads(int threadCount) {
+    return threadCount > 0 ? threadCount : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+const double Infinity = std::numeric_limits<double>::infinity();
+
+enum Mark : char { Unknown = 0, Cut = 1, Kept = 2, Walking = 3 };
+
+struct Workspace {
+    std::vector<char> mark;
+    std::vector<int> chain;
+    std::vector<int> cut;
+    std::vector<double> tentative;
+    std::vector<int> hop;
+    std::vector<std::pair<double, int>> heap;
+};
+
+// Repairs column j. A city is cut if following next hops towards j takes
+// the road u-v in either direction, or never gets to j because the hops
+// run in a circle.
+template <typename T>
+void repairTarget(Matrix<T>& dist, NextHopMatrix& next, const SparseGraph& graph, int u, int v, int j,
+                  Workspace& space) {
+    int n = dist.size();
+    double scale = dist.scale();
+    T unreachable = Matrix<T>::infinity();
+    space.mark.assign(n, Unknown);
+    space.mark[j] = Kept;
+    space.cut.clear();
+    for (int i = 0; i < n; ++i) {
+        // Walk until a city whose mark is known, then mark the whole walk.
+        space.chain.clear();
+        int c = i;
+        while (space.mark[c] == Unknown) {
+            int h = next.get(c, j);
+            if (h < 0) {
+                space.mark[c] = Kept;
+                break;
+            }
+            if ((c == u && h == v) || (c == v && h == u)) {
+                space.mark[c] = Cut;
+                space.cut.push_back(c);
+                break;
+            }
+            space.mark[c] = Walking;
+            space.chain.push_back(c);
+            c = h;
+        }
+        char result = space.mark[c] == Walking ? static_cast<char>(Cut) : space.mark[c];
+        for (int w : space.chain) {
+            space.mark[w] = result;
+            if (result == Cut) space.cut.push_back(w);
+        }
+    }
+
+    // Cut cities start from their best road into the kept part of the tree.
+    std::greater<std::pair<double, int>> after;
+    space.heap.clear();
+    for (int a : space.cut) {
+        double best = Infinity;
+        int hop = -1;
+        for (int i = graph.offset[a]; i < graph.offset[a + 1]; ++i) {
+            int b = graph.target[i];
+            if (space.mark[b] != Kept || dist[b][j] >= unreachable) continue;
+            double d = graph.weight[i] * scale + dist[b][j];
+            if (d < best) {
+                best = d;
+                hop = b;
+            }
+        }
+        space.tentative[a] = best;
+        space.hop[a] = hop;
+        if (hop >= 0) space.heap.push_back({best, a});
+    }
+    std::make_heap(space.heap.begin(), space.heap.end(), after);
+
+    while (!space.heap.empty()) {
+        std::pop_heap(space.heap.begin(), space.heap.end(), after);
+        std::pair<double, int> top = space.heap.back();
+        space.heap.pop_back();
+        int a = top.second;
+        if (top.first > space.tentative[a]) continue;
+        for (int i = graph.offset[a]; i < graph.offset[a + 1]; ++i) {
+            int c = graph.target[i];
+            if (space.mark[c] != Cut) continue;
+            double d = top.first + graph.weight[i] * scale;
+            if (d < space.tentative[c]) {
+                space.tentative[c] = d;
+                space.hop[c] = a;
+                space.heap.push_back({d, c});
+                std::push_heap(space.heap.begin(), space.heap.end(), after);
+            }
+        }
+    }
+
+    for (int a : space.cut) {
+        bool reached = space.hop[a] >= 0 && space.tentative[a] < unreachable;
+        dist[a][j] = reached ? MatrixTraits<T>::convert(space.tentative[a]) : unreachable;
+        next.set(a, j, reached ? space.hop[a] : -1);
+    }
+}
+
+}
+
+template <typename T>
+void lowerRoad(Matrix<T>& dist, NextHopMatrix& next, int u, int v, double w, int threadCount) {
+    int n = dist.size();
+    double unreachable = Matrix<T>::infinity();
+    // Rows and columns of u and v as they were; a shortest path uses the
+    // road at most once, so these are the values every pair needs.
+    std::vector<double> toU(n), toV(n), fromU(dist[u], dist[u] + n), fromV(dist[v], dist[v] + n);
+    std::vector<int> hopU(n), hopV(n);
+    for (int i = 0; i < n; ++i) {
+        toU[i] = dist[i][u];
+        toV[i] = dist[i][v];
+        hopU[i] = i == u ? v : next.get(i, u);
+        hopV[i] = i == v ? u : next.get(i, v);
+    }
+
+    parallelFor(n, resolveThreads(threadCount), [&](int i, int) {
+        double iu = toU[i] + w;
+        double iv = toV[i] + w;
+        if (iu >= unreachable && iv >= unreachable) return;
+        T* row = dist[i];
+        for (int j = 0; j < n; ++j) {
+            double viaU = iu + fromV[j];
+            double viaV = iv + fromU[j];
+            if (viaU < row[j] && viaU <= viaV) {
+                row[j] = MatrixTraits<T>::convert(viaU);
+                next.set(i, j, hopU[i]);
+            } else if (viaV < row[j]) {
+                row[j] = MatrixTraits<T>::convert(viaV);
+                next.set(i, j, hopV[i]);
+            }
+        }
+    });
+}
+
+template <typename T>
+void raiseRoad(Matrix<T>& dist, NextHopMatrix& next, const SparseGraph& graph, int u, int v, int threadCount) {
+    int n = dist.size();
+    std::vector<int> targets;
+    for (int j = 0; j < n; ++j) {
+        if (next.get(u, j) == v || next.get(v, j) == u) targets.push_back(j);
+    }
+
+    threadCount = std::min(resolveThreads(threadCount), std::max(1, static_cast<int>(targets.size())));
+    std::vector<Workspace> spaces(threadCount);
+    for (Workspace& space : spaces) {
+        space.tentative.resize(n);
+        space.hop.resize(n);
+    }
+    parallelFor(static_cast<int>(targets.size()), threadCount, [&](int t, int thread) {
+        repairTarget(dist, next, graph, u, v, targets[t], spaces[thread]);
+    });
+}
+
+template void lowerRoad(Matrix<double>&, NextHopMatrix&, int, int, double, int);
+template void lowerRoad(Matrix<float>&, NextHopMatrix&, int, int, double, int);
+template void lowerRoad(Matrix<int32_t>&, NextHopMatrix&, int, int, double, int);
+template void raiseRoad(Matrix<double>&, NextHopMatrix&, const SparseGraph&, int, int, int);
+template void raiseRoad(Matrix<float>&, NextHopMatrix&, const SparseGraph&, int, int, int);
+template void raiseRoad(Matrix<int32_t>&, NextHopMatrix&, const SparseGraph&, int, int, int);
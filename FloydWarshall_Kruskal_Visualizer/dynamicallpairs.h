@@ -0,0 +1,31 @@
+#ifndef DYNAMICALLPAIRS_H
+#define DYNAMICALLPAIRS_H
+
+#include "distancematrix.h"
+#include "nexthopmatrix.h"
+#include "sparsegraph.h"
+
+// Repairs of solved all-pairs tables (dist and next as left by
+// floydWarshall() or dijkstraAllPairs()) after one undirected road changes,
+// instead of solving again. Weights are in the matrix's scaled units, and
+// entries at or above Matrix<T>::infinity() mean no path and are written
+// back as exactly that value. Weights must be non-negative.
+// Rows (lowerRoad) or target columns (raiseRoad) are independent and are
+// spread over threadCount threads.
+
+// The road between u and v got shorter or was added, with length w. Every
+// pair either keeps its path or now goes i -> u -> v -> j (or via v -> u):
+// one O(n^2) pass.
+template <typename T>
+void lowerRoad(Matrix<T>& dist, NextHopMatrix& next, int u, int v, double w, int threadCount = 0);
+
+// The road between u and v got longer or was removed; graph is the road
+// network after the change, unscaled, and must be symmetric. For every target j whose
+// shortest path tree used the road, the cities whose path to j crossed it
+// are cut off and rejoined by a Dijkstra over those cities only, starting
+// from their roads into the rest of the tree. Other pairs are untouched.
+template <typename T>
+void raiseRoad(Matrix<T>& dist, NextHopMatrix& next, const SparseGraph& graph, int u, int v,
+               int threadCount = 0);
+
+#endif
@@ -0,0 +1,391 @@
+#include "floydwarshall.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FLOYD_SSE2
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define FLOYD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLOYD_SSE2
+#endif
+
+namespace {
+
+// 64 x 64 doubles is 32 KB, so the three tiles of an update stay in L2;
+// narrower entries only leave more room.
+const int TileSize = 64;
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < std::min(threadCount, count); ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+// The vector operations the kernels need for one entry type: Width entries
+// per register, and less() giving one mask bit per entry where a < b. The
+// generic version is plain scalar code.
+template <typename T>
+struct Lanes {
+    typedef T Vector;
+    static const int Width = 1;
+    static Vector load(const T* p) { return *p; }
+    static void store(T* p, Vector v) { *p = v; }
+    static Vector broadcast(T v) { return v; }
+    static Vector add(Vector a, Vector b) { return a + b; }
+    static Vector min(Vector a, Vector b) { return b < a ? b : a; }
+    static unsigned less(Vector a, Vector b) { return a < b; }
+};
+
+#if defined(__AVX__)
+template <>
+struct Lanes<double> {
+    typedef __m256d Vector;
+    static const int Width = 4;
+    static Vector load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Vector v) { _mm256_storeu_pd(p, v); }
+    static Vector broadcast(double v) { return _mm256_set1_pd(v); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm256_min_pd(a, b); }
+    static unsigned less(Vector a, Vector b) { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)); }
+};
+
+template <>
+struct Lanes<float> {
+    typedef __m256 Vector;
+    static const int Width = 8;
+    static Vector load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, Vector v) { _mm256_storeu_ps(p, v); }
+    static Vector broadcast(float v) { return _mm256_set1_ps(v); }
+    static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    static unsigned less(Vector a, Vector b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+};
+#elif defined(FLOYD_SSE2)
+template <>
+struct Lanes<double> {
+    typedef __m128d Vector;
+    static const int Width = 2;
+    static Vector load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, Vector v) { _mm_storeu_pd(p, v); }
+    static Vector broadcast(double v) { return _mm_set1_pd(v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_pd(a, b); }
+    static unsigned less(Vector a, Vector b) { return _mm_movemask_pd(_mm_cmplt_pd(a, b)); }
+};
+
+template <>
+struct Lanes<float> {
+    typedef __m128 Vector;
+    static const int Width = 4;
+    static Vector load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, Vector v) { _mm_storeu_ps(p, v); }
+    static Vector broadcast(float v) { return _mm_set1_ps(v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+    static Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+    static unsigned less(Vector a, Vector b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+};
+#endif
+
+#if defined(FLOYD_SSE2)
+// 128 bits wide even with AVX, which has no 256-bit integer arithmetic.
+template <>
+struct Lanes<int32_t> {
+    typedef __m128i Vector;
+    static const int Width = 4;
+    static Vector load(const int32_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(int32_t* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    static Vector broadcast(int32_t v) { return _mm_set1_epi32(v); }
+    static Vector add(Vector a, Vector b) { return _mm_add_epi32(a, b); }
+    static Vector min(Vector a, Vector b) {
+#if defined(__AVX__) || defined(__SSE4_1__)
+        return _mm_min_epi32(a, b);
+#else
+        __m128i greater = _mm_cmpgt_epi32(a, b);
+        return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+#endif
+    }
+    static unsigned less(Vector a, Vector b) { return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(a, b))); }
+};
+#endif
+
+// c[j] = min(c[j], a + b[j]) for j < count. With Track, every improved
+// entry also gets hops[j] = hop; improvements are rare after the first few
+// k, so the vector loops only test a movemask and fall back to scalar
+// stores when it is set.
+template <bool Track, typename T, typename H>
+inline void relaxRow(T* c, const T* b, T a, int count, H* hops, H hop) {
+    typedef Lanes<T> L;
+    int j = 0;
+    if (L::Width > 1) {
+        typename L::Vector va = L::broadcast(a);
+        for (; j + L::Width <= count; j += L::Width) {
+            typename L::Vector sum = L::add(va, L::load(b + j));
+            typename L::Vector cj = L::load(c + j);
+            if (Track) {
+                for (unsigned mask = L::less(sum, cj), l = 0; mask; ++l, mask >>= 1) {
+                    if (mask & 1) hops[j + l] = hop;
+                }
+            }
+            L::store(c + j, L::min(cj, sum));
+        }
+    }
+    for (; j < count; ++j) {
+        T sum = a + b[j];
+        if (Track && sum < c[j]) hops[j] = hop;
+        c[j] = sum < c[j] ? sum : c[j];
+    }
+}
+
+// Tile update c = min(c, a (x) b) over `depth` intermediate nodes, where c
+// may be the same tile as a or b. Keeping k outermost means row k and
+// column k are read after step k - 1 and before they could change, exactly
+// as in the unblocked algorithm. hc and ha are the hop tiles matching c and
+// a: a path through k leaves i the way the path to k does.
+template <bool Track, typename T, typename H>
+void updateDependent(T* c, const T* a, const T* b, H* hc, const H* ha, int rows, int cols, int depth, int stride,
+                     int hopStride) {
+    for (int k = 0; k < depth; ++k) {
+        const T* bk = b + static_cast<size_t>(k) * stride;
+        for (int i = 0; i < rows; ++i) {
+            size_t row = static_cast<size_t>(i) * stride;
+            size_t hopRow = static_cast<size_t>(i) * hopStride;
+            relaxRow<Track>(c + row, bk, a[row + k], cols, Track ? hc + hopRow : hc, Track ? ha[hopRow + k] : H());
+        }
+    }
+}
+
+// Same update for a tile that a and b do not overlap. Four registers of a
+// row of c are kept while all of k is folded into them, so c is read and
+// written once per tile instead of once per k. Tracking hops adds one
+// combined mask test per k for those columns.
+template <bool Track, typename T, typename H>
+void updateIndependent(T* c, const T* a, const T* b, H* hc, const H* ha, int rows, int cols, int depth, int stride,
+                       int hopStride) {
+    typedef Lanes<T> L;
+    const int W = L::Width;
+    for (int i = 0; i < rows; ++i) {
+        size_t row = static_cast<size_t>(i) * stride;
+        size_t hopRow = static_cast<size_t>(i) * hopStride;
+        T* ci = c + row;
+        const T* ai = a + row;
+        H* hi = Track ? hc + hopRow : hc;
+        int j = 0;
+        for (; W > 1 && j + 4 * W <= cols; j += 4 * W) {
+            typename L::Vector c0 = L::load(ci + j);
+            typename L::Vector c1 = L::load(ci + j + W);
+            typename L::Vector c2 = L::load(ci + j + 2 * W);
+            typename L::Vector c3 = L::load(ci + j + 3 * W);
+            for (int k = 0; k < depth; ++k) {
+                const T* bk = b + static_cast<size_t>(k) * stride + j;
+                typename L::Vector va = L::broadcast(ai[k]);
+                typename L::Vector s0 = L::add(va, L::load(bk));
+                typename L::Vector s1 = L::add(va, L::load(bk + W));
+                typename L::Vector s2 = L::add(va, L::load(bk + 2 * W));
+                typename L::Vector s3 = L::add(va, L::load(bk + 3 * W));
+                if (Track) {
+                    unsigned mask = L::less(s0, c0) | L::less(s1, c1) << W | L::less(s2, c2) << 2 * W
+                                    | L::less(s3, c3) << 3 * W;
+                    for (int l = 0; mask; ++l, mask >>= 1) {
+                        if (mask & 1) hi[j + l] = ha[hopRow + k];
+                    }
+                }
+                c0 = L::min(c0, s0);
+                c1 = L::min(c1, s1);
+                c2 = L::min(c2, s2);
+                c3 = L::min(c3, s3);
+            }
+            L::store(ci + j, c0);
+            L::store(ci + j + W, c1);
+            L::store(ci + j + 2 * W, c2);
+            L::store(ci + j + 3 * W, c3);
+        }
+        if (j < cols) {
+            for (int k = 0; k < depth; ++k) {
+                relaxRow<Track>(ci + j, b + static_cast<size_t>(k) * stride + j, ai[k], cols - j,
+                                Track ? hi + j : hi, Track ? ha[hopRow + k] : H());
+            }
+        }
+    }
+}
+
+template <bool Track, typename T, typename H>
+void solve(Matrix<T>& dist, H* hops, int threadCount) {
+    int n = dist.size();
+    if (n == 0) return;
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // Distance rows are padded; next hop rows are not.
+    int stride = dist.stride();
+    int hopStride = n;
+    T* d = dist.data();
+    int tiles = (n + TileSize - 1) / TileSize;
+    auto offset = [&](int ti, int tj) {
+        return static_cast<size_t>(ti) * TileSize * stride + static_cast<size_t>(tj) * TileSize;
+    };
+    auto hopTile = [&](int ti, int tj) {
+        return Track ? hops + static_cast<size_t>(ti) * TileSize * hopStride + static_cast<size_t>(tj) * TileSize
+                     : hops;
+    };
+    auto extent = [&](int t) { return std::min(TileSize, n - t * TileSize); };
+
+    for (int kt = 0; kt < tiles; ++kt) {
+        int depth = extent(kt);
+        T* diagonal = d + offset(kt, kt);
+        H* diagonalHops = hopTile(kt, kt);
+        updateDependent<Track>(diagonal, diagonal, diagonal, diagonalHops, diagonalHops, depth, depth, depth, stride,
+                               hopStride);
+
+        // Row kt first, then column kt, skipping the diagonal.
+        parallelFor(2 * tiles, threadCount, [&](int p) {
+            int t = p % tiles;
+            if (t == kt) return;
+            if (p < tiles) {
+                T* c = d + offset(kt, t);
+                updateDependent<Track>(c, diagonal, c, hopTile(kt, t), diagonalHops, depth, extent(t), depth, stride,
+                                       hopStride);
+            } else {
+                T* c = d + offset(t, kt);
+                H* hc = hopTile(t, kt);
+                updateDependent<Track>(c, c, diagonal, hc, hc, extent(t), depth, depth, stride, hopStride);
+            }
+        });
+
+        parallelFor(tiles * tiles, threadCount, [&](int p) {
+            int ti = p / tiles;
+            int tj = p % tiles;
+            if (ti == kt || tj == kt) return;
+            updateIndependent<Track>(d + offset(ti, tj), d + offset(ti, kt), d + offset(kt, tj), hopTile(ti, tj),
+                                     hopTile(ti, kt), extent(ti), extent(tj), depth, stride, hopStride);
+        });
+    }
+}
+
+enum Walk : char { Unvisited = 0, OnWalk = 1, Reaches = 2 };
+
+// True if following the hops towards j from every city that has one ends at
+// j. Each city is walked once; a walk that comes back to itself or runs into
+// a city without a hop means the column is broken.
+template <typename H>
+bool columnReaches(const H* hops, int n, int j) {
+    const H none = std::numeric_limits<H>::max();
+    std::vector<char> state(n, Unvisited);
+    std::vector<int> walk;
+    state[j] = Reaches;
+    for (int i = 0; i < n; ++i) {
+        if (state[i] != Unvisited || hops[static_cast<size_t>(i) * n + j] == none) continue;
+        walk.clear();
+        int c = i;
+        while (state[c] == Unvisited) {
+            H h = hops[static_cast<size_t>(c) * n + j];
+            if (h == none) return false;
+            state[c] = OnWalk;
+            walk.push_back(c);
+            c = h;
+        }
+        if (state[c] == OnWalk) return false;
+        for (int w : walk) state[w] = Reaches;
+    }
+    return true;
+}
+
+// New hops towards j from a shortest path tree over the input edges. With
+// the solved distances as potentials, edge i -> k costs w(i, k) + d(k, j) -
+// d(i, j): never negative, and zero along every shortest path. A dense
+// Dijkstra from j on those costs hands every city a parent that was settled
+// before it, so ties between paths cannot close a cycle.
+template <typename T, typename H>
+void rebuildColumn(const Matrix<T>& edges, const Matrix<T>& dist, H* hops, int j) {
+    int n = dist.size();
+    const T infinity = Matrix<T>::infinity();
+    const double unset = std::numeric_limits<double>::infinity();
+    std::vector<double> key(n, unset);
+    std::vector<char> done(n, 0);
+    for (int i = 0; i < n; ++i) hops[static_cast<size_t>(i) * n + j] = std::numeric_limits<H>::max();
+    hops[static_cast<size_t>(j) * n + j] = static_cast<H>(j);
+    key[j] = 0;
+    for (;;) {
+        int k = -1;
+        for (int i = 0; i < n; ++i) {
+            if (!done[i] && key[i] < unset && (k < 0 || key[i] < key[k])) k = i;
+        }
+        if (k < 0) break;
+        done[k] = 1;
+        double toJ = dist[k][j];
+        for (int i = 0; i < n; ++i) {
+            if (done[i] || edges[i][k] >= infinity || dist[i][j] >= infinity) continue;
+            double cost = std::max(0.0, static_cast<double>(edges[i][k]) + toJ - static_cast<double>(dist[i][j]));
+            if (key[k] + cost < key[i]) {
+                key[i] = key[k] + cost;
+                hops[static_cast<size_t>(i) * n + j] = static_cast<H>(k);
+            }
+        }
+    }
+}
+
+// Direct edges hop straight to their end; everything else has no path yet.
+//
+// The tiles relax pairs in another order than the plain triple loop, and
+// where shortest paths tie through edges of length 0 that order can leave
+// two cities hopping to each other. With every edge positive no cycle can
+// tie, so only inputs with an edge of 0 or less keep a copy of the edges,
+// check every column afterwards and rebuild the broken ones.
+template <typename T, typename H>
+void solveWithHops(Matrix<T>& dist, H* hops, int threadCount) {
+    int n = dist.size();
+    T infinity = Matrix<T>::infinity();
+    bool ties = false;
+    for (int i = 0; i < n; ++i) {
+        const T* row = dist[i];
+        H* hopRow = hops + static_cast<size_t>(i) * n;
+        for (int j = 0; j < n; ++j) {
+            if (row[j] < infinity) hopRow[j] = static_cast<H>(j);
+            if (i != j && row[j] <= 0) ties = true;
+        }
+    }
+    if (!ties) {
+        solve<true>(dist, hops, threadCount);
+        return;
+    }
+
+    Matrix<T> edges = dist;
+    solve<true>(dist, hops, threadCount);
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    parallelFor(n, threadCount, [&](int j) {
+        if (!columnReaches(hops, n, j)) rebuildColumn(edges, dist, hops, j);
+    });
+}
+
+}
+
+template <typename T>
+void floydWarshall(Matrix<T>& dist, int threadCount) {
+    solve<false, T, uint8_t>(dist, nullptr, threadCount);
+}
+
+template <typename T>
+void floydWarshall(Matrix<T>& dist, NextHopMatrix& next, int threadCount) {
+    next.reset(dist.size());
+    if (next.bytesPerEntry() == 1) solveWithHops(dist, next.data8(), threadCount);
+    else if (next.bytesPerEntry() == 2) solveWithHops(dist, next.data16(), threadCount);
+    else solveWithHops(dist, next.data32(), threadCount);
+}
+
+template void floydWarshall(Matrix<double>&, int);
+template void floydWarshall(Matrix<float>&, int);
+template void floydWarshall(Matrix<int32_t>&, int);
+template void floydWarshall(Matrix<double>&, NextHopMatrix&, int);
+template void floydWarshall(Matrix<float>&, NextHopMatrix&, int);
+template void floydWarshall(Matrix<int32_t>&, NextHopMatrix&, int);
@@ -0,0 +1,28 @@
+#ifndef FLOYDWARSHALL_H
+#define FLOYDWARSHALL_H
+
+#include "distancematrix.h"
+#include "nexthopmatrix.h"
+
+// All-pairs shortest paths in place, for double, float and int32 matrices.
+// Missing edges must be Matrix<T>::infinity(), which lets the inner loop be
+// a plain min(d[i][j], d[i][k] + d[k][j]) without a branch. Narrower entries
+// move half the memory per step, and floats also fill a SIMD register with
+// twice as many of them.
+//
+// The matrix is processed in square tiles that fit in cache. For every tile
+// k on the diagonal: the diagonal tile is solved first, then the tiles in
+// row k and column k, which only depend on it, then all remaining tiles,
+// which only depend on those. Tiles within the last two phases are
+// independent and are spread over threadCount threads (<= 0 uses every
+// available core).
+template <typename T>
+void floydWarshall(Matrix<T>& dist, int threadCount = 0);
+
+// Same, and fills next with the first hop of every shortest path so paths
+// can be walked afterwards in O(length). next is resized to match dist;
+// finite off-diagonal entries of dist on input are taken as edges.
+template <typename T>
+void floydWarshall(Matrix<T>& dist, NextHopMatrix& next, int threadCount = 0);
+
+#endif
@@ -1,119 +1,470 @@
 #include "Graph.h"
-#include <fstream>
+#include "floydwarshall.h"
+#include "allpairs.h"
+#include "cityloader.h"
+#include "dynamicallpairs.h"
+#include "disjointsets.h"
+#include "spanningtree.h"
+#include "delaunay.h"
+#include "tourimprove.h"
 #include <cmath>
 #include <algorithm>
 #include <iostream>
+#include <thread>
 
-Graph::Graph() : n(0), state(INITIAL_GRAPH) {}
+namespace {
 
-void Graph::loadFromFile(const std::string& filename) {
-    std::ifstream fin(filename);
-    if (!fin.is_open()) return;
-
-    cities.clear();
-    std::string tempName;
-    int tx, ty;
-    int idCounter = 0;
+// A road of the given length as an entry of m; 1e9 and above is no road.
+template <typename T>
+T toEntry(const Matrix<T>& m, double weight) {
+    return weight < 1e9 ? MatrixTraits<T>::convert(weight * m.scale()) : Matrix<T>::infinity();
+}
 
-    while (fin >> tempName && tempName != "EndCities") {
-        fin >> tx >> ty;
-        cities.push_back({tempName, tx, ty, idCounter++});
+template <typename T>
+void fillRoads(Matrix<T>& m, int n, const std::vector<Edge>& roads) {
+    m.assign(n, Matrix<T>::infinity());
+    for (int i = 0; i < n; ++i) m[i][i] = 0;
+    for (const Edge& road : roads) {
+        T w = std::min(m[road.source][road.dest], toEntry(m, road.weight));
+        m[road.source][road.dest] = w;
+        m[road.dest][road.source] = w;
     }
+}
+
+}
+
+Graph::Graph() : n(0), state(INITIAL_GRAPH), revision(0), threadCount(0), allPairsMode(AUTO_ALL_PAIRS),
+      mstEngine(AUTO_MST), matrixPrecision(AUTO_PRECISION), activePrecision(DOUBLE_PRECISION), memoryBudget(0),
+      euclideanTree(false), roadTree(false) {}
+
+void Graph::setThreadCount(int count) {
+    threadCount = count;
+}
+
+void Graph::setAllPairsMode(int mode) {
+    allPairsMode = mode;
+}
+
+void Graph::setMstEngine(int engine) {
+    mstEngine = engine;
+}
+
+void Graph::setMatrixPrecision(int precision) {
+    matrixPrecision = precision;
+}
+
+void Graph::setMemoryBudget(size_t bytes) {
+    memoryBudget = bytes;
+}
 
+int Graph::getMatrixPrecision() const {
+    return activePrecision;
+}
+
+bool Graph::loadFromFile(const std::string& filename) {
+    std::vector<City> parsedCities;
+    std::vector<Edge> parsedRoads;
+    if (!CityLoader::read(filename, parsedCities, parsedRoads, loadProblems)) return false;
+
+    cities.swap(parsedCities);
+    roads.swap(parsedRoads);
     n = cities.size();
-    adjMatrix.assign(n, std::vector<double>(n, 1e9));
-    for (int i = 0; i < n; ++i) adjMatrix[i][i] = 0;
+    clearMatrix();
+    nextHop.clear();
+    mstEdges.clear();
+    mstAdjList.clear();
+    tspPath.clear();
+    euclideanTree = false;
 
-    int u, v;
-    double w;
-    currentEdges.clear();
-    while (fin >> u >> v >> w) {
-        if (u < n && v < n) {
-            adjMatrix[u][v] = w;
-            adjMatrix[v][u] = w;
-            currentEdges.push_back({u, v, w});
+    buildNetwork();
+    currentEdges = roads;
+    state = INITIAL_GRAPH;
+    ++revision;
+    return true;
+}
+
+bool Graph::saveToBinary(const std::string& filename) const {
+    return CityLoader::writeBinary(filename, cities, roads);
+}
+
+void Graph::buildNetwork() {
+    std::vector<Arc> arcs;
+    arcs.reserve(2 * roads.size());
+    for (const Edge& road : roads) {
+        arcs.push_back({road.source, road.dest, road.weight});
+        arcs.push_back({road.dest, road.source, road.weight});
+    }
+    network.build(n, arcs);
+}
+
+template <typename Fn>
+void Graph::withMatrix(Fn fn) {
+    if (activePrecision == FLOAT_PRECISION) fn(floatMatrix);
+    else if (activePrecision == INT32_PRECISION) fn(intMatrix);
+    else fn(adjMatrix);
+}
+
+template <typename Fn>
+void Graph::withMatrix(Fn fn) const {
+    if (activePrecision == FLOAT_PRECISION) fn(floatMatrix);
+    else if (activePrecision == INT32_PRECISION) fn(intMatrix);
+    else fn(adjMatrix);
+}
+
+// Entry type and scale for the current roads; see MatrixPrecision.
+void Graph::choosePrecision(int& precision, double& scale) const {
+    // Smallest power of ten that turns every weight into an integer, 0 if
+    // none up to 10^6 does.
+    scale = 0;
+    for (double s = 1; s <= 1e6 && scale == 0; s *= 10) {
+        bool whole = true;
+        for (size_t i = 0; i < roads.size() && whole; ++i) {
+            double w = roads[i].weight * s;
+            whole = std::abs(w - std::round(w)) <= 1e-9 * std::max(1.0, std::abs(w));
         }
+        if (whole) scale = s;
     }
-    state = INITIAL_GRAPH;
+    bool integral = scale > 0;
+
+    double heaviest = 0;
+    double total = 0;
+    for (const Edge& road : roads) {
+        heaviest = std::max(heaviest, std::abs(road.weight));
+        total += std::abs(road.weight);
+    }
+    double longest = std::min(heaviest * std::max(0, n - 1), total);
+    bool negative = network.hasNegativeWeights();
+    bool floatExact = integral && longest * scale < 16777216.0;
+    bool intExact = integral && !negative && longest * scale < Matrix<int32_t>::infinity();
+
+    precision = matrixPrecision;
+    if (precision == AUTO_PRECISION) {
+        if (floatExact) precision = FLOAT_PRECISION;
+        else if (intExact) precision = INT32_PRECISION;
+        else precision = DOUBLE_PRECISION;
+        if (precision == DOUBLE_PRECISION && memoryBudget > 0 && DistanceMatrix::bytesFor(n) > memoryBudget) {
+            precision = FLOAT_PRECISION;
+        }
+    }
+    if (precision == INT32_PRECISION && negative) precision = FLOAT_PRECISION;
+
+    if (precision == INT32_PRECISION) {
+        // Round, scaled down far enough that no path can reach infinity.
+        if (!integral) scale = 1;
+        if (!intExact && longest * scale >= Matrix<int32_t>::infinity()) {
+            scale = (Matrix<int32_t>::infinity() - 1) / longest;
+        }
+    } else if (precision == DOUBLE_PRECISION || !floatExact) {
+        scale = 1;
+    }
+}
+
+int Graph::matrixSize() const {
+    int size = 0;
+    withMatrix([&](const auto& m) { size = m.size(); });
+    return size;
+}
+
+void Graph::clearMatrix() {
+    adjMatrix.clear();
+    floatMatrix.clear();
+    intMatrix.clear();
+}
+
+double Graph::distance(int u, int v) const {
+    double d = 1e9;
+    withMatrix([&](const auto& m) {
+        if (m[u][v] < m.infinity()) d = m[u][v] / m.scale();
+    });
+    return d;
 }
 
 void Graph::runFloydWarshall() {
-    for (int k = 0; k < n; ++k) {
-        for (int i = 0; i < n; ++i) {
-            for (int j = 0; j < n; ++j) {
-                if (adjMatrix[i][k] != 1e9 && adjMatrix[k][j] != 1e9) {
-                    if (adjMatrix[i][j] > adjMatrix[i][k] + adjMatrix[k][j]) {
-                        adjMatrix[i][j] = adjMatrix[i][k] + adjMatrix[k][j];
-                    }
-                }
-            }
-        }
+    // Once the next hops exist the matrix already holds the shortest paths;
+    // running again would take them as direct roads.
+    if (nextHop.size() != n) {
+        solveAllPairs();
     }
 
+    buildCompleteEdges();
+    state = COMPLETE_KN;
+    ++revision;
+}
+
+void Graph::buildCompleteEdges() {
     currentEdges.clear();
     for (int i = 0; i < n; ++i) {
         for (int j = i + 1; j < n; ++j) {
-            currentEdges.push_back({i, j, adjMatrix[i][j]});
+            currentEdges.push_back({i, j, distance(i, j)});
         }
     }
-    state = COMPLETE_KN;
 }
 
-int Graph::findSet(std::vector<int>& parent, int i) {
-    if (parent[i] != i)
-        parent[i] = findSet(parent, parent[i]);
-    return parent[i];
+// Direct road lengths in a newly chosen precision. Of repeated roads the
+// shortest counts, as it does for the sparse search.
+void Graph::fillRoadMatrix() {
+    double scale;
+    clearMatrix();
+    choosePrecision(activePrecision, scale);
+    withMatrix([&](auto& m) {
+        m.setScale(scale);
+        fillRoads(m, n, roads);
+    });
 }
 
-void Graph::unionSets(std::vector<int>& parent, std::vector<int>& rank, int x, int y) {
-    int xroot = findSet(parent, x);
-    int yroot = findSet(parent, y);
-
-    if (xroot != yroot) {
-        if (rank[xroot] < rank[yroot])
-            parent[xroot] = yroot;
-        else if (rank[xroot] > rank[yroot])
-            parent[yroot] = xroot;
-        else {
-            parent[yroot] = xroot;
-            rank[xroot]++;
+void Graph::solveAllPairs() {
+    bool sparse = allPairsMode == SPARSE_ALL_PAIRS
+                  || (allPairsMode == AUTO_ALL_PAIRS && preferSparseAllPairs(n, network.arcCount()));
+    double scale;
+    clearMatrix();
+    choosePrecision(activePrecision, scale);
+    withMatrix([&](auto& m) {
+        m.setScale(scale);
+        if (!sparse || !dijkstraAllPairs(network, m, nextHop, threadCount)) {
+            fillRoads(m, n, roads);
+            floydWarshall(m, nextHop, threadCount);
         }
+    });
+}
+
+int Graph::getNextHop(int from, int to) const {
+    if (from < 0 || to < 0 || from >= nextHop.size() || to >= nextHop.size()) return -1;
+    return nextHop.get(from, to);
+}
+
+std::vector<Edge> Graph::getShortestPath(int from, int to) const {
+    std::vector<Edge> path;
+    if (getNextHop(from, to) < 0) return path;
+    // Every hop lies on a shortest path, so the distance between its ends is
+    // the road itself. No simple path has more than n - 1 hops; a walk that
+    // gets longer has met a broken table and returns nothing.
+    for (int u = from; u != to;) {
+        int v = nextHop.get(u, to);
+        if (v < 0 || static_cast<int>(path.size()) >= n) return std::vector<Edge>();
+        path.push_back({u, v, distance(u, v)});
+        u = v;
     }
+    return path;
 }
 
-void Graph::runKruskalMST() {
-    std::vector<Edge> allEdges;
-    for (int i = 0; i < n; ++i) {
-        for (int j = i + 1; j < n; ++j) {
-            allEdges.push_back({i, j, adjMatrix[i][j]});
+double Graph::cityDistance(int u, int v) const {
+    return std::hypot(cities[u].x - cities[v].x, cities[u].y - cities[v].y);
+}
+
+std::vector<Arc> Graph::spanningTree() {
+    int engine = mstEngine;
+    if (engine == AUTO_MST && roads.empty()) engine = EUCLIDEAN_MST;
+    euclideanTree = engine == EUCLIDEAN_MST;
+    roadTree = false;
+    if (euclideanTree) {
+        std::vector<double> x(n);
+        std::vector<double> y(n);
+        for (int i = 0; i < n; ++i) {
+            x[i] = cities[i].x;
+            y[i] = cities[i].y;
         }
+        return filterKruskal(n, delaunayEdges(x, y));
+    }
+
+    if (network.hasNegativeWeights()) engine = PRIM_MST;
+    if (engine == AUTO_MST) {
+        // Prim's n^2 against sorting the roads.
+        double m = roads.size();
+        if (m * std::log2(m + 1) > static_cast<double>(n) * n) engine = PRIM_MST;
+        else if (threadCount != 1 && std::thread::hardware_concurrency() > 1) engine = BORUVKA_MST;
+        else engine = FILTER_KRUSKAL_MST;
+    }
+
+    if (engine == PRIM_MST) {
+        if (matrixSize() != n) fillRoadMatrix();
+        std::vector<Arc> tree;
+        withMatrix([&](const auto& m) { tree = primDense(m); });
+        for (Arc& arc : tree) arc.weight = distance(arc.from, arc.to);
+        return tree;
+    }
+
+    roadTree = true;
+    std::vector<Arc> tree;
+    if (engine == BORUVKA_MST) {
+        tree = boruvka(network, threadCount);
+    } else {
+        std::vector<Arc> edges;
+        edges.reserve(roads.size());
+        for (const Edge& road : roads) edges.push_back({road.source, road.dest, road.weight});
+        tree = filterKruskal(n, edges);
+    }
+
+    // The first city of every other component is linked to city 0.
+    DisjointSets sets(n);
+    for (const Arc& arc : tree) sets.unite(arc.from, arc.to);
+    for (int v = 1; v < n; ++v) {
+        if (sets.unite(0, v)) tree.push_back({0, v, 1e9});
     }
-    std::sort(allEdges.begin(), allEdges.end());
+    return tree;
+}
 
-    std::vector<int> parent(n);
-    std::vector<int> rank(n, 0);
-    for (int i = 0; i < n; ++i) parent[i] = i;
+void Graph::runKruskalMST() {
+    mstEdges = spanningTree();
+    buildTreeLists();
+    state = MST_RESULT;
+    ++revision;
+}
 
+void Graph::buildTreeLists() {
     currentEdges.clear();
     mstAdjList.assign(n, std::vector<int>());
+    for (const Arc& arc : mstEdges) {
+        currentEdges.push_back({arc.from, arc.to, arc.weight});
+        mstAdjList[arc.from].push_back(arc.to);
+        mstAdjList[arc.to].push_back(arc.from);
+    }
+}
+
+void Graph::removeRoad(int u, int v) {
+    setRoad(u, v, 1e9);
+}
+
+void Graph::setRoad(int u, int v, double weight) {
+    if (u < 0 || v < 0 || u >= n || v >= n || u == v) return;
+    weight = std::min(weight, 1e9);
+
+    double before = 1e9;
+    auto between = [u, v](const Edge& road) {
+        return (road.source == u && road.dest == v) || (road.source == v && road.dest == u);
+    };
+    for (const Edge& road : roads) {
+        if (between(road)) before = std::min(before, road.weight);
+    }
+    roads.erase(std::remove_if(roads.begin(), roads.end(), between), roads.end());
+    if (weight < 1e9) roads.push_back({u, v, weight});
+    buildNetwork();
+
+    bool fits = true;
+    if (matrixSize() == n) {
+        int precision;
+        double scale;
+        choosePrecision(precision, scale);
+        withMatrix([&](const auto& m) { fits = precision == activePrecision && scale == m.scale(); });
+    }
 
-    int edgesCount = 0;
-    for (const auto& edge : allEdges) {
-        int u = edge.source;
-        int v = edge.dest;
-        if (findSet(parent, u) != findSet(parent, v)) {
-            currentEdges.push_back(edge);
-            unionSets(parent, rank, u, v);
-            mstAdjList[u].push_back(v);
-            mstAdjList[v].push_back(u);
-            edgesCount++;
+    if (before < 0 || weight < 0 || network.hasNegativeWeights() || !fits) {
+        // Negative roads break the repairs below, and the matrix may not hold
+        // the new length exactly; solve whatever was solved before again.
+        bool pairs = nextHop.size() == n;
+        bool matrix = matrixSize() == n;
+        clearMatrix();
+        nextHop.clear();
+        if (pairs) solveAllPairs();
+        else if (matrix) fillRoadMatrix();
+        if (!mstEdges.empty()) {
+            mstEdges = spanningTree();
+            buildTreeLists();
         }
+        refreshEdges();
+        return;
     }
-    state = MST_RESULT;
+
+    if (weight != before) {
+        if (nextHop.size() == n) {
+            withMatrix([&](auto& m) {
+                if (weight < before) lowerRoad(m, nextHop, u, v, weight * m.scale(), threadCount);
+                else raiseRoad(m, nextHop, network, u, v, threadCount);
+            });
+        } else if (matrixSize() == n) {
+            withMatrix([&](auto& m) {
+                m[u][v] = toEntry(m, weight);
+                m[v][u] = m[u][v];
+            });
+        }
+
+        // Straight-line trees do not depend on roads at all.
+        if (!mstEdges.empty() && !euclideanTree) {
+            if (!roadTree) mstEdges = spanningTree();
+            else if (weight < before) lowerTreeRoad(u, v, weight);
+            else raiseTreeRoad(u, v);
+            buildTreeLists();
+        }
+    }
+    refreshEdges();
+}
+
+// Breadth-first search over the tree without edge `skip`. For every city
+// reached from `from` the result holds the index of the tree edge it was
+// reached by; `from` itself gets -1 and cities not reached -2.
+std::vector<int> Graph::treeSearch(int from, int skip) const {
+    std::vector<std::vector<int>> incident(n);
+    for (int e = 0; e < static_cast<int>(mstEdges.size()); ++e) {
+        if (e == skip) continue;
+        incident[mstEdges[e].from].push_back(e);
+        incident[mstEdges[e].to].push_back(e);
+    }
+
+    std::vector<int> via(n, -2);
+    std::vector<int> queue(1, from);
+    via[from] = -1;
+    for (size_t head = 0; head < queue.size(); ++head) {
+        int c = queue[head];
+        for (int e : incident[c]) {
+            int other = mstEdges[e].from == c ? mstEdges[e].to : mstEdges[e].from;
+            if (via[other] != -2) continue;
+            via[other] = e;
+            queue.push_back(other);
+        }
+    }
+    return via;
+}
+
+// Cycle property: the shorter road closes a cycle with the tree path between
+// its ends, and only the heaviest edge on that cycle has to go. When the road
+// already is a tree edge the path is that edge alone.
+void Graph::lowerTreeRoad(int u, int v, double weight) {
+    std::vector<int> via = treeSearch(u, -1);
+    int heaviest = -1;
+    for (int c = v; c != u;) {
+        int e = via[c];
+        if (heaviest < 0 || mstEdges[e].weight > mstEdges[heaviest].weight) heaviest = e;
+        c = mstEdges[e].from == c ? mstEdges[e].to : mstEdges[e].from;
+    }
+    if (mstEdges[heaviest].weight > weight) mstEdges[heaviest] = {u, v, weight};
+}
+
+// Cut property: if the longer road was a tree edge, removing it splits the
+// tree in two and the lightest road across is the new edge. A road outside
+// the tree getting longer changes nothing.
+void Graph::raiseTreeRoad(int u, int v) {
+    int cut = -1;
+    for (int e = 0; e < static_cast<int>(mstEdges.size()); ++e) {
+        const Arc& arc = mstEdges[e];
+        if ((arc.from == u && arc.to == v) || (arc.from == v && arc.to == u)) cut = e;
+    }
+    if (cut < 0) return;
+
+    std::vector<int> side = treeSearch(u, cut);
+    Arc best = {u, v, 1e9};
+    for (const Edge& road : roads) {
+        bool across = (side[road.source] == -2) != (side[road.dest] == -2);
+        if (across && road.weight < best.weight) best = {road.source, road.dest, road.weight};
+    }
+    mstEdges[cut] = best;
+}
+
+// Redraws whatever the current state shows from the updated data.
+void Graph::refreshEdges() {
+    if (state == INITIAL_GRAPH) {
+        currentEdges = roads;
+    } else if (state == COMPLETE_KN) {
+        buildCompleteEdges();
+    } else if (state == MST_RESULT) {
+        buildTreeLists();
+    } else if (tspPath.size() > 1) {
+        buildTourEdges();
+    }
+    ++revision;
 }
 
 void Graph::runTSPPreorder() {
     if (mstAdjList.empty() || n == 0) return;
+    if (!euclideanTree && matrixSize() != n) fillRoadMatrix();
 
     tspPath.clear();
     std::vector<bool> visited(n, false);
@@ -141,23 +492,76 @@ void Graph::runTSPPreorder() {
         tspPath.push_back(tspPath[0]);
     }
 
+    buildTourEdges();
+}
+
+void Graph::runTSPLocalSearch(double timeBudget) {
+    setTour(improvedTour(timeBudget));
+}
+
+std::vector<int> Graph::improvedTour(double timeBudget) const {
+    if (tspPath.size() < 2) return std::vector<int>();
+
+    std::vector<int> tour(tspPath.begin(), tspPath.end() - 1);
+    if (euclideanTree) {
+        std::vector<double> x(n);
+        std::vector<double> y(n);
+        for (int i = 0; i < n; ++i) {
+            x[i] = cities[i].x;
+            y[i] = cities[i].y;
+        }
+        tour = improveTour(tour, x, y, timeBudget, threadCount);
+    } else {
+        withMatrix([&](const auto& m) { tour = improveTour(tour, m, timeBudget, threadCount); });
+    }
+    return tour;
+}
+
+// Ignored unless it visits the same cities as the current tour, which a
+// reload while the search ran may have changed.
+void Graph::setTour(const std::vector<int>& tour) {
+    if (tour.empty() || tour.size() + 1 != tspPath.size()) return;
+    std::vector<int> sorted(tour);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> current(tspPath.begin(), tspPath.end() - 1);
+    std::sort(current.begin(), current.end());
+    if (sorted != current) return;
+
+    // Keep starting from the same city as the preorder walk.
+    std::vector<int> path(tour);
+    std::rotate(path.begin(), std::find(path.begin(), path.end(), tspPath[0]), path.end());
+    path.push_back(path[0]);
+    tspPath = path;
+    buildTourEdges();
+}
+
+void Graph::buildTourEdges() {
     currentEdges.clear();
     for (size_t i = 0; i < tspPath.size() - 1; ++i) {
         int u = tspPath[i];
         int v = tspPath[i+1];
-        currentEdges.push_back({u, v, adjMatrix[u][v]});
+        currentEdges.push_back({u, v, euclideanTree ? cityDistance(u, v) : distance(u, v)});
     }
     state = TSP_CYCLE;
+    ++revision;
 }
 
-std::vector<City> Graph::getCities() const {
+const std::vector<City>& Graph::getCities() const {
     return cities;
 }
 
-std::vector<Edge> Graph::getEdgesToDraw() const {
+const std::vector<Edge>& Graph::getEdgesToDraw() const {
     return currentEdges;
 }
 
 int Graph::getState() const {
     return state;
 }
+
+int Graph::getRevision() const {
+    return revision;
+}
+
+const std::vector<std::string>& Graph::getLoadProblems() const {
+    return loadProblems;
+}
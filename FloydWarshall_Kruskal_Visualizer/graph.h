@@ -6,6 +6,9 @@
 #include <limits>
 #include <QPoint>
 #include <stack>
+#include "distancematrix.h"
+#include "nexthopmatrix.h"
+#include "sparsegraph.h"
 
 struct City {
     std::string name;
@@ -25,14 +28,69 @@ struct Edge {
 class Graph {
 public:
     Graph();
-    void loadFromFile(const std::string& filename);
+    // Reads data.txt-style text, TSPLIB .tsp or the binary .fwb form (see
+    // CityLoader). Returns false, keeping the current graph, if the file
+    // cannot be read; skipped lines are listed by getLoadProblems.
+    bool loadFromFile(const std::string& filename);
+    // Writes the cities and roads in the binary form, which loads with a
+    // few copies out of a memory mapping.
+    bool saveToBinary(const std::string& filename) const;
     void runFloydWarshall();
     void runKruskalMST();
     void runTSPPreorder();
+    // Shortens the current tour with 2-opt / Or-opt local search, spending
+    // up to timeBudget seconds on every thread. Needs runTSPPreorder first.
+    void runTSPLocalSearch(double timeBudget);
+    // The same in two steps, so the search can run on another thread:
+    // improvedTour only reads the graph, and setTour shows its result. Both
+    // return or take the tour without the closing city; an empty one means
+    // there is no tour yet.
+    std::vector<int> improvedTour(double timeBudget) const;
+    void setTour(const std::vector<int>& tour);
+    // Threads used by runFloydWarshall, runKruskalMST and
+    // runTSPLocalSearch; 0 uses every available core.
+    void setThreadCount(int count);
+    // How runFloydWarshall computes all pairs; AUTO_ALL_PAIRS picks by edge
+    // density.
+    void setAllPairsMode(int mode);
+    // Which algorithm runKruskalMST uses; AUTO_MST picks by edge density.
+    void setMstEngine(int engine);
+    // Entry type of the distance matrix; AUTO_PRECISION picks the narrowest
+    // one that keeps every shortest distance exact.
+    void setMatrixPrecision(int precision);
+    // Most bytes the distance matrix may take, 0 for no limit. Over the
+    // limit AUTO_PRECISION gives up exactness and uses floats.
+    void setMemoryBudget(size_t bytes);
+    // The entry type the current matrix was built with.
+    int getMatrixPrecision() const;
 
-    std::vector<City> getCities() const;
-    std::vector<Edge> getEdgesToDraw() const;
+    // Road edits. setRoad adds the road between u and v or changes its
+    // length (a length of 1e9 or more removes it, as does removeRoad);
+    // repeated roads between the two cities become one. Shortest paths,
+    // the spanning tree and the drawn edges are repaired in place rather
+    // than recomputed: a shorter road is one O(n^2) pass over the distance
+    // matrix and a swap with the heaviest tree edge on the cycle it closes,
+    // a longer one re-solves only the paths that used it and, if it was in
+    // the tree, reconnects the two halves with the lightest road between
+    // them. The tour keeps its order. Negative roads and Prim trees on
+    // shortest distances fall back to solving again.
+    void setRoad(int u, int v, double weight);
+    void removeRoad(int u, int v);
+
+    const std::vector<City>& getCities() const;
+    const std::vector<Edge>& getEdgesToDraw() const;
     int getState() const;
+    // Goes up whenever the cities or the edges to draw change, so a view can
+    // keep whatever it built from them until then.
+    int getRevision() const;
+    const std::vector<std::string>& getLoadProblems() const;
+
+    // Shortest path queries answered from the tables runFloydWarshall keeps.
+    // getNextHop returns the node after `from` on the way to `to`, or -1 when
+    // there is no path (or Floyd-Warshall has not run); walking it gives the
+    // route one road at a time. getShortestPath collects the whole route.
+    int getNextHop(int from, int to) const;
+    std::vector<Edge> getShortestPath(int from, int to) const;
 
     enum State {
         INITIAL_GRAPH = 0,
@@ -41,17 +99,104 @@ public:
         TSP_CYCLE = 3
     };
 
+    enum AllPairsMode {
+        AUTO_ALL_PAIRS = 0,
+        // Floyd-Warshall on the n x n matrix.
+        DENSE_ALL_PAIRS = 1,
+        // One Dijkstra per city over the road list; falls back to dense when
+        // negative roads make shortest paths undefined.
+        SPARSE_ALL_PAIRS = 2
+    };
+
+    // Float and int32 matrices hold the weights times the smallest power of
+    // ten (up to 10^6) that makes them all integers. Sums then stay exact as
+    // long as every path fits: below 2^24 for floats, which also allow
+    // negative roads, and below 2^30 for int32, which do not. Paths are at
+    // most n - 1 roads long and never longer than all roads together, which
+    // bounds them before solving.
+    enum MatrixPrecision {
+        AUTO_PRECISION = 0,
+        DOUBLE_PRECISION = 1,
+        // Forced on weights that do not fit, rounds them.
+        FLOAT_PRECISION = 2,
+        // Forced on weights that do not fit, rounds them; negative roads
+        // still use floats.
+        INT32_PRECISION = 3
+    };
+
+    // The tree is a minimum spanning tree of the complete graph of shortest
+    // distances, which for non-negative roads weighs the same as one of the
+    // roads themselves. The sparse engines therefore work on the road list;
+    // cities they leave unconnected are joined with 1e9 links, as the
+    // complete graph would join them.
+    enum MstEngine {
+        AUTO_MST = 0,
+        // O(n^2) Prim on the distance matrix, for dense inputs and negative
+        // roads.
+        PRIM_MST = 1,
+        FILTER_KRUSKAL_MST = 2,
+        // Parallel over threadCount threads.
+        BORUVKA_MST = 3,
+        // Straight-line distances between the cities instead of roads:
+        // Kruskal on the edges of their Delaunay triangulation, without any
+        // n x n matrix. runTSPPreorder then uses straight lines too. The
+        // default for files without roads.
+        EUCLIDEAN_MST = 4
+    };
+
 private:
     int n;
     std::vector<City> cities;
-    std::vector<std::vector<double>> adjMatrix;
+    std::vector<Edge> roads;
+    std::vector<std::string> loadProblems;
+    // Both directions of every road, kept instead of adjMatrix until a
+    // dense matrix is needed.
+    SparseGraph network;
+    // Only the matrix of the active precision is allocated.
+    DistanceMatrix adjMatrix;
+    Matrix<float> floatMatrix;
+    Matrix<int32_t> intMatrix;
+    NextHopMatrix nextHop;
     std::vector<Edge> currentEdges;
+    std::vector<Arc> mstEdges;
     std::vector<std::vector<int>> mstAdjList;
     std::vector<int> tspPath;
     int state;
+    int revision;
+    int threadCount;
+    int allPairsMode;
+    int mstEngine;
+    int matrixPrecision;
+    int activePrecision;
+    size_t memoryBudget;
+    // The current tree was built on straight-line distances.
+    bool euclideanTree;
+    // The current tree is made of roads (and 1e9 links), so road edits can
+    // repair it.
+    bool roadTree;
 
-    int findSet(std::vector<int>& parent, int i);
-    void unionSets(std::vector<int>& parent, std::vector<int>& rank, int x, int y);
+    void buildNetwork();
+    template <typename Fn>
+    void withMatrix(Fn fn);
+    template <typename Fn>
+    void withMatrix(Fn fn) const;
+    void choosePrecision(int& precision, double& scale) const;
+    int matrixSize() const;
+    void clearMatrix();
+    // Shortest (or direct, before solving) distance in road units, 1e9 when
+    // there is none.
+    double distance(int u, int v) const;
+    void fillRoadMatrix();
+    void solveAllPairs();
+    void buildCompleteEdges();
+    std::vector<Arc> spanningTree();
+    void buildTreeLists();
+    std::vector<int> treeSearch(int from, int skip) const;
+    void lowerTreeRoad(int u, int v, double weight);
+    void raiseTreeRoad(int u, int v);
+    void refreshEdges();
+    double cityDistance(int u, int v) const;
+    void buildTourEdges();
     void preorderTraversal(int u, std::vector<bool>& visited, std::vector<Edge>& pathEdges);
 };
 
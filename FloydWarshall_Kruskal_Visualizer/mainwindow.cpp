@@ -1,9 +1,20 @@
 #include "MainWindow.h"
 #include <QPainter>
 #include <QFileDialog>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QPaintEvent>
+#include <unordered_set>
+
+namespace {
+
+// Seconds the tour search of onImproveTSP spends on every thread.
+const double ImproveBudget = 1.0;
+
+}
 
 MainWindow::MainWindow(QWidget *parent)
-    : QMainWindow(parent) {
+    : QMainWindow(parent), paintedRevision(-1) {
 
     centralWidget = new QWidget(this);
     setCentralWidget(centralWidget);
@@ -15,11 +26,17 @@ MainWindow::MainWindow(QWidget *parent)
     btnFloyd = new QPushButton("2. Floyd-Warshall (Kn)", this);
     btnKruskal = new QPushButton("3. MST Kruskal", this);
     btnTSP = new QPushButton("4. TSP Preorder", this);
+    btnImprove = new QPushButton("5. Imbunatatire TSP", this);
+    btnEdit = new QPushButton("6. Modifica Drum", this);
+    btnSave = new QPushButton("7. Salveaza Binar", this);
 
     buttonLayout->addWidget(btnLoad);
     buttonLayout->addWidget(btnFloyd);
     buttonLayout->addWidget(btnKruskal);
     buttonLayout->addWidget(btnTSP);
+    buttonLayout->addWidget(btnImprove);
+    buttonLayout->addWidget(btnEdit);
+    buttonLayout->addWidget(btnSave);
 
     mainLayout->addLayout(buttonLayout);
     mainLayout->addStretch();
@@ -28,17 +45,41 @@ MainWindow::MainWindow(QWidget *parent)
     connect(btnFloyd, &QPushButton::clicked, this, &MainWindow::onRunFloydWarshall);
     connect(btnKruskal, &QPushButton::clicked, this, &MainWindow::onRunKruskal);
     connect(btnTSP, &QPushButton::clicked, this, &MainWindow::onRunTSP);
+    connect(btnImprove, &QPushButton::clicked, this, &MainWindow::onImproveTSP);
+    connect(btnEdit, &QPushButton::clicked, this, &MainWindow::onEditRoad);
+    connect(btnSave, &QPushButton::clicked, this, &MainWindow::onSaveBinary);
 
     resize(800, 600);
 }
 
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow() {
+    if (tspWorker.joinable()) tspWorker.join();
+}
 
 void MainWindow::onLoadData() {
-    QString fileName = QFileDialog::getOpenFileName(this, "Open Data File", "", "Text Files (*.txt)");
-    if (!fileName.isEmpty()) {
-        graph.loadFromFile(fileName.toStdString());
-        update();
+    QString fileName = QFileDialog::getOpenFileName(this, "Open Data File", "",
+                                                    "Data Files (*.txt *.tsp *.fwb);;All Files (*)");
+    if (fileName.isEmpty()) return;
+
+    if (!graph.loadFromFile(fileName.toStdString())) {
+        QMessageBox::warning(this, "Incarca Date", "Fisierul nu a putut fi citit.");
+    }
+    const auto& problems = graph.getLoadProblems();
+    if (!problems.empty()) {
+        QStringList lines;
+        for (size_t i = 0; i < problems.size() && i < 10; ++i) lines.append(QString::fromStdString(problems[i]));
+        if (problems.size() > 10) lines.append("...");
+        QMessageBox::warning(this, "Incarca Date", "Linii ignorate:\n" + lines.join("\n"));
+    }
+    update();
+}
+
+void MainWindow::onSaveBinary() {
+    QString fileName = QFileDialog::getSaveFileName(this, "Save Binary File", "", "Binary Files (*.fwb)");
+    if (fileName.isEmpty()) return;
+    if (!fileName.endsWith(".fwb")) fileName += ".fwb";
+    if (!graph.saveToBinary(fileName.toStdString())) {
+        QMessageBox::warning(this, "Salveaza Binar", "Fisierul nu a putut fi scris.");
     }
 }
 
@@ -57,36 +98,125 @@ void MainWindow::onRunTSP() {
     update();
 }
 
-void MainWindow::paintEvent(QPaintEvent *event) {
-    QPainter painter(this);
-    painter.setRenderHint(QPainter::Antialiasing);
+// The search only reads the graph, so the window keeps painting while it
+// runs on its own thread.
+void MainWindow::onImproveTSP() {
+    if (tspWorker.joinable()) return;
+    setBusy(true);
+    tspWorker = std::thread([this]() {
+        std::vector<int> tour = graph.improvedTour(ImproveBudget);
+        QMetaObject::invokeMethod(this, [this, tour]() {
+            tspWorker.join();
+            graph.setTour(tour);
+            setBusy(false);
+            update();
+        }, Qt::QueuedConnection);
+    });
+}
 
-    auto cities = graph.getCities();
-    auto edges = graph.getEdgesToDraw();
-    int state = graph.getState();
+void MainWindow::setBusy(bool busy) {
+    for (QPushButton* button : {btnLoad, btnFloyd, btnKruskal, btnTSP, btnImprove, btnEdit}) {
+        button->setEnabled(!busy);
+    }
+    btnImprove->setText(busy ? QString("Imbunatatire TSP (%1 s)...").arg(ImproveBudget)
+                             : QString("5. Imbunatatire TSP"));
+}
 
-    if (state == 0) painter.setPen(QPen(Qt::black, 1));
-    else if (state == 1) painter.setPen(QPen(Qt::lightGray, 1));
-    else if (state == 2) painter.setPen(QPen(Qt::blue, 2));
-    else if (state == 3) painter.setPen(QPen(Qt::red, 3));
+// "u v cost" adds or changes a road, "u v" removes it. Anything else,
+// unknown cities or a negative cost (a negative cycle on an undirected
+// road) leaves the graph as it is.
+void MainWindow::onEditRoad() {
+    bool ok = false;
+    QString text = QInputDialog::getText(this, "Modifica Drum", "Oras 1, oras 2, cost (fara cost = sterge):",
+                                         QLineEdit::Normal, "", &ok);
+    if (!ok) return;
+    QStringList parts = text.simplified().split(' ');
+
+    bool valid = parts.size() == 2 || parts.size() == 3;
+    int cityCount = static_cast<int>(graph.getCities().size());
+    int u = valid ? parts[0].toInt(&ok) : -1;
+    valid = valid && ok && u >= 0 && u < cityCount;
+    int v = valid ? parts[1].toInt(&ok) : -1;
+    valid = valid && ok && v >= 0 && v < cityCount && v != u;
+    double cost = 0;
+    if (valid && parts.size() == 3) {
+        cost = parts[2].toDouble(&ok);
+        valid = ok && cost >= 0;
+    }
+    if (!valid) {
+        QMessageBox::warning(this, "Modifica Drum",
+                             "Scrieti doua orase diferite (0 - " + QString::number(cityCount - 1)
+                                 + ") si, optional, un cost nenegativ.");
+        return;
+    }
+
+    if (parts.size() == 3) graph.setRoad(u, v, cost);
+    else graph.removeRoad(u, v);
+    update();
+}
+
+// Weight labels keep to one per cell of this size; past that they overlap
+// and only slow painting down, as after Floyd-Warshall.
+static const int LabelCellWidth = 32;
+static const int LabelCellHeight = 14;
+
+void MainWindow::rebuildPaintCache() {
+    const auto& cities = graph.getCities();
+    const auto& edges = graph.getEdgesToDraw();
+    int state = graph.getState();
 
+    edgeLines.clear();
+    weightPositions.clear();
+    weightLabels.clear();
+    edgeLines.reserve(static_cast<int>(edges.size()));
+    std::unordered_set<long long> usedCells;
     for (const auto& edge : edges) {
         if (edge.source < cities.size() && edge.dest < cities.size()) {
             QPoint p1(cities[edge.source].x, cities[edge.source].y);
             QPoint p2(cities[edge.dest].x, cities[edge.dest].y);
-            painter.drawLine(p1, p2);
+            edgeLines.append(QLine(p1, p2));
 
             if (state == 2 || state == 0) {
                 QPoint mid = (p1 + p2) / 2;
-                painter.drawText(mid, QString::number((int)edge.weight));
+                long long cell = static_cast<long long>(mid.x() / LabelCellWidth) * 1000003
+                                 + mid.y() / LabelCellHeight;
+                if (usedCells.insert(cell).second) {
+                    weightPositions.append(mid);
+                    weightLabels.append(QString::number((int)edge.weight));
+                }
             }
         }
     }
 
+    cityLabels.clear();
+    for (const auto& city : cities) cityLabels.append(QString::fromStdString(city.name));
+    paintedRevision = graph.getRevision();
+}
+
+void MainWindow::paintEvent(QPaintEvent *event) {
+    if (paintedRevision != graph.getRevision()) rebuildPaintCache();
+
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const auto& cities = graph.getCities();
+    int state = graph.getState();
+    QRect visible = event->rect();
+
+    if (state == 0) painter.setPen(QPen(Qt::black, 1));
+    else if (state == 1) painter.setPen(QPen(Qt::lightGray, 1));
+    else if (state == 2) painter.setPen(QPen(Qt::blue, 2));
+    else if (state == 3) painter.setPen(QPen(Qt::red, 3));
+
+    painter.drawLines(edgeLines);
+    for (int i = 0; i < weightLabels.size(); ++i) {
+        if (visible.contains(weightPositions[i])) painter.drawText(weightPositions[i], weightLabels[i]);
+    }
+
     painter.setPen(Qt::black);
     painter.setBrush(Qt::yellow);
-    for (const auto& city : cities) {
-        painter.drawEllipse(QPoint(city.x, city.y), 6, 6);
-        painter.drawText(city.x + 10, city.y, QString::fromStdString(city.name));
+    for (size_t i = 0; i < cities.size(); ++i) {
+        painter.drawEllipse(QPoint(cities[i].x, cities[i].y), 6, 6);
+        painter.drawText(cities[i].x + 10, cities[i].y, cityLabels[static_cast<int>(i)]);
     }
 }
@@ -6,6 +6,10 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QWidget>
+#include <QLine>
+#include <QStringList>
+#include <QVector>
+#include <thread>
 #include "Graph.h"
 
 class MainWindow : public QMainWindow {
@@ -23,9 +27,25 @@ private slots:
     void onRunFloydWarshall();
     void onRunKruskal();
     void onRunTSP();
+    void onImproveTSP();
+    void onEditRoad();
+    void onSaveBinary();
 
 private:
+    void rebuildPaintCache();
+    void setBusy(bool busy);
+
     Graph graph;
+    // Geometry and label text for the current edges, rebuilt only when the
+    // graph's revision changes rather than on every repaint.
+    int paintedRevision;
+    QVector<QLine> edgeLines;
+    QVector<QPoint> weightPositions;
+    QStringList weightLabels;
+    QStringList cityLabels;
+    // Runs the tour search of onImproveTSP; the buttons that change the
+    // graph stay disabled until its result is shown.
+    std::thread tspWorker;
     QWidget *centralWidget;
     QVBoxLayout *mainLayout;
     QHBoxLayout *buttonLayout;
@@ -33,6 +53,9 @@ private:
     QPushButton *btnFloyd;
     QPushButton *btnKruskal;
     QPushButton *btnTSP;
+    QPushButton *btnImprove;
+    QPushButton *btnEdit;
+    QPushButton *btnSave;
 };
 
 #endif
@@ -0,0 +1,106 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+// "No path" for each entry type. Integer weights stop at a quarter of the
+// range so that adding two entries, as every shortest path kernel does,
+// cannot overflow, and the sum of anything with infinity stays at or above
+// infinity. convert() turns an already scaled distance into an entry,
+// rounding for integers.
+template <typename T>
+struct MatrixTraits {
+    static T infinity() { return std::numeric_limits<T>::infinity(); }
+    static T convert(double value) { return static_cast<T>(value); }
+};
+
+template <>
+struct MatrixTraits<int32_t> {
+    static int32_t infinity() { return 0x3FFFFFFF; }
+    static int32_t convert(double value) { return static_cast<int32_t>(std::lround(value)); }
+};
+
+// Allocator handing out 64-byte aligned blocks, so every row of a Matrix
+// starts on a cache line and SIMD loads never straddle one.
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    static const size_t Alignment = 64;
+
+    AlignedAllocator() {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+// Square matrix in one contiguous row-major block, with every row padded to
+// a whole number of cache lines. operator[] returns a pointer to the row, so
+// m[i][j] reads like nested vectors; whole-matrix loops must step rows by
+// stride(), not size().
+//
+// Entries are distances times scale(): a float or int32 matrix holds
+// decimal weights as exact integers (scale 10 for one decimal, and so on),
+// which keeps every sum exact while using half or a quarter of the memory
+// of doubles. MatrixTraits<T>::infinity() marks missing paths.
+template <typename T>
+class Matrix {
+public:
+    Matrix() : n(0), rowStride(0), factor(1) {}
+
+    void assign(int size, T value) {
+        n = size;
+        rowStride = strideFor(size);
+        values.assign(static_cast<size_t>(rowStride) * size, value);
+    }
+
+    // Row stride and memory a matrix of this size takes, before allocating.
+    static int strideFor(int size) {
+        size_t perLine = AlignedAllocator<T>::Alignment / sizeof(T);
+        return static_cast<int>((size + perLine - 1) / perLine * perLine);
+    }
+    static size_t bytesFor(int size) { return static_cast<size_t>(strideFor(size)) * size * sizeof(T); }
+
+    void clear() {
+        n = 0;
+        rowStride = 0;
+        values = std::vector<T, AlignedAllocator<T>>();
+    }
+
+    int size() const { return n; }
+    // Distance between the starts of two consecutive rows.
+    int stride() const { return rowStride; }
+    size_t bytes() const { return values.size() * sizeof(T); }
+
+    double scale() const { return factor; }
+    void setScale(double value) { factor = value; }
+
+    static T infinity() { return MatrixTraits<T>::infinity(); }
+
+    T* operator[](int i) { return values.data() + static_cast<size_t>(i) * rowStride; }
+    const T* operator[](int i) const { return values.data() + static_cast<size_t>(i) * rowStride; }
+
+    T* data() { return values.data(); }
+    const T* data() const { return values.data(); }
+
+private:
+    int n;
+    int rowStride;
+    double factor;
+    std::vector<T, AlignedAllocator<T>> values;
+};
+
+#endif
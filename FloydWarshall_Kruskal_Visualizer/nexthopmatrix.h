@@ -0,0 +1,72 @@
+#ifndef NEXTHOPMATRIX_H
+#define NEXTHOPMATRIX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// For every pair (i, j) the node that follows i on a shortest path to j.
+// Entries use the narrowest unsigned type that holds every node index plus
+// a "no path" value: one byte below 255 nodes, two below 65535, four above.
+// Only the vector of the chosen width is allocated.
+class NextHopMatrix {
+public:
+    NextHopMatrix() : n(0), width(0) {}
+
+    void reset(int size) {
+        clear();
+        n = size;
+        size_t cells = static_cast<size_t>(size) * size;
+        if (size < 0xFF) {
+            width = 1;
+            narrow.assign(cells, 0xFF);
+        } else if (size < 0xFFFF) {
+            width = 2;
+            medium.assign(cells, 0xFFFF);
+        } else {
+            width = 4;
+            wide.assign(cells, 0xFFFFFFFFu);
+        }
+    }
+
+    void clear() {
+        n = 0;
+        width = 0;
+        narrow = std::vector<uint8_t>();
+        medium = std::vector<uint16_t>();
+        wide = std::vector<uint32_t>();
+    }
+
+    int size() const { return n; }
+    // Bytes per entry, 0 while empty.
+    int bytesPerEntry() const { return width; }
+
+    // -1 when j cannot be reached from i.
+    int get(int i, int j) const {
+        size_t c = static_cast<size_t>(i) * n + j;
+        if (width == 1) return narrow[c] == 0xFF ? -1 : narrow[c];
+        if (width == 2) return medium[c] == 0xFFFF ? -1 : medium[c];
+        return wide[c] == 0xFFFFFFFFu ? -1 : static_cast<int>(wide[c]);
+    }
+
+    void set(int i, int j, int hop) {
+        size_t c = static_cast<size_t>(i) * n + j;
+        if (width == 1) narrow[c] = static_cast<uint8_t>(hop);
+        else if (width == 2) medium[c] = static_cast<uint16_t>(hop);
+        else wide[c] = static_cast<uint32_t>(hop);
+    }
+
+    // Raw rows for kernels specialised on the entry type.
+    uint8_t* data8() { return narrow.data(); }
+    uint16_t* data16() { return medium.data(); }
+    uint32_t* data32() { return wide.data(); }
+
+private:
+    int n;
+    int width;
+    std::vector<uint8_t> narrow;
+    std::vector<uint16_t> medium;
+    std::vector<uint32_t> wide;
+};
+
+#endif
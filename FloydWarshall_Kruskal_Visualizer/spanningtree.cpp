@@ -0,0 +1,170 @@
+#include "spanningtree.h"
+#include "disjointsets.h"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
+
+namespace {
+
+// Below this many edges Filter-Kruskal just sorts.
+const size_t SortCutoff = 1024;
+// Nodes per task in the parallel Boruvka scan.
+const int ChunkSize = 1024;
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < std::min(threadCount, count); ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+typedef std::vector<Arc>::iterator ArcIt;
+
+void kruskal(ArcIt begin, ArcIt end, DisjointSets& sets, std::vector<Arc>& tree) {
+    std::sort(begin, end, [](const Arc& a, const Arc& b) { return a.weight < b.weight; });
+    for (ArcIt e = begin; e != end; ++e) {
+        if (sets.unite(e->from, e->to)) tree.push_back(*e);
+    }
+}
+
+void filterKruskal(ArcIt begin, ArcIt end, DisjointSets& sets, std::vector<Arc>& tree, size_t treeSize) {
+    if (static_cast<size_t>(end - begin) <= SortCutoff) {
+        kruskal(begin, end, sets, tree);
+        return;
+    }
+
+    double a = begin->weight;
+    double b = begin[(end - begin) / 2].weight;
+    double c = (end - 1)->weight;
+    double pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+    ArcIt middle = std::partition(begin, end, [pivot](const Arc& e) { return e.weight <= pivot; });
+    if (middle == end) {
+        middle = std::partition(begin, end, [pivot](const Arc& e) { return e.weight < pivot; });
+        // Every weight equals the pivot; any order is sorted.
+        if (middle == begin) {
+            for (ArcIt e = begin; e != end; ++e) {
+                if (sets.unite(e->from, e->to)) tree.push_back(*e);
+            }
+            return;
+        }
+    }
+
+    filterKruskal(begin, middle, sets, tree, treeSize);
+    if (tree.size() == treeSize) return;
+    ArcIt kept = std::partition(middle, end, [&sets](const Arc& e) { return sets.find(e.from) != sets.find(e.to); });
+    filterKruskal(middle, kept, sets, tree, treeSize);
+}
+
+// Total order on edges: weight, then end points. Both directions of an
+// edge compare equal.
+bool lighter(double wa, int ua, int va, double wb, int ub, int vb) {
+    if (wa != wb) return wa < wb;
+    if (std::min(ua, va) != std::min(ub, vb)) return std::min(ua, va) < std::min(ub, vb);
+    return std::max(ua, va) < std::max(ub, vb);
+}
+
+}
+
+template <typename T>
+std::vector<Arc> primDense(const Matrix<T>& dist) {
+    int n = dist.size();
+    std::vector<Arc> tree;
+    if (n == 0) return tree;
+    tree.reserve(n - 1);
+
+    // Every key starts at infinity with node 0 as parent, so a node that
+    // nothing reaches still gets an arc.
+    std::vector<T> key(n, Matrix<T>::infinity());
+    std::vector<int> parent(n, 0);
+    std::vector<char> inTree(n, 0);
+    int u = 0;
+    for (int round = 0; round < n; ++round) {
+        inTree[u] = 1;
+        if (round > 0) tree.push_back({parent[u], u, static_cast<double>(dist[parent[u]][u])});
+
+        // Lower the keys through u and find the next node in the same pass.
+        const T* row = dist[u];
+        int next = -1;
+        for (int v = 0; v < n; ++v) {
+            if (inTree[v]) continue;
+            if (row[v] < key[v]) {
+                key[v] = row[v];
+                parent[v] = u;
+            }
+            if (next < 0 || key[v] < key[next]) next = v;
+        }
+        if (next < 0) break;
+        u = next;
+    }
+    return tree;
+}
+
+template std::vector<Arc> primDense(const Matrix<double>&);
+template std::vector<Arc> primDense(const Matrix<float>&);
+template std::vector<Arc> primDense(const Matrix<int32_t>&);
+
+std::vector<Arc> filterKruskal(int nodeCount, std::vector<Arc> edges) {
+    std::vector<Arc> tree;
+    if (nodeCount == 0) return tree;
+    DisjointSets sets(nodeCount);
+    filterKruskal(edges.begin(), edges.end(), sets, tree, static_cast<size_t>(nodeCount - 1));
+    return tree;
+}
+
+std::vector<Arc> boruvka(const SparseGraph& graph, int threadCount) {
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int n = graph.size();
+    std::vector<Arc> tree;
+    DisjointSets sets(n);
+    std::vector<int> component(n);
+    for (int u = 0; u < n; ++u) component[u] = u;
+    // Per node, then per component: index of the lightest arc leaving it.
+    std::vector<int> nodeBest(n);
+    std::vector<int> componentBest(n);
+    std::vector<int> source(graph.arcCount());
+    for (int u = 0; u < n; ++u) {
+        for (int i = graph.offset[u]; i < graph.offset[u + 1]; ++i) source[i] = u;
+    }
+    auto arcLighter = [&](int a, int b) {
+        return lighter(graph.weight[a], source[a], graph.target[a], graph.weight[b], source[b], graph.target[b]);
+    };
+
+    for (bool merged = true; merged;) {
+        int chunks = (n + ChunkSize - 1) / ChunkSize;
+        parallelFor(chunks, threadCount, [&](int chunk) {
+            int end = std::min(n, (chunk + 1) * ChunkSize);
+            for (int u = chunk * ChunkSize; u < end; ++u) {
+                int best = -1;
+                for (int i = graph.offset[u]; i < graph.offset[u + 1]; ++i) {
+                    if (component[graph.target[i]] == component[u]) continue;
+                    if (best < 0 || arcLighter(i, best)) best = i;
+                }
+                nodeBest[u] = best;
+            }
+        });
+
+        std::fill(componentBest.begin(), componentBest.end(), -1);
+        for (int u = 0; u < n; ++u) {
+            int i = nodeBest[u];
+            int& best = componentBest[component[u]];
+            if (i >= 0 && (best < 0 || arcLighter(i, best))) best = i;
+        }
+
+        merged = false;
+        for (int c = 0; c < n; ++c) {
+            int i = componentBest[c];
+            if (i >= 0 && sets.unite(source[i], graph.target[i])) {
+                tree.push_back({source[i], graph.target[i], graph.weight[i]});
+                merged = true;
+            }
+        }
+        for (int u = 0; u < n; ++u) component[u] = sets.find(u);
+    }
+    return tree;
+}
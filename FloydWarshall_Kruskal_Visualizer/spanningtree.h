@@ -0,0 +1,28 @@
+#ifndef SPANNINGTREE_H
+#define SPANNINGTREE_H
+
+#include <vector>
+#include "distancematrix.h"
+#include "sparsegraph.h"
+
+// Prim on a complete graph given as a matrix, with a plain array of
+// tentative keys instead of a heap: n rounds of an O(n) scan, O(n^2) in
+// all, which no edge list based method beats when there are ~n^2/2 edges.
+// Arc weights are the matrix entries as they are, still scaled; nodes out
+// of reach are joined by arcs weighing Matrix<T>::infinity().
+template <typename T>
+std::vector<Arc> primDense(const Matrix<T>& dist);
+
+// Minimum spanning forest of an undirected edge list (one arc per edge).
+// Filter-Kruskal partitions around a pivot weight like quicksort, solves
+// the light half first and then drops every heavy edge whose ends are
+// already joined before recursing, so most heavy edges are never sorted.
+std::vector<Arc> filterKruskal(int nodeCount, std::vector<Arc> edges);
+
+// Minimum spanning forest by Boruvka rounds on a symmetric graph: every
+// node finds its lightest arc leaving its component in parallel, then each
+// component takes the lightest of its nodes' arcs. Ties are broken by the
+// node indices, so the chosen arcs never close a cycle.
+std::vector<Arc> boruvka(const SparseGraph& graph, int threadCount = 0);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SPARSEGRAPH_H
+#define SPARSEGRAPH_H
+
+#include <vector>
+
+struct Arc {
+    int from;
+    int to;
+    double weight;
+};
+
+// Directed adjacency in compressed sparse row form: the arcs leaving u are
+// target[i], weight[i] for i in [offset[u], offset[u + 1]).
+class SparseGraph {
+public:
+    SparseGraph() : n(0) {}
+
+    void build(int nodeCount, const std::vector<Arc>& arcs) {
+        n = nodeCount;
+        offset.assign(n + 1, 0);
+        for (const Arc& arc : arcs) ++offset[arc.from + 1];
+        for (int u = 0; u < n; ++u) offset[u + 1] += offset[u];
+
+        target.resize(arcs.size());
+        weight.resize(arcs.size());
+        std::vector<int> fill(offset.begin(), offset.end() - 1);
+        for (const Arc& arc : arcs) {
+            int slot = fill[arc.from]++;
+            target[slot] = arc.to;
+            weight[slot] = arc.weight;
+        }
+    }
+
+    void clear() {
+        n = 0;
+        offset.clear();
+        target.clear();
+        weight.clear();
+    }
+
+    int size() const { return n; }
+    int arcCount() const { return static_cast<int>(target.size()); }
+
+    bool hasNegativeWeights() const {
+        for (double w : weight) {
+            if (w < 0) return true;
+        }
+        return false;
+    }
+
+    std::vector<int> offset;
+    std::vector<int> target;
+    std::vector<double> weight;
+
+private:
+    int n;
+};
+
+#endif
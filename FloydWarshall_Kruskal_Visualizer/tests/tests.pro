@@ -0,0 +1,22 @@
+QT = core testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+# The shortest path code is compiled straight from the visualizer; none of
+# these files depend on QtGui or QtWidgets.
+CORE = ..
+INCLUDEPATH += $$CORE
+
+SOURCES += \
+    tst_shortestpaths.cpp \
+    $$CORE/dynamicallpairs.cpp \
+    $$CORE/floydwarshall.cpp
+
+HEADERS += \
+    $$CORE/distancematrix.h \
+    $$CORE/dynamicallpairs.h \
+    $$CORE/floydwarshall.h \
+    $$CORE/matrix.h \
+    $$CORE/nexthopmatrix.h \
+    $$CORE/sparsegraph.h
@@ -0,0 +1,108 @@
+#include <QtTest>
+#include <random>
+#include "dynamicallpairs.h"
+#include "floydwarshall.h"
+
+namespace {
+
+// Complete symmetric matrix, wider than one Floyd-Warshall tile, where about
+// one road in fifty has length 0.
+DistanceMatrix zeroRoads(int n, unsigned seed) {
+    std::mt19937 rng(seed);
+    DistanceMatrix dist;
+    dist.assign(n, 0);
+    for (int i = 0; i < n; ++i) {
+        for (int j = i + 1; j < n; ++j) {
+            double w = rng() % 50 == 0 ? 0 : 1 + rng() % 100;
+            dist[i][j] = w;
+            dist[j][i] = w;
+        }
+    }
+    return dist;
+}
+
+// Walks the hops of every pair, failing on a walk longer than n or one whose
+// roads do not add up to the distance.
+bool hopsReachTargets(const DistanceMatrix& roads, const DistanceMatrix& dist, const NextHopMatrix& next) {
+    int n = dist.size();
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double length = 0;
+            int steps = 0;
+            for (int c = i; c != j; ++steps) {
+                int h = next.get(c, j);
+                if (h < 0 || steps >= n) return false;
+                length += roads[c][h];
+                c = h;
+            }
+            if (length != dist[i][j]) return false;
+        }
+    }
+    return true;
+}
+
+// Both directions of every finite road.
+SparseGraph network(const DistanceMatrix& roads) {
+    int n = roads.size();
+    std::vector<Arc> arcs;
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            if (i != j && roads[i][j] < DistanceMatrix::infinity()) arcs.push_back({i, j, roads[i][j]});
+        }
+    }
+    SparseGraph graph;
+    graph.build(n, arcs);
+    return graph;
+}
+
+}
+
+class TestShortestPaths : public QObject {
+    Q_OBJECT
+
+private slots:
+    void zeroRoadsKeepHopsAcyclic();
+    void raiseRoadSurvivesHopCycle();
+};
+
+void TestShortestPaths::zeroRoadsKeepHopsAcyclic() {
+    for (unsigned seed = 1; seed <= 5; ++seed) {
+        DistanceMatrix roads = zeroRoads(70 + 13 * seed, seed);
+        DistanceMatrix dist = roads;
+        NextHopMatrix next;
+        floydWarshall(dist, next, 2);
+        QVERIFY(hopsReachTargets(roads, dist, next));
+    }
+}
+
+// A longer road after a table whose hops towards one target run in a circle:
+// the repair has to stop walking them and solve those cities again.
+void TestShortestPaths::raiseRoadSurvivesHopCycle() {
+    int n = 70;
+    DistanceMatrix roads = zeroRoads(n, 7);
+    DistanceMatrix dist = roads;
+    NextHopMatrix next;
+    floydWarshall(dist, next);
+
+    int j = 0;
+    int u = 1;
+    int v = next.get(u, j);
+    QVERIFY(v >= 0);
+    int a = u == 2 || v == 2 ? 4 : 2;
+    int b = u == 3 || v == 3 ? 5 : 3;
+    next.set(a, j, b);
+    next.set(b, j, a);
+
+    roads[u][v] = roads[v][u] = roads[u][v] + 500;
+    raiseRoad(dist, next, network(roads), u, v);
+
+    DistanceMatrix fresh = roads;
+    NextHopMatrix freshNext;
+    floydWarshall(fresh, freshNext);
+    for (int i = 0; i < n; ++i) QCOMPARE(dist[i][j], fresh[i][j]);
+    QVERIFY(hopsReachTargets(roads, dist, next));
+}
+
+QTEST_APPLESS_MAIN(TestShortestPaths)
+
+#include "tst_shortestpaths.moc"
@@ -0,0 +1,505 @@
+#include "tourimprove.h"
+#include "disjointsets.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <queue>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Candidate neighbours per city.
+const int NeighborCount = 8;
+// Longest run of cities an Or-opt move takes.
+const int OrOptLength = 3;
+// Longest block a kick moves; keeps kicks and their undo O(1).
+const int KickSpan = 50;
+// Smallest gain taken as an improvement, so rounding cannot cycle.
+const double Tolerance = 1e-9;
+
+template <typename Fn>
+void parallelFor(int count, int threadCount, Fn fn) {
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) fn(i);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < std::min(threadCount, count); ++t) threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads) t.join();
+}
+
+struct EuclideanMetric {
+    const std::vector<double>& x;
+    const std::vector<double>& y;
+    double operator()(int a, int b) const { return std::hypot(x[a] - x[b], y[a] - y[b]); }
+};
+
+template <typename T>
+struct MatrixMetric {
+    const Matrix<T>& dist;
+    double operator()(int a, int b) const {
+        T d = dist[a][b];
+        return d >= Matrix<T>::infinity() ? 1e9 : d / dist.scale();
+    }
+};
+
+// k nearest cities of every city, nearest first, in rows of k. Cities are
+// bucketed in a grid of about two per cell and each search widens ring by
+// ring until no unvisited cell can hold anything closer.
+std::vector<int> nearestOnGrid(const std::vector<double>& x, const std::vector<double>& y, int k) {
+    int n = static_cast<int>(x.size());
+    double minX = *std::min_element(x.begin(), x.end());
+    double minY = *std::min_element(y.begin(), y.end());
+    double width = *std::max_element(x.begin(), x.end()) - minX;
+    double height = *std::max_element(y.begin(), y.end()) - minY;
+    double cell = std::sqrt(width * height * 2 / n);
+    if (!(cell > 0)) cell = std::max(width, height) * 2 / n;
+    if (!(cell > 0)) cell = 1;
+    int cols = static_cast<int>(std::min(width / cell, 4.0 * n)) + 1;
+    int rows = static_cast<int>(std::min(height / cell, 4.0 * n)) + 1;
+    while (static_cast<double>(cols) * rows > 4.0 * n + 4) {
+        cell *= 2;
+        cols = static_cast<int>(width / cell) + 1;
+        rows = static_cast<int>(height / cell) + 1;
+    }
+
+    auto cellOf = [&](int i, int& cx, int& cy) {
+        cx = std::min(cols - 1, static_cast<int>((x[i] - minX) / cell));
+        cy = std::min(rows - 1, static_cast<int>((y[i] - minY) / cell));
+    };
+    std::vector<int> start(static_cast<size_t>(cols) * rows + 1, 0);
+    std::vector<int> members(n);
+    for (int i = 0; i < n; ++i) {
+        int cx, cy;
+        cellOf(i, cx, cy);
+        ++start[static_cast<size_t>(cy) * cols + cx + 1];
+    }
+    for (size_t c = 1; c < start.size(); ++c) start[c] += start[c - 1];
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int i = 0; i < n; ++i) {
+        int cx, cy;
+        cellOf(i, cx, cy);
+        members[fill[static_cast<size_t>(cy) * cols + cx]++] = i;
+    }
+
+    std::vector<int> near(static_cast<size_t>(n) * k);
+    std::priority_queue<std::pair<double, int>> best;
+    for (int i = 0; i < n; ++i) {
+        int cx, cy;
+        cellOf(i, cx, cy);
+        auto scan = [&](int gx, int gy) {
+            if (gx < 0 || gy < 0 || gx >= cols || gy >= rows) return;
+            size_t c = static_cast<size_t>(gy) * cols + gx;
+            for (int m = start[c]; m < start[c + 1]; ++m) {
+                int j = members[m];
+                if (j == i) continue;
+                double d = (x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j]);
+                if (static_cast<int>(best.size()) < k) best.push({d, j});
+                else if (d < best.top().first) {
+                    best.pop();
+                    best.push({d, j});
+                }
+            }
+        };
+        for (int r = 0; r <= std::max(cols, rows); ++r) {
+            for (int dy = -r; dy <= r; ++dy) {
+                if (dy == -r || dy == r) {
+                    for (int dx = -r; dx <= r; ++dx) scan(cx + dx, cy + dy);
+                } else {
+                    scan(cx - r, cy + dy);
+                    scan(cx + r, cy + dy);
+                }
+            }
+            if (static_cast<int>(best.size()) == k && best.top().first <= (r * cell) * (r * cell)) break;
+        }
+        for (int slot = k - 1; slot >= 0; --slot) {
+            near[static_cast<size_t>(i) * k + slot] = best.top().second;
+            best.pop();
+        }
+    }
+    return near;
+}
+
+template <typename T>
+std::vector<int> nearestInMatrix(const Matrix<T>& dist, int k, int threadCount) {
+    int n = dist.size();
+    std::vector<int> near(static_cast<size_t>(n) * k);
+    parallelFor(n, threadCount, [&](int i) {
+        const T* row = dist[i];
+        std::vector<int> others;
+        others.reserve(n - 1);
+        for (int j = 0; j < n; ++j) {
+            if (j != i) others.push_back(j);
+        }
+        auto closer = [row](int a, int b) { return row[a] < row[b]; };
+        std::partial_sort(others.begin(), others.begin() + k, others.end(), closer);
+        std::copy(others.begin(), others.begin() + k, near.begin() + static_cast<size_t>(i) * k);
+    });
+    return near;
+}
+
+template <typename Metric>
+double tourLength(const std::vector<int>& tour, const Metric& dist) {
+    double total = 0;
+    for (size_t i = 0; i < tour.size(); ++i) total += dist(tour[i], tour[i + 1 == tour.size() ? 0 : i + 1]);
+    return total;
+}
+
+// Greedy edge construction over the candidate lists: take candidate edges
+// shortest first whenever both cities still have a free end and the edge
+// closes no cycle, then chain the fragments, each time jumping to the free
+// end nearest to where the last fragment stopped.
+template <typename Metric>
+std::vector<int> greedyTour(int n, const Metric& dist, const std::vector<int>& near, int k) {
+    std::vector<std::pair<double, std::pair<int, int>>> candidates;
+    candidates.reserve(static_cast<size_t>(n) * k);
+    for (int a = 0; a < n; ++a) {
+        for (int i = 0; i < k; ++i) {
+            int b = near[static_cast<size_t>(a) * k + i];
+            candidates.push_back({dist(a, b), {std::min(a, b), std::max(a, b)}});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    DisjointSets fragments(n);
+    std::vector<int> links(2 * static_cast<size_t>(n), -1);
+    auto degree = [&](int c) { return (links[2 * c] >= 0) + (links[2 * c + 1] >= 0); };
+    for (const auto& candidate : candidates) {
+        int a = candidate.second.first;
+        int b = candidate.second.second;
+        if (degree(a) == 2 || degree(b) == 2 || !fragments.unite(a, b)) continue;
+        links[2 * a + degree(a)] = b;
+        links[2 * b + degree(b)] = a;
+    }
+
+    // Fragments are paths, so there are always free ends to start from.
+    std::vector<int> ends;
+    for (int c = 0; c < n; ++c) {
+        if (degree(c) < 2) ends.push_back(c);
+    }
+    std::vector<int> tour;
+    tour.reserve(n);
+    std::vector<char> visited(n, 0);
+    int from = ends[0];
+    while (true) {
+        int prev = -1;
+        int c = from;
+        while (c >= 0) {
+            visited[c] = 1;
+            tour.push_back(c);
+            int next = links[2 * c] >= 0 && links[2 * c] != prev ? links[2 * c] : links[2 * c + 1];
+            prev = c;
+            c = next;
+        }
+
+        from = -1;
+        double best = 0;
+        size_t kept = 0;
+        for (int e : ends) {
+            if (visited[e]) continue;
+            ends[kept++] = e;
+            double d = dist(prev, e);
+            if (from < 0 || d < best) {
+                from = e;
+                best = d;
+            }
+        }
+        ends.resize(kept);
+        if (from < 0) break;
+    }
+    return tour;
+}
+
+// One search state: the tour as an array plus each city's position in it.
+// Every change is a 2-opt move (replace edges (a, b), (c, e) by (a, c),
+// (b, e)) or a kick, and both can be logged and undone.
+template <typename Metric>
+class LocalSearch {
+public:
+    LocalSearch(const Metric& dist, const std::vector<int>& near, int k, const std::vector<int>& start, unsigned seed)
+        : dist(dist), near(near), k(k), n(static_cast<int>(start.size())), tour(start), pos(n), queued(n, 0),
+          logging(false), rng(seed) {
+        for (int i = 0; i < n; ++i) pos[tour[i]] = i;
+        length = tourLength(tour, dist);
+        for (int c : tour) push(c);
+    }
+
+    const std::vector<int>& order() const { return tour; }
+
+    // Improve until no queued city finds a move.
+    void descend() {
+        while (!queue.empty()) {
+            int c = queue.front();
+            queue.pop_front();
+            queued[c] = 0;
+            if (tryTwoOpt(c) || tryOrOpt(c)) push(c);
+        }
+    }
+
+    void perturb(int kicks) {
+        for (int i = 0; i < kicks; ++i) kick();
+    }
+
+    // One kick followed by local search; kept only if the tour got shorter.
+    bool iterate() {
+        double before = length;
+        log.clear();
+        logging = true;
+        Kick applied = kick();
+        descend();
+        logging = false;
+        if (length < before - Tolerance) return true;
+
+        for (size_t i = log.size(); i-- > 0;) {
+            const Move& m = log[i];
+            move(m.a, m.c, m.b, m.e);
+        }
+        if (applied.l1 > 0) {
+            if (succ(applied.a1) == applied.c0) swapBlocks(pos[applied.c0], applied.l2, applied.l1);
+            else swapBlocks(pos[applied.b1], applied.l1, applied.l2);
+        }
+        length = before;
+        return false;
+    }
+
+private:
+    struct Move {
+        int a, b, c, e;
+    };
+    // a1 b0..b1 c0..c1 d0 became a1 c0..c1 b0..b1 d0.
+    struct Kick {
+        int a1, b1, c0, l1, l2;
+    };
+
+    const Metric& dist;
+    const std::vector<int>& near;
+    int k;
+    int n;
+    std::vector<int> tour;
+    std::vector<int> pos;
+    double length;
+    std::vector<char> queued;
+    std::deque<int> queue;
+    std::vector<Move> log;
+    bool logging;
+    std::mt19937 rng;
+
+    int at(int p) const { return tour[p >= n ? p - n : p]; }
+    int succ(int c) const { return at(pos[c] + 1); }
+    int pred(int c) const { return at(pos[c] + n - 1); }
+    int step(int c, bool forward) const { return forward ? succ(c) : pred(c); }
+
+    void push(int c) {
+        if (!queued[c]) {
+            queued[c] = 1;
+            queue.push_back(c);
+        }
+    }
+
+    // Reverse the run of the tour from city `from` forward to city `to`, or
+    // the rest of the tour if that is shorter; the cycle is the same.
+    void reversePath(int from, int to) {
+        int i = pos[from];
+        int j = pos[to];
+        int count = (j - i + n) % n + 1;
+        if (2 * count > n) {
+            i = (j + 1) % n;
+            j = (pos[from] + n - 1) % n;
+            count = n - count;
+        }
+        for (int s = 0; s < count / 2; ++s) {
+            std::swap(tour[i], tour[j]);
+            pos[tour[i]] = i;
+            pos[tour[j]] = j;
+            i = i + 1 == n ? 0 : i + 1;
+            j = j == 0 ? n - 1 : j - 1;
+        }
+    }
+
+    // b follows a and e follows c in the same direction.
+    void move(int a, int b, int c, int e) {
+        if (succ(a) == b) reversePath(b, c);
+        else reversePath(c, b);
+        if (logging) log.push_back({a, b, c, e});
+    }
+
+    void swapBlocks(int start, int l1, int l2) {
+        std::vector<int> cities(l1 + l2);
+        for (int i = 0; i < l1 + l2; ++i) cities[i] = at(start + i);
+        std::rotate(cities.begin(), cities.begin() + l1, cities.end());
+        for (int i = 0; i < l1 + l2; ++i) {
+            int p = (start + i) % n;
+            tour[p] = cities[i];
+            pos[cities[i]] = p;
+        }
+    }
+
+    bool tryTwoOpt(int a) {
+        for (int dir = 0; dir < 2; ++dir) {
+            bool forward = dir == 0;
+            int b = step(a, forward);
+            double ab = dist(a, b);
+            for (int i = 0; i < k; ++i) {
+                int c = near[static_cast<size_t>(a) * k + i];
+                double ac = dist(a, c);
+                if (ac >= ab - Tolerance) break;
+                int e = step(c, forward);
+                if (c == b || e == a) continue;
+                double delta = ac + dist(b, e) - ab - dist(c, e);
+                if (delta < -Tolerance) {
+                    move(a, b, c, e);
+                    length += delta;
+                    push(b);
+                    push(c);
+                    push(e);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Move the run s1..e starting at a (in either direction) between some x
+    // near one of its ends and the city after x.
+    bool tryOrOpt(int a) {
+        for (int dir = 0; dir < 2; ++dir) {
+            bool forward = dir == 0;
+            int segment[OrOptLength];
+            int s1 = a;
+            int e = a;
+            for (int len = 1; len <= OrOptLength && len + 4 <= n; ++len) {
+                if (len > 1) e = step(e, forward);
+                segment[len - 1] = e;
+                int p = step(s1, !forward);
+                int nx = step(e, forward);
+                double removed = dist(p, s1) + dist(e, nx) - dist(p, nx);
+                if (removed <= Tolerance) continue;
+                auto inSegment = [&](int c) {
+                    for (int i = 0; i < len; ++i) {
+                        if (segment[i] == c) return true;
+                    }
+                    return false;
+                };
+
+                for (int end = 0; end < 2; ++end) {
+                    int t = end == 0 ? s1 : e;
+                    for (int i = 0; i < k; ++i) {
+                        int c = near[static_cast<size_t>(t) * k + i];
+                        if (dist(t, c) >= removed - Tolerance) break;
+                        for (int side = 0; side < 2; ++side) {
+                            int x = side == 0 ? c : step(c, !forward);
+                            int x2 = step(x, forward);
+                            if (inSegment(x) || inSegment(x2) || x == nx || x2 == p) continue;
+                            double base = dist(x, x2);
+                            double keep = dist(x, s1) + dist(e, x2) - base - removed;
+                            double flip = dist(x, e) + dist(s1, x2) - base - removed;
+                            if (keep < -Tolerance && keep <= flip) {
+                                move(p, s1, e, nx);
+                                move(p, e, x, x2);
+                                move(p, x, nx, s1);
+                                length += keep;
+                            } else if (flip < -Tolerance) {
+                                move(p, s1, x, x2);
+                                move(p, x, nx, e);
+                                length += flip;
+                            } else {
+                                continue;
+                            }
+                            push(p);
+                            push(nx);
+                            push(s1);
+                            push(e);
+                            push(x);
+                            push(x2);
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    // Double bridge on a short stretch: swap two adjacent blocks.
+    Kick kick() {
+        Kick applied = {0, 0, 0, 0, 0};
+        if (n < 8) return applied;
+        int span = std::min(KickSpan, (n - 2) / 2);
+        int l1 = 1 + static_cast<int>(rng() % span);
+        int l2 = 1 + static_cast<int>(rng() % span);
+        int i = static_cast<int>(rng() % n);
+        int a1 = tour[i];
+        int b0 = at(i + 1);
+        int b1 = at(i + l1);
+        int c0 = at(i + l1 + 1);
+        int c1 = at(i + l1 + l2);
+        int d0 = at(i + l1 + l2 + 1);
+        length += dist(a1, c0) + dist(c1, b0) + dist(b1, d0) - dist(a1, b0) - dist(b1, c0) - dist(c1, d0);
+        swapBlocks((i + 1) % n, l1, l2);
+        for (int c : {a1, b0, b1, c0, c1, d0}) push(c);
+        applied = {a1, b1, c0, l1, l2};
+        return applied;
+    }
+};
+
+template <typename Metric>
+std::vector<int> improve(const std::vector<int>& tour, const Metric& metric, const std::vector<int>& near, int k,
+                         double timeBudget, int threadCount) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline =
+        Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeBudget));
+
+    // Start from the greedy tour when it is the shorter one, as it usually is
+    // against an MST walk.
+    std::vector<int> start = greedyTour(static_cast<int>(tour.size()), metric, near, k);
+    if (tourLength(start, metric) >= tourLength(tour, metric)) start = tour;
+
+    std::vector<std::vector<int>> tours(threadCount);
+    std::vector<double> lengths(threadCount);
+    parallelFor(threadCount, threadCount, [&](int t) {
+        LocalSearch<Metric> search(metric, near, k, start, 7919u * t + 1);
+        if (t > 0) search.perturb(static_cast<int>(tour.size()) / 50 + 1);
+        search.descend();
+        while (timeBudget > 0 && Clock::now() < deadline) search.iterate();
+        tours[t] = search.order();
+        lengths[t] = tourLength(search.order(), metric);
+    });
+
+    int best = static_cast<int>(std::min_element(lengths.begin(), lengths.end()) - lengths.begin());
+    if (lengths[best] >= tourLength(tour, metric)) return tour;
+    return tours[best];
+}
+
+int resolveThreads(int threadCount) {
+    return threadCount > 0 ? threadCount : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+}
+
+std::vector<int> improveTour(const std::vector<int>& tour, const std::vector<double>& x,
+                             const std::vector<double>& y, double timeBudget, int threadCount) {
+    int n = static_cast<int>(tour.size());
+    if (n < 5) return tour;
+    int k = std::min(NeighborCount, n - 1);
+    EuclideanMetric metric = {x, y};
+    return improve(tour, metric, nearestOnGrid(x, y, k), k, timeBudget, resolveThreads(threadCount));
+}
+
+template <typename T>
+std::vector<int> improveTour(const std::vector<int>& tour, const Matrix<T>& dist, double timeBudget,
+                             int threadCount) {
+    int n = static_cast<int>(tour.size());
+    if (n < 5) return tour;
+    int k = std::min(NeighborCount, n - 1);
+    threadCount = resolveThreads(threadCount);
+    MatrixMetric<T> metric = {dist};
+    return improve(tour, metric, nearestInMatrix(dist, k, threadCount), k, timeBudget, threadCount);
+}
+
+template std::vector<int> improveTour(const std::vector<int>&, const Matrix<double>&, double, int);
+template std::vector<int> improveTour(const std::vector<int>&, const Matrix<float>&, double, int);
+template std::vector<int> improveTour(const std::vector<int>&, const Matrix<int32_t>&, double, int);
@@ -0,0 +1,35 @@
+#ifndef TOURIMPROVE_H
+#define TOURIMPROVE_H
+
+#include <vector>
+#include "distancematrix.h"
+
+// Local search on a closed tour, given as the order of the cities without
+// repeating the first one at the end. Returns a tour that is never longer.
+// The search starts from a greedy edge tour over the candidate lists below
+// instead whenever that one is shorter. (Christofides would need a minimum
+// weight perfect matching, O(n^3), far more than the local search spends.)
+//
+// Moves are 2-opt and Or-opt (moving a run of up to three cities, either
+// way round, between two others: the segment insertion subset of 3-opt).
+// Only the k nearest cities of each city are tried as new neighbours, and
+// cities whose surroundings have not changed since they last failed to
+// improve are skipped (don't-look bits), so one improvement pass is about
+// O(n k) instead of O(n^2).
+//
+// After the first local optimum every thread runs its own iterated local
+// search: a random double-bridge kick on a short stretch of the tour, local
+// search around it, and an undo if the result is not shorter. Threads
+// other than the first start from a perturbed copy of the tour. The
+// shortest tour found within timeBudget seconds wins; with a budget of 0
+// every thread stops at its first local optimum. threadCount <= 0 uses
+// every core.
+std::vector<int> improveTour(const std::vector<int>& tour, const std::vector<double>& x,
+                             const std::vector<double>& y, double timeBudget, int threadCount = 0);
+// The matrix form reads distances as entry / dist.scale(), with
+// Matrix<T>::infinity() counting as 1e9.
+template <typename T>
+std::vector<int> improveTour(const std::vector<int>& tour, const Matrix<T>& dist, double timeBudget,
+                             int threadCount = 0);
+
+#endif
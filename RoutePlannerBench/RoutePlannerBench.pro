@@ -0,0 +1,42 @@
+QT = core
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# The routing core is compiled straight from the GUI project; none of these
+# files depend on QtGui or QtWidgets.
+CORE = ../DijkstraRoutePlanner
+INCLUDEPATH += $$CORE
+
+SOURCES += \
+    main.cpp \
+    $$CORE/contractionhierarchy.cpp \
+    $$CORE/distancetable.cpp \
+    $$CORE/graph.cpp \
+    $$CORE/isochrone.cpp \
+    $$CORE/kdtree.cpp \
+    $$CORE/landmarks.cpp \
+    $$CORE/maploader.cpp \
+    $$CORE/routecache.cpp \
+    $$CORE/routeengine.cpp
+
+HEADERS += \
+    $$CORE/contractionhierarchy.h \
+    $$CORE/distancetable.h \
+    $$CORE/edgeweights.h \
+    $$CORE/geo.h \
+    $$CORE/graph.h \
+    $$CORE/indexedheap.h \
+    $$CORE/isochrone.h \
+    $$CORE/kdtree.h \
+    $$CORE/landmarks.h \
+    $$CORE/maploader.h \
+    $$CORE/routecache.h \
+    $$CORE/routeengine.h \
+    $$CORE/searchspace.h
+
+win32: LIBS += -lpsapi
+
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,425 @@
+#include "graph.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Pair {
+    long startId;
+    long endId;
+};
+
+struct Result {
+    QString algorithm;
+    QString order;
+    int batch;
+    int threads;
+    int queries;
+    int found;
+    double wallSeconds;
+    double prepMs;
+    double p50Us;
+    double p95Us;
+    double p99Us;
+    double meanSettled;
+    double distanceSum;
+    long long cacheHits;
+    long long treeHits;
+    long long cacheKb;
+    long long peakRssKb;
+};
+
+long long peakRssKb() {
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+bool readPairs(const QString& path, std::vector<Pair>& pairs) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return false;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        line.replace(',', ' ').replace(';', ' ');
+        QStringList parts = line.simplified().split(' ', Qt::SkipEmptyParts);
+        if (parts.size() < 2) continue;
+        bool okStart = false, okEnd = false;
+        Pair p = {parts[0].toLong(&okStart), parts[1].toLong(&okEnd)};
+        if (okStart && okEnd) pairs.push_back(p);
+    }
+    return true;
+}
+
+// Drawn from the ids in sorted order, so a seed gives the same pairs
+// whatever node order the graph uses. With hotspots > 0 both ends come from
+// that many random nodes, like requests clustered around a few places. A
+// graph without nodes gives no pairs.
+std::vector<Pair> randomPairs(const Graph& graph, int count, unsigned seed, int hotspots) {
+    std::vector<long> ids;
+    ids.reserve(graph.nodeCount());
+    for (const Node& node : graph.getNodes()) ids.push_back(node.id);
+    std::sort(ids.begin(), ids.end());
+    if (ids.empty()) return {};
+
+    std::mt19937 rng(seed);
+    if (hotspots > 0 && hotspots < static_cast<int>(ids.size())) {
+        std::shuffle(ids.begin(), ids.end(), rng);
+        ids.resize(hotspots);
+    }
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(ids.size()) - 1);
+    std::vector<Pair> pairs(count);
+    for (auto& p : pairs) {
+        p.startId = ids[pick(rng)];
+        p.endId = ids[pick(rng)];
+    }
+    return pairs;
+}
+
+// One batch of traffic updates on edgeCount random edges: a third get
+// longer, a third shorter, and the rest are split between closing the edge
+// and restoring it. Edges are drawn like randomPairs(), from a start node
+// in id order and then one of its edges.
+std::vector<EdgeWeightUpdate> randomUpdates(const Graph& graph, int edgeCount, std::mt19937& rng) {
+    std::vector<EdgeWeightUpdate> updates;
+    std::vector<long> ids;
+    ids.reserve(graph.nodeCount());
+    for (const Node& node : graph.getNodes()) ids.push_back(node.id);
+    std::sort(ids.begin(), ids.end());
+    if (ids.empty()) return updates;
+
+    const auto& offsets = graph.getEdgeOffsets();
+    const auto& targets = graph.getEdgeTargets();
+    const auto& nodes = graph.getNodes();
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(ids.size()) - 1);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (int i = 0; i < edgeCount; ++i) {
+        int u = graph.indexOf(ids[pick(rng)]);
+        int degree = offsets[u + 1] - offsets[u];
+        if (degree == 0) continue;
+        int v = targets[offsets[u] + static_cast<int>(rng() % degree)];
+
+        double kind = unit(rng);
+        double factor;
+        if (kind < 1.0 / 3) factor = 1 + 2 * unit(rng);
+        else if (kind < 2.0 / 3) factor = 0.5 + 0.5 * unit(rng);
+        else if (kind < 5.0 / 6) factor = EdgeWeightUpdate::Closed;
+        else factor = 1;
+        updates.push_back({nodes[u].id, nodes[v].id, factor});
+    }
+    return updates;
+}
+
+double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t i = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+Result runBenchmark(const Graph& graph, RoutingAlgorithm algorithm, const std::vector<Pair>& pairs,
+                    int threadCount, bool useCache) {
+    int count = static_cast<int>(pairs.size());
+    std::vector<double> latencyUs(count, 0);
+    std::vector<int> settled(count, 0);
+    std::vector<double> distance(count, -1);
+
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        RouteEngine engine(graph);
+        engine.setAlgorithm(algorithm);
+        if (useCache) engine.setRouteCache(&graph.getRouteCache());
+        for (int i = next++; i < count; i = next++) {
+            int source = graph.indexOf(pairs[i].startId);
+            int target = graph.indexOf(pairs[i].endId);
+
+            auto begin = std::chrono::steady_clock::now();
+            std::vector<int> path = engine.shortestPath(source, target);
+            auto end = std::chrono::steady_clock::now();
+
+            latencyUs[i] = std::chrono::duration<double, std::micro>(end - begin).count();
+            settled[i] = engine.lastSettledCount();
+            if (!path.empty()) distance[i] = engine.lastDistance();
+        }
+    };
+
+    // Every algorithm starts from an empty cache.
+    graph.getRouteCache().clear();
+    graph.getRouteCache().resetStats();
+
+    QElapsedTimer wall;
+    wall.start();
+    std::vector<std::thread> threads;
+    for (int t = 1; t < threadCount; ++t) threads.emplace_back(work);
+    work();
+    for (auto& t : threads) t.join();
+    double wallSeconds = wall.nsecsElapsed() / 1e9;
+
+    Result r;
+    r.threads = threadCount;
+    r.queries = count;
+    r.found = 0;
+    r.wallSeconds = wallSeconds;
+    r.meanSettled = 0;
+    r.distanceSum = 0;
+    for (int i = 0; i < count; ++i) {
+        r.meanSettled += settled[i];
+        if (distance[i] >= 0) {
+            ++r.found;
+            r.distanceSum += distance[i];
+        }
+    }
+    if (count > 0) r.meanSettled /= count;
+
+    std::sort(latencyUs.begin(), latencyUs.end());
+    r.p50Us = percentile(latencyUs, 0.50);
+    r.p95Us = percentile(latencyUs, 0.95);
+    r.p99Us = percentile(latencyUs, 0.99);
+    RouteCacheStats cache = graph.getRouteCache().stats();
+    r.cacheHits = cache.hits;
+    r.treeHits = cache.treeHits;
+    r.cacheKb = static_cast<long long>(cache.bytes / 1024);
+    r.peakRssKb = peakRssKb();
+    return r;
+}
+
+void writeCsv(QTextStream& out, const std::vector<Result>& results) {
+    out << "algorithm,order,batch,threads,queries,found,wall_s,qps,p50_us,p95_us,p99_us,mean_settled,prep_ms,distance_sum,cache_hits,tree_hits,cache_kb,peak_rss_kb\n";
+    for (const Result& r : results) {
+        out << r.algorithm << ',' << r.order << ',' << r.batch << ',' << r.threads << ',' << r.queries << ',' << r.found << ','
+            << QString::number(r.wallSeconds, 'f', 4) << ','
+            << QString::number(r.queries / std::max(r.wallSeconds, 1e-9), 'f', 1) << ','
+            << QString::number(r.p50Us, 'f', 1) << ',' << QString::number(r.p95Us, 'f', 1) << ','
+            << QString::number(r.p99Us, 'f', 1) << ',' << QString::number(r.meanSettled, 'f', 1) << ','
+            << QString::number(r.prepMs, 'f', 1) << ',' << QString::number(r.distanceSum, 'f', 3) << ','
+            << r.cacheHits << ',' << r.treeHits << ',' << r.cacheKb << ',' << r.peakRssKb << '\n';
+    }
+}
+
+void writeJson(QTextStream& out, const std::vector<Result>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "  {\"algorithm\": \"" << r.algorithm << "\", \"order\": \"" << r.order
+            << "\", \"batch\": " << r.batch << ", \"threads\": " << r.threads
+            << ", \"queries\": " << r.queries << ", \"found\": " << r.found
+            << ", \"wall_s\": " << QString::number(r.wallSeconds, 'f', 4)
+            << ", \"qps\": " << QString::number(r.queries / std::max(r.wallSeconds, 1e-9), 'f', 1)
+            << ", \"p50_us\": " << QString::number(r.p50Us, 'f', 1)
+            << ", \"p95_us\": " << QString::number(r.p95Us, 'f', 1)
+            << ", \"p99_us\": " << QString::number(r.p99Us, 'f', 1)
+            << ", \"mean_settled\": " << QString::number(r.meanSettled, 'f', 1)
+            << ", \"prep_ms\": " << QString::number(r.prepMs, 'f', 1)
+            << ", \"distance_sum\": " << QString::number(r.distanceSum, 'f', 3)
+            << ", \"cache_hits\": " << r.cacheHits << ", \"tree_hits\": " << r.treeHits
+            << ", \"cache_kb\": " << r.cacheKb
+            << ", \"peak_rss_kb\": " << r.peakRssKb << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("RoutePlannerBench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs batches of route queries against a map and reports throughput and latency.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("map", "Map file in the planner's XML format.");
+
+    QCommandLineOption pairsOption("pairs", "File with one \"startId endId\" pair per line.", "file");
+    QCommandLineOption randomOption("random", "Number of random pairs when no pair file is given.", "count", "1000");
+    QCommandLineOption seedOption("seed", "Seed for the random pairs.", "seed", "1");
+    QCommandLineOption hotspotsOption("hotspots", "Draw random pairs among this many nodes only.", "count", "0");
+    QCommandLineOption cacheOption("cache", "Share the graph's route cache between the query threads.");
+    QCommandLineOption threadsOption("threads", "Number of query threads.", "count",
+                                     QString::number(std::max(1u, std::thread::hardware_concurrency())));
+    QCommandLineOption algorithmsOption("algorithms", "Comma separated list of dijkstra, astar, alt, ch.", "list",
+                                        "dijkstra,astar,alt,ch");
+    QCommandLineOption landmarksOption("landmarks", "Number of ALT landmarks.", "count", "16");
+    QCommandLineOption updatesOption("updates", "Traffic update batches to apply after the first run; every "
+                                     "algorithm runs again after each one.", "count", "0");
+    QCommandLineOption updateEdgesOption("update-edges", "Edges changed by each update batch.", "count", "1000");
+    QCommandLineOption orderOption("order", "Node numbering: file, hilbert or bfs.", "order", "hilbert");
+    QCommandLineOption formatOption("format", "Output format, csv or json.", "format", "csv");
+    QCommandLineOption outputOption("output", "Write the report to a file instead of stdout.", "file");
+    parser.addOption(pairsOption);
+    parser.addOption(randomOption);
+    parser.addOption(seedOption);
+    parser.addOption(hotspotsOption);
+    parser.addOption(cacheOption);
+    parser.addOption(threadsOption);
+    parser.addOption(algorithmsOption);
+    parser.addOption(landmarksOption);
+    parser.addOption(updatesOption);
+    parser.addOption(updateEdgesOption);
+    parser.addOption(orderOption);
+    parser.addOption(formatOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QTextStream err(stderr);
+    if (parser.positionalArguments().isEmpty()) {
+        err << "No map file given.\n";
+        return 1;
+    }
+
+    QString order = parser.value(orderOption).toLower();
+    Graph graph;
+    if (order == "file") {
+        graph.setNodeOrder(FileOrder);
+    } else if (order == "bfs") {
+        graph.setNodeOrder(BreadthFirstOrder);
+    } else if (order == "hilbert") {
+        graph.setNodeOrder(HilbertOrder);
+    } else {
+        err << "Unknown node order " << order << "\n";
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!graph.loadFromXml(parser.positionalArguments().first())) {
+        err << "Could not load " << parser.positionalArguments().first() << "\n";
+        return 1;
+    }
+    if (graph.nodeCount() == 0) {
+        err << "No nodes in " << parser.positionalArguments().first() << "\n";
+        return 1;
+    }
+    err << "Loaded " << graph.nodeCount() << " nodes and " << graph.edgeCount() << " edges in "
+        << timer.elapsed() << " ms\n";
+
+    std::vector<Pair> pairs;
+    if (parser.isSet(pairsOption)) {
+        if (!readPairs(parser.value(pairsOption), pairs)) {
+            err << "Could not read " << parser.value(pairsOption) << "\n";
+            return 1;
+        }
+    } else {
+        pairs = randomPairs(graph, std::max(0, parser.value(randomOption).toInt()),
+                            parser.value(seedOption).toUInt(), parser.value(hotspotsOption).toInt());
+    }
+
+    int threadCount = std::max(1, parser.value(threadsOption).toInt());
+    QStringList keys;
+    for (const QString& name : parser.value(algorithmsOption).split(',', Qt::SkipEmptyParts)) {
+        keys.push_back(name.trimmed().toLower());
+    }
+    std::vector<Result> results;
+    for (const QString& key : keys) {
+        RoutingAlgorithm algorithm;
+        timer.start();
+        if (key == "dijkstra") {
+            algorithm = BidirectionalDijkstra;
+        } else if (key == "astar") {
+            algorithm = AStar;
+        } else if (key == "alt") {
+            algorithm = AltAStar;
+            graph.prepareLandmarks(parser.value(landmarksOption).toInt());
+        } else if (key == "ch") {
+            algorithm = ContractionHierarchies;
+            graph.prepareContractionHierarchy();
+        } else {
+            err << "Unknown algorithm " << key << "\n";
+            return 1;
+        }
+        double prepMs = timer.nsecsElapsed() / 1e6;
+
+        err << "Running " << key << " on " << pairs.size() << " pairs with " << threadCount << " threads\n";
+        err.flush();
+        Result r = runBenchmark(graph, algorithm, pairs, threadCount, parser.isSet(cacheOption));
+        r.algorithm = key;
+        r.order = order;
+        r.batch = 0;
+        r.prepMs = prepMs;
+        results.push_back(r);
+    }
+
+    // Update batches. prep_ms is then the time from the start of the update
+    // until the algorithm can run on the new lengths: applying the batch,
+    // which includes the landmark repair, and for ch also waiting for the
+    // hierarchy rebuilt in the background. Every fourth batch is a reset.
+    int batches = std::max(0, parser.value(updatesOption).toInt());
+    int updateEdges = std::max(0, parser.value(updateEdgesOption).toInt());
+    std::mt19937 updateRng(parser.value(seedOption).toUInt());
+    for (int batch = 1; batch <= batches; ++batch) {
+        std::vector<EdgeWeightUpdate> updates = randomUpdates(graph, updateEdges, updateRng);
+        timer.start();
+        int changed = batch % 4 == 0 ? graph.resetEdgeWeights() : graph.updateEdgeWeights(updates);
+        double updateMs = timer.nsecsElapsed() / 1e6;
+        err << "Batch " << batch << (batch % 4 == 0 ? " (reset)" : "") << " changed " << changed
+            << " edges in " << QString::number(updateMs, 'f', 1) << " ms\n";
+
+        for (const QString& key : keys) {
+            RoutingAlgorithm algorithm = key == "dijkstra" ? BidirectionalDijkstra
+                                       : key == "astar"    ? AStar
+                                       : key == "alt"      ? AltAStar
+                                                           : ContractionHierarchies;
+            double prepMs = updateMs;
+            if (algorithm == ContractionHierarchies) {
+                graph.waitForContractionHierarchy();
+                prepMs = timer.nsecsElapsed() / 1e6;
+            }
+
+            err << "Running " << key << " after batch " << batch << "\n";
+            err.flush();
+            Result r = runBenchmark(graph, algorithm, pairs, threadCount, parser.isSet(cacheOption));
+            r.algorithm = key;
+            r.order = order;
+            r.batch = batch;
+            r.prepMs = prepMs;
+            results.push_back(r);
+        }
+    }
+
+    QFile outputFile;
+    QTextStream out(stdout);
+    if (parser.isSet(outputOption)) {
+        outputFile.setFileName(parser.value(outputOption));
+        if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            err << "Could not write " << outputFile.fileName() << "\n";
+            return 1;
+        }
+        out.setDevice(&outputFile);
+    }
+
+    if (parser.value(formatOption).toLower() == "json") {
+        writeJson(out, results);
+    } else {
+        writeCsv(out, results);
+    }
+    return 0;
+}